@@ -152,6 +152,7 @@ Mapping Map[] = {
     {"EnableIPCM",               &cfgparams.EnableIPCM,                   0,   0.0,                       1,  0.0,              2.0,                             },
     {"ChromaIntraDisable",       &cfgparams.ChromaIntraDisable,           0,   0.0,                       1,  0.0,              1.0,                             },
     {"RDOptimization",           &cfgparams.rdopt,                        0,   0.0,                       1,  0.0,              4.0,                             },
+    {"WavefrontModeDecision",    &cfgparams.WavefrontModeDecision,        0,   0.0,                       1,  0.0,              1.0,                             },
 
     {"DistortionEstimation",     &cfgparams.de,                           0,   1.0,                       2,  0.0,              8.0,                             },
     {"SubMBCodingState",         &cfgparams.subMBCodingState,             0,   2.0,                       1,  0.0,              2.0,                             },
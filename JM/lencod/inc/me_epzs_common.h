@@ -108,9 +108,12 @@ extern void    EPZS_hierarchical_predictors    (EPZSParameters * p_EPZS, MEBlock
  
 extern void  EPZSDelete                (VideoParameters *p_Vid);
 extern void  EPZSStructDelete          (Slice *currSlice);
+extern void  EPZSStructCopyDelete      (Slice *copySlice);
 extern void  EPZSSliceInit             (Slice *currSlice);
 extern int   EPZSInit                  (VideoParameters *p_Vid);
 extern int   EPZSStructInit            (Slice *currSlice);
+extern int   EPZSStructCopy            (Slice *copySlice, Slice *currSlice);
+extern void  EPZSStructCopyReset       (Slice *copySlice);
 extern void  EPZSOutputStats           (InputParameters *p_Inp, FILE * stat, short stats_file);
 extern void  EPZS_setup_engine         (Macroblock *, InputParameters *);
 /*!
@@ -212,6 +212,7 @@ struct inp_par_enc
   int full_search;
 
   int rdopt;
+  int WavefrontModeDecision;  //!< decide macroblock modes in wavefront order, in parallel
   int de;     //!< the algorithm to estimate the distortion in the decoder
   int I16rdo; 
   int MDReference[2];
@@ -1070,6 +1070,32 @@ static void PatchInp (VideoParameters *p_Vid, InputParameters *p_Inp)
     error (errortext, 500);
   }
 
+  // Wavefront mode decision needs decisions that don't depend on the entropy coder state or
+  // on macroblocks after the current one in raster order
+  if (p_Inp->WavefrontModeDecision)
+  {
+    if (p_Inp->rdopt || p_Inp->UseRDOQuant || p_Inp->CtxAdptLagrangeMult || p_Inp->AdaptiveRounding || p_Inp->RCEnable)
+    {
+      snprintf(errortext, ET_SIZE, "WavefrontModeDecision requires RDOptimization=0 and no RDOQuant, CtxAdptLagrangeMult, AdaptiveRounding or rate control.");
+      error (errortext, 500);
+    }
+    if (p_Inp->slice_mode || p_Inp->num_slice_groups_minus1 || p_Inp->PicInterlace || p_Inp->MbInterlace)
+    {
+      snprintf(errortext, ET_SIZE, "WavefrontModeDecision requires one frame slice per picture (SliceMode=0, no FMO or interlace).");
+      error (errortext, 500);
+    }
+    if (p_Inp->SearchMode[0] != EPZS && p_Inp->SearchMode[0] != FULL_SEARCH)
+    {
+      snprintf(errortext, ET_SIZE, "WavefrontModeDecision supports only the EPZS and full search motion estimation (SearchMode 3 or -1).");
+      error (errortext, 500);
+    }
+    if (p_Inp->yuv_format == YUV444 || p_Inp->sp_periodicity || p_Inp->si_frame_indicator || p_Inp->num_of_views > 1)
+    {
+      snprintf(errortext, ET_SIZE, "WavefrontModeDecision is not supported for 4:4:4, SP/SI slices or multiview coding.");
+      error (errortext, 500);
+    }
+  }
+
   // Tian Dong: May 31, 2002
   // The number of frames in one sub-seq in enhanced layer should not exceed
   // the number of reference frame number.
@@ -338,6 +338,9 @@ void get_intrapred_16x16(Macroblock *currMB, ColorPlane pl, int i16x16_mode, int
 
 distblk distI16x16_satd(Macroblock *currMB, imgpel **img_org, imgpel **pred_img, distblk min_cost)
 {
+#if USE_SHIM==1
+  return (dist_scale((distblk) distI16x16_satd_Shim(currMB, img_org, pred_img)));
+#else
   Slice *currSlice = currMB->p_Slice;
   int   **M7 = NULL;
   int   **tblk4x4 = currSlice->tblk4x4;
@@ -408,14 +411,20 @@ distblk distI16x16_satd(Macroblock *currMB, imgpel **img_org, imgpel **pred_img,
 
   current_intra_sad_2 += (dist_scale((distblk)i32Cost));
   return current_intra_sad_2;
+#endif
 }
 
 distblk distI16x16_sad(Macroblock *currMB, imgpel **img_org, imgpel **pred_img, distblk min_cost)
 {
+#if USE_SHIM==1
+  int imin_cost = dist_down(min_cost);
+  int cost = distI16x16_sad_Shim(currMB, img_org, pred_img, imin_cost);
+  return cost > imin_cost ? min_cost : dist_scale((distblk) cost);
+#else
   imgpel *cur_img, *prd_img;
   int i32Cost = 0;
   int i, j; 
-//  int imin_cost = dist_down(min_cost);
+  int imin_cost = dist_down(min_cost);
 
   for (j = 0; j < MB_BLOCK_SIZE; j++)
   {
@@ -426,15 +435,20 @@ distblk distI16x16_sad(Macroblock *currMB, imgpel **img_org, imgpel **pred_img,
       i32Cost += abs( *cur_img++ - *prd_img++ );
     }
 
-    // JESS disabled b/c the equivalent in shim breaks something with buildit
-//    if (i32Cost > imin_cost)
-//      return (min_cost);
+    if (i32Cost > imin_cost)
+      return (min_cost);
   }
   return (dist_scale((distblk) i32Cost));
+#endif
 }
 
 distblk distI16x16_sse(Macroblock *currMB, imgpel **img_org, imgpel **pred_img, distblk min_cost)
 {
+#if USE_SHIM==1
+  int imin_cost = dist_down(min_cost);
+  int cost = distI16x16_sse_Shim(currMB, img_org, pred_img, imin_cost);
+  return cost > imin_cost ? min_cost : dist_scale((distblk) cost);
+#else
   imgpel *cur_img, *prd_img;  
   int i, j, i32Cost = 0; 
   int imin_cost = dist_down(min_cost);
@@ -453,6 +467,7 @@ distblk distI16x16_sse(Macroblock *currMB, imgpel **img_org, imgpel **pred_img,
   }
 
   return (dist_scale((distblk) i32Cost));
+#endif
 }
 
 
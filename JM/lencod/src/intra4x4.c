@@ -18,6 +18,10 @@
 #include "image.h"
 #include "mb_access.h"
 
+#if USE_SHIM==1
+#include "ShimJM_generated.h"
+#endif
+
 void generate_pred_error_4x4(imgpel **cur_img, imgpel **prd_img, imgpel **cur_prd, int **m7, int pic_opix_x, int block_x)
 {
   int j, i, *m7_line;
@@ -520,6 +524,9 @@ void set_intrapred_4x4(Macroblock *currMB, ColorPlane pl, int img_x,int img_y, i
  */
 void get_intrapred_4x4(Macroblock *currMB, ColorPlane pl, int i4x4_mode, int img_x, int img_y, int left_available, int up_available)
 {
+#if USE_SHIM==1
+  get_intrapred_4x4_Shim(currMB, pl, i4x4_mode, left_available, up_available);
+#else
   imgpel        *PredPel = currMB->intra4x4_pred[pl];  // array of predictor pels
   imgpel ***curr_mpr_4x4 = currMB->p_Slice->mpr_4x4[pl];
 
@@ -558,4 +565,5 @@ void get_intrapred_4x4(Macroblock *currMB, ColorPlane pl, int i4x4_mode, int img
     printf("invalid prediction mode \n");
     break;
   }
+#endif
 }
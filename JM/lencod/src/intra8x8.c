@@ -16,6 +16,10 @@
 #include "mb_access.h"
 #include "intra8x8.h"
 
+#if USE_SHIM==1
+#include "ShimJM_generated.h"
+#endif
+
 // Notation for comments regarding prediction and predictors.
 // The pels of the 8x8 block are labelled a1..h8. The predictor pels above
 // are labelled A..P, from the left Q..X, and from above left Z, as follows:
@@ -715,6 +719,9 @@ void set_intrapred_8x8_mbaff(Macroblock *currMB, ColorPlane pl, int img_x,int im
  */
 void get_intrapred_8x8(Macroblock *currMB, ColorPlane pl, int i8x8_mode, int left_available, int up_available)
 {
+#if USE_SHIM==1
+  get_intrapred_8x8_Shim(currMB, pl, i8x8_mode, left_available, up_available);
+#else
   imgpel *PredPel = currMB->intra8x8_pred[pl];  // array of predictor pels
   Slice *currSlice = currMB->p_Slice;
   imgpel ***curr_mpr_8x8  = currSlice->mpr_8x8[pl];
@@ -752,5 +759,6 @@ void get_intrapred_8x8(Macroblock *currMB, ColorPlane pl, int i8x8_mode, int lef
     printf("invalid prediction mode \n");
     break;
   }
+#endif
 }
 
@@ -19,6 +19,10 @@
 #include "block.h"
 #include "mv_search.h"
 
+#if USE_SHIM==1
+#include "ShimJM_generated.h"
+#endif
+
 void get_difference_4x4(imgpel **src, imgpel **prd, short *diff, int pos_x, int block_x)
 {
   int i, j;
@@ -352,6 +356,9 @@ void set_intrapred_chroma_mbaff(Macroblock *currMB, ColorPlane pl, int *left_ava
  */
 void get_intrapred_chroma(Macroblock *currMB, ColorPlane pl, int iChroma_mode, int left_available, int up_available)
 {
+#if USE_SHIM==1
+  get_intrapred_chroma_Shim(currMB, pl, iChroma_mode, left_available, up_available);
+#else
   VideoParameters *p_Vid = currMB->p_Vid;
   imgpel   *PredPel = currMB->intra16x16_pred[pl];  // array of predictor pels
   imgpel ***curr_mpr_16x16 = currMB->p_Slice->mpr_16x16[pl];
@@ -376,6 +383,7 @@ void get_intrapred_chroma(Macroblock *currMB, ColorPlane pl, int iChroma_mode, i
     printf("invalid prediction mode \n");
     break;
   }
+#endif
 }
 
 void rdo_low_intra_chroma_decision_mbaff(Macroblock *currMB, int mb_available_up, int mb_available_left[2], int mb_available_up_left)
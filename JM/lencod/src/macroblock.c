@@ -413,7 +413,15 @@ void start_macroblock(Slice *currSlice, Macroblock **currMB, int mb_addr, bool m
   // Rate control
   (*currMB)->qpsp = (short) p_Vid->qpsp;
 
-  if (prev_mb > -1 && (p_Vid->mb_data[prev_mb].slice_nr == currSlice->slice_nr))
+  if (p_Inp->WavefrontModeDecision)
+  {
+    // The previous MB in raster order may still be undecided. Without rate
+    // control every MB of the (single) slice is coded with the slice QP.
+    (*currMB)->PrevMB   = (prev_mb > -1) ? &p_Vid->mb_data[prev_mb] : NULL;
+    (*currMB)->prev_qp  = (short) currSlice->qp;
+    (*currMB)->prev_dqp = 0;
+  }
+  else if (prev_mb > -1 && (p_Vid->mb_data[prev_mb].slice_nr == currSlice->slice_nr))
   {
     (*currMB)->PrevMB   = &p_Vid->mb_data[prev_mb];
     (*currMB)->prev_qp  = (*currMB)->PrevMB->qp;
@@ -436,7 +444,8 @@ void start_macroblock(Slice *currSlice, Macroblock **currMB, int mb_addr, bool m
     mb_qp = p_Vid->qp;
   }
 
-  last_coded_mb = *currMB;   // save the address of the last coded MB
+  if (p_Inp->RCEnable)
+    last_coded_mb = *currMB;   // save the address of the last coded MB
   
   if ((*currMB)->mbAddrX == 0)
     p_Vid->BasicUnitQP = mb_qp;
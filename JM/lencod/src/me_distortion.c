@@ -25,6 +25,10 @@
 #include "mv_search.h"
 #include "me_distortion.h"
 
+#if USE_SHIM==1
+#include "ShimJM_generated.h"
+#endif
+
 
 //#define CHECKOVERFLOW(mcost) assert(mcost>=0)
 #define CHECKOVERFLOW(mcost) 
@@ -37,12 +41,16 @@
 */
 distblk distortion4x4SAD(short* diff, distblk min_dist)
 {
+#if USE_SHIM==1
+  return (dist_scale((distblk) distortion4x4SAD_Shim(diff)));
+#else
   int distortion = 0, k;
   for (k = 0; k < 16; k++)
   {
     distortion += iabs(*diff++);
   }
   return (dist_scale((distblk) distortion));
+#endif
 }
 
 /*!
@@ -53,12 +61,16 @@ distblk distortion4x4SAD(short* diff, distblk min_dist)
 */
 distblk distortion4x4SSE(short* diff, distblk min_dist)
 {
+#if USE_SHIM==1
+  return (dist_scale((distblk) distortion4x4SSE_Shim(diff)));
+#else
   int distortion = 0, k;
   for (k = 0; k < 16; k++)
   {
     distortion += iabs2(*diff++);
   }
   return (dist_scale((distblk) distortion));
+#endif
 }
 
 /*!
@@ -81,6 +93,9 @@ distblk distortion4x4SATD(short* diff, distblk min_dist)
 */
 distblk distortion8x8SADthres(short* diff, distblk min_cost)
 {
+#if USE_SHIM==1
+  return (dist_scale((distblk) distortion8x8SADthres_Shim(diff, dist_down(min_cost))));
+#else
   int distortion = 0;
   int i, j;  
   int imin_cost = dist_down(min_cost);
@@ -96,6 +111,7 @@ distblk distortion8x8SADthres(short* diff, distblk min_cost)
   }
 
   return (dist_scale((distblk) distortion));
+#endif
 }
 
 /*!
@@ -106,6 +122,9 @@ distblk distortion8x8SADthres(short* diff, distblk min_cost)
 */
 distblk distortion8x8SAD(short* diff, distblk min_dist)
 {
+#if USE_SHIM==1
+  return (dist_scale((distblk) distortion8x8SAD_Shim(diff)));
+#else
   int distortion = 0;
   int k;
 
@@ -114,6 +133,7 @@ distblk distortion8x8SAD(short* diff, distblk min_dist)
     distortion += iabs(*diff++);
   }
   return (dist_scale((distblk) distortion));
+#endif
 }
 
 /*!
@@ -124,6 +144,9 @@ distblk distortion8x8SAD(short* diff, distblk min_dist)
 */
 distblk distortion8x8SSE(short* diff, distblk min_dist)
 {
+#if USE_SHIM==1
+  return (dist_scale((distblk) distortion8x8SSE_Shim(diff)));
+#else
   distblk distortion = 0;
   int k;
   for (k = 0; k < 64; k++)
@@ -131,6 +154,7 @@ distblk distortion8x8SSE(short* diff, distblk min_dist)
     distortion += iabs2(*diff++);
   }
   return (dist_scale(distortion));
+#endif
 }
 
 /*!
@@ -174,6 +198,9 @@ void select_distortion(VideoParameters *p_Vid, InputParameters *p_Inp)
 */
 int HadamardSAD4x4 (short* diff)
 {
+#if USE_SHIM==1
+  return HadamardSAD4x4_Shim(diff);
+#else
   int k, satd = 0;
   int m[16], d[16];
 
@@ -255,6 +282,7 @@ int HadamardSAD4x4 (short* diff)
 
 
   return ((satd+1)>>1);
+#endif
 }
 
 /*!
@@ -265,6 +293,9 @@ int HadamardSAD4x4 (short* diff)
 */
 int HadamardSAD8x8 (short* diff)
 {
+#if USE_SHIM==1
+  return HadamardSAD8x8_Shim(diff);
+#else
   int i, j, jj, sad=0;
 
   // Hadamard related arrays
@@ -338,6 +369,7 @@ int HadamardSAD8x8 (short* diff)
       sad += iabs (m2[j][i]);
 
   return ((sad+2)>>2);
+#endif
 }
 
 /*!
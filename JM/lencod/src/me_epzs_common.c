@@ -609,6 +609,85 @@ EPZSStructDelete (Slice * currSlice)
   currSlice->p_EPZS = NULL;
 }
 
+/*!
+************************************************************************
+* \brief
+*    Size of the EPZS search map
+************************************************************************
+*/
+static int
+EPZSSearchArraySize (VideoParameters * p_Vid, InputParameters * p_Inp)
+{
+  return p_Inp->BiPredMotionEstimation ? (2 * imax (p_Inp->search_range[p_Vid->view_id], p_Inp->BiPredMESearchRange[p_Vid->view_id]) +
+    1) << 2 : (2 * p_Inp->search_range[p_Vid->view_id] + 1) << 2;
+}
+
+/*!
+************************************************************************
+* \brief
+*    Give copySlice an EPZS structure of its own, for searches run in
+*    parallel with those of currSlice. The search map and the predictor
+*    list are private, everything else is shared with currSlice.
+************************************************************************
+*/
+int
+EPZSStructCopy (Slice * copySlice, Slice * currSlice)
+{
+  VideoParameters *p_Vid = currSlice->p_Vid;
+  InputParameters *p_Inp = currSlice->p_Inp;
+  EPZSParameters *p_EPZS;
+  int searchlevels = RoundLog2 (p_Inp->search_range[p_Vid->view_id]) - 1;
+  int searcharray = EPZSSearchArraySize (p_Vid, p_Inp);
+
+  if ((p_EPZS = (EPZSParameters *) malloc (sizeof (EPZSParameters))) == NULL)
+    no_mem_exit ("EPZSStructCopy: p_EPZS");
+  *p_EPZS = *currSlice->p_EPZS;
+  p_EPZS->p_Vid = copySlice->p_Vid;
+#if (MVC_EXTENSION_ENABLE)
+  p_EPZS->predictor = allocEPZSpattern (10 + searchlevels * 24 + 5 + 5 + 9 * (p_Inp->EPZSTemporal[0] | p_Inp->EPZSTemporal[1]) + 3 * (p_Inp->EPZSSpatialMem));
+#else
+  p_EPZS->predictor = allocEPZSpattern (10 + searchlevels * 24 + 5 + 5 + 9 * (p_Inp->EPZSTemporal) + 3 * (p_Inp->EPZSSpatialMem));
+#endif
+  copySlice->p_EPZS = p_EPZS;
+
+  return get_mem2Dshort ((short ***) &(p_EPZS->EPZSMap), searcharray, searcharray);
+}
+
+/*!
+************************************************************************
+* \brief
+*    Clear the search map of an EPZS copy, so that the searches of a
+*    macroblock don't depend on which macroblocks the copy searched before
+************************************************************************
+*/
+void
+EPZSStructCopyReset (Slice * copySlice)
+{
+  EPZSParameters *p_EPZS = copySlice->p_EPZS;
+  int searcharray = EPZSSearchArraySize (copySlice->p_Vid, copySlice->p_Inp);
+
+  memset (p_EPZS->EPZSMap[0], 0, searcharray * searcharray * sizeof (uint16));
+  p_EPZS->BlkCount = 1;
+}
+
+/*!
+************************************************************************
+* \brief
+*    Delete an EPZS structure made by EPZSStructCopy
+************************************************************************
+*/
+void
+EPZSStructCopyDelete (Slice * copySlice)
+{
+  EPZSParameters *p_EPZS = copySlice->p_EPZS;
+
+  free_mem2Dshort ((short **) p_EPZS->EPZSMap);
+  freeEPZSpattern (p_EPZS->predictor);
+
+  free (copySlice->p_EPZS);
+  copySlice->p_EPZS = NULL;
+}
+
 //! For ME purposes restricting the co-located partition is not necessary.
 /*!
 ************************************************************************
@@ -46,6 +46,10 @@
 #include "md_distortion.h"
 #include "intra16x16.h"
 
+#if USE_SHIM==1
+#include "ShimJM_generated.h"
+#endif
+
 #define FASTMODE 1
 
 static void set_stored_macroblock_parameters      (Macroblock *currMB);
@@ -3770,6 +3774,11 @@ int valid_intra_mode(Slice *currSlice, int ipmode)
 
 distblk compute_sad4x4_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **prd_img, int pic_opix_x, distblk min_cost)
 {
+#if USE_SHIM==1
+  int imin_cost = dist_down(min_cost);
+  int cost = compute_sad4x4_cost_Shim(cur_img, prd_img, pic_opix_x, imin_cost);
+  return cost > imin_cost ? min_cost : dist_scale((distblk) cost);
+#else
   imgpel *cur_line, *prd_line;
   int i32Cost = 0;  
   int imin_cost = dist_down(min_cost);
@@ -3791,10 +3800,16 @@ distblk compute_sad4x4_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **p
     }
   }
   return dist_scale(i32Cost);
+#endif
 }
 
 distblk compute_sse4x4_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **prd_img, int pic_opix_x, distblk min_cost)
 {
+#if USE_SHIM==1
+  int imin_cost = dist_down(min_cost);
+  int cost = compute_sse4x4_cost_Shim(cur_img, prd_img, pic_opix_x, imin_cost);
+  return cost > imin_cost ? min_cost : dist_scale((distblk) cost);
+#else
   int j, i;
   imgpel *cur_line, *prd_line;
   int i32Cost = 0;
@@ -3814,10 +3829,14 @@ distblk compute_sse4x4_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **p
     }
   }
   return dist_scale(i32Cost);
+#endif
 }
 
 distblk compute_satd4x4_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **prd_img, int pic_opix_x, distblk min_cost)
 {
+#if USE_SHIM==1
+  return dist_scale((distblk) compute_satd4x4_cost_Shim(cur_img, prd_img, pic_opix_x));
+#else
   int j, i;
   imgpel *cur_line, *prd_line;
   short diff[16];
@@ -3836,6 +3855,7 @@ distblk compute_satd4x4_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **
   }
 
   return dist_scale(HadamardSAD4x4 (diff));
+#endif
 }
 
 static distblk compute_comp4x4_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **prd_img, int pic_opix_x, distblk min_cost)
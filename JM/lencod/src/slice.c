@@ -19,6 +19,9 @@
 
 #include <math.h>
 #include <float.h>
+#if defined(OPENMP)
+#include <omp.h>
+#endif
 
 #include "global.h"
 #include "header.h"
@@ -420,6 +423,252 @@ static void init_bipred_enabled(VideoParameters *p_Vid)
     p_Vid->bipred_enabled[mode] = (p_Inp->BiPredSearch[mode - 1]) ? 1: 0;
 }
 
+/*!
+************************************************************************
+* \brief
+*    Private copies of the state that macroblock mode decision writes,
+*    for one thread of the wavefront mode decision
+************************************************************************
+*/
+typedef struct wavefront_worker
+{
+  VideoParameters p_Vid;
+  Slice           slice;
+} WavefrontWorker;
+
+/*!
+************************************************************************
+* \brief
+*    Sets up a wavefront worker as a copy of currSlice, with its own
+*    mode decision scratch memory
+************************************************************************
+*/
+static void init_wavefront_worker (WavefrontWorker *worker, Slice *currSlice)
+{
+  VideoParameters *p_Vid = currSlice->p_Vid;
+  InputParameters *p_Inp = currSlice->p_Inp;
+  VideoParameters *wVid  = &worker->p_Vid;
+  Slice *wSlice = &worker->slice;
+
+  memcpy(wVid, p_Vid, sizeof(VideoParameters));
+  memcpy(wSlice, currSlice, sizeof(Slice));
+  wVid->currentSlice = wSlice;
+  wSlice->p_Vid = wVid;
+  wSlice->rddata = &wSlice->rddata_top_frame_mb;
+
+  if ((wVid->b8x8info = (Block8x8Info *) calloc(1, sizeof(Block8x8Info))) == NULL)
+    no_mem_exit("init_wavefront_worker: b8x8info");
+
+  if (wSlice->slice_type != I_SLICE)
+  {
+    get_mem4Ddistblk (&wVid->motion_cost, 8, 2, p_Vid->max_num_references, 4);
+    get_mem5Dmv (&wSlice->all_mv, 2, wSlice->max_num_references, 9, 4, 4);
+    if (p_Inp->BiPredMotionEstimation && (wSlice->slice_type == B_SLICE))
+      get_mem6Dmv (&wSlice->bipred_mv, 2, 2, wSlice->max_num_references, 9, 4, 4);
+    if (p_Inp->SearchMode[p_Vid->view_id] == EPZS)
+      EPZSStructCopy (wSlice, currSlice);
+  }
+
+  get_mem3Dpel(&wSlice->mb_pred,   MAX_PLANE, MB_BLOCK_SIZE, MB_BLOCK_SIZE);
+  get_mem3Dint(&wSlice->mb_rres,   MAX_PLANE, MB_BLOCK_SIZE, MB_BLOCK_SIZE);
+  get_mem3Dint(&wSlice->mb_ores,   MAX_PLANE, MB_BLOCK_SIZE, MB_BLOCK_SIZE);
+  get_mem4Dpel(&wSlice->mpr_4x4,   MAX_PLANE, 9, MB_BLOCK_SIZE, MB_BLOCK_SIZE);
+  get_mem4Dpel(&wSlice->mpr_8x8,   MAX_PLANE, 9, MB_BLOCK_SIZE, MB_BLOCK_SIZE);
+  get_mem4Dpel(&wSlice->mpr_16x16, MAX_PLANE, 5, MB_BLOCK_SIZE, MB_BLOCK_SIZE);
+
+  get_mem_ACcoeff (wVid, &wSlice->cofAC);
+  get_mem_DCcoeff (&wSlice->cofDC);
+
+  allocate_block_mem(wSlice);
+
+  if ((wSlice->p_RDO = (RDOPTStructure *) calloc(1, sizeof(RDOPTStructure))) == NULL)
+    no_mem_exit("init_wavefront_worker: p_RDO");
+  init_rdopt(wSlice);
+}
+
+/*!
+************************************************************************
+* \brief
+*    Frees the memory of a wavefront worker
+************************************************************************
+*/
+static void free_wavefront_worker (WavefrontWorker *worker, VideoParameters *p_Vid)
+{
+  InputParameters *p_Inp = p_Vid->p_Inp;
+  VideoParameters *wVid  = &worker->p_Vid;
+  Slice *wSlice = &worker->slice;
+
+  clear_rdopt (wSlice);
+  free (wSlice->p_RDO);
+
+  free_block_mem(wSlice);
+
+  free_mem_ACcoeff (wSlice->cofAC);
+  free_mem_DCcoeff (wSlice->cofDC);
+
+  free_mem3Dint(wSlice->mb_rres);
+  free_mem3Dint(wSlice->mb_ores);
+  free_mem3Dpel(wSlice->mb_pred);
+  free_mem4Dpel(wSlice->mpr_16x16);
+  free_mem4Dpel(wSlice->mpr_8x8);
+  free_mem4Dpel(wSlice->mpr_4x4);
+
+  if (wSlice->slice_type != I_SLICE)
+  {
+    free_mem4Ddistblk (wVid->motion_cost);
+    free_mem5Dmv (wSlice->all_mv);
+    if (p_Inp->BiPredMotionEstimation && (wSlice->slice_type == B_SLICE))
+      free_mem6Dmv (wSlice->bipred_mv);
+    if (p_Inp->SearchMode[p_Vid->view_id] == EPZS)
+      EPZSStructCopyDelete (wSlice);
+  }
+
+  free (wVid->b8x8info);
+}
+
+/*!
+************************************************************************
+* \brief
+*    Decides the mode of one macroblock with the state of a wavefront
+*    worker, and keeps what writing the macroblock needs from it
+************************************************************************
+*/
+static void decide_wavefront_macroblock (WavefrontWorker *worker, int mb_addr, int *cofAC, int *cofDC, signed char *b8only)
+{
+  VideoParameters *p_Vid = &worker->p_Vid;
+  Slice *currSlice = &worker->slice;
+  Macroblock *currMB;
+
+  if (currSlice->slice_type != I_SLICE && p_Vid->p_Inp->SearchMode[p_Vid->view_id] == EPZS)
+    EPZSStructCopyReset (currSlice);
+
+  // -1 flags that this macroblock's decision left giRDOpt_B8OnlyFlag alone
+  p_Vid->giRDOpt_B8OnlyFlag = (Boolean) -1;
+
+  start_macroblock (currSlice, &currMB, mb_addr, FALSE);
+  p_Vid->masterQP = p_Vid->qp;
+
+  currSlice->encode_one_macroblock (currMB);
+  end_encode_one_macroblock(currMB);
+
+  memcpy(cofAC, currSlice->cofAC[0][0][0], (BLOCK_SIZE + p_Vid->num_blk8x8_uv) * BLOCK_SIZE * 2 * 65 * sizeof(int));
+  memcpy(cofDC, currSlice->cofDC[0][0], 3 * 2 * 18 * sizeof(int));
+  *b8only = (signed char) p_Vid->giRDOpt_B8OnlyFlag;
+}
+
+/*!
+************************************************************************
+* \brief
+*    Encodes the macroblocks of a slice in two passes. Mode decision
+*    goes over anti-diagonal waves of macroblocks, where macroblock
+*    (x, y) is in wave x + 2y, so that its left, top and top right
+*    neighbours are decided in earlier waves. The macroblocks of a wave
+*    are decided in parallel when built with OpenMP. The macroblocks
+*    are then written in raster order.
+*    Only used for a single frame slice without RD optimization or
+*    rate control (see configfile.c), where mode decision doesn't
+*    depend on the entropy coder, and the result is the same as with
+*    the raster order loop of encode_one_slice.
+* \par
+*   returns the last coded macroblock
+************************************************************************
+*/
+static Macroblock *encode_slice_wavefront (Slice *currSlice, int CurrentMbAddr, int *NumberOfCodedMBs)
+{
+  VideoParameters *p_Vid = currSlice->p_Vid;
+  Macroblock *currMB = NULL;
+  Boolean end_of_slice = FALSE;
+  Boolean recode_macroblock;
+  int width  = p_Vid->PicWidthInMbs;
+  int height = p_Vid->PicSizeInMbs / width;
+  int waves  = width + 2 * (height - 1);
+  int ac_size = (BLOCK_SIZE + p_Vid->num_blk8x8_uv) * BLOCK_SIZE * 2 * 65;
+  int dc_size = 3 * 2 * 18;
+  int num_workers = 1;
+  int i, wave;
+  int64 me_time, me_tot_time;
+  WavefrontWorker *workers;
+  int **cofAC, **cofDC;
+  signed char *b8only;
+
+#if defined(OPENMP)
+  num_workers = omp_get_max_threads();
+#endif
+
+  if ((workers = (WavefrontWorker *) calloc(num_workers, sizeof(WavefrontWorker))) == NULL)
+    no_mem_exit("encode_slice_wavefront: workers");
+  for (i = 0; i < num_workers; ++i)
+    init_wavefront_worker(&workers[i], currSlice);
+
+  get_mem2Dint(&cofAC, p_Vid->PicSizeInMbs, ac_size);
+  get_mem2Dint(&cofDC, p_Vid->PicSizeInMbs, dc_size);
+  if ((b8only = (signed char *) calloc(p_Vid->PicSizeInMbs, sizeof(signed char))) == NULL)
+    no_mem_exit("encode_slice_wavefront: b8only");
+
+  for (wave = 0; wave < waves; ++wave)
+  {
+    int row;
+    int row_last  = imin(height, (wave >> 1) + 1);
+    int row_start = (wave < width) ? 0 : ((wave - width) >> 1) + 1;
+
+#if defined(OPENMP)
+#pragma omp parallel for
+#endif
+    for (row = row_start; row < row_last; ++row)
+    {
+      int mb_addr = row * width + wave - 2 * row;
+#if defined(OPENMP)
+      WavefrontWorker *worker = &workers[omp_get_thread_num()];
+#else
+      WavefrontWorker *worker = workers;
+#endif
+      decide_wavefront_macroblock(worker, mb_addr, cofAC[mb_addr], cofDC[mb_addr], &b8only[mb_addr]);
+    }
+  }
+
+  while (end_of_slice == FALSE)
+  {
+    currMB = &p_Vid->mb_data[CurrentMbAddr];
+    currMB->p_Slice = currSlice;
+    currMB->p_Vid   = p_Vid;
+    p_Vid->current_mb_nr = CurrentMbAddr;
+    // as start_macroblock would, since later pictures (e.g. HME lambdas) read these
+    p_Vid->qp = p_Vid->masterQP = currMB->qp;
+
+    memcpy(currSlice->cofAC[0][0][0], cofAC[CurrentMbAddr], ac_size * sizeof(int));
+    memcpy(currSlice->cofDC[0][0], cofDC[CurrentMbAddr], dc_size * sizeof(int));
+    if (b8only[CurrentMbAddr] >= 0)
+      p_Vid->giRDOpt_B8OnlyFlag = (Boolean) b8only[CurrentMbAddr];
+
+    write_macroblock (currMB, 1);
+    end_macroblock (currMB, &end_of_slice, &recode_macroblock);
+
+    p_Vid->SumFrameQP += currMB->qp;
+    CurrentMbAddr = FmoGetNextMBNr (p_Vid, CurrentMbAddr);
+    if (CurrentMbAddr == -1)
+      end_of_slice = TRUE;
+    ++(*NumberOfCodedMBs);
+    next_macroblock (currMB);
+  }
+
+  free(b8only);
+  free_mem2Dint(cofDC);
+  free_mem2Dint(cofAC);
+
+  // Each worker started from the motion estimation times of p_Vid
+  me_time = p_Vid->me_time;
+  me_tot_time = p_Vid->me_tot_time;
+  for (i = 0; i < num_workers; ++i)
+  {
+    p_Vid->me_time     += workers[i].p_Vid.me_time - me_time;
+    p_Vid->me_tot_time += workers[i].p_Vid.me_tot_time - me_tot_time;
+    free_wavefront_worker(&workers[i], p_Vid);
+  }
+  free(workers);
+
+  return currMB;
+}
+
 /*!
 ************************************************************************
 * \brief
@@ -483,6 +732,12 @@ int encode_one_slice (VideoParameters *p_Vid, int SliceGroupId, int TotalCodedMB
   if(currSlice->UseRDOQuant == 1 && currSlice->RDOQ_QP_Num > 1)
     get_dQP_table(currSlice);
 
+  if (p_Inp->WavefrontModeDecision)
+  {
+    currMB = encode_slice_wavefront (currSlice, CurrentMbAddr, &NumberOfCodedMBs);
+    end_of_slice = TRUE;
+  }
+
   while (end_of_slice == FALSE) // loop over macroblocks
   {
     Boolean recode_macroblock = FALSE;
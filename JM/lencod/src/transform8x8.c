@@ -40,6 +40,10 @@
 #include "intra8x8.h"
 #include "rdopt_coding_state.h"
 
+#if USE_SHIM==1
+#include "ShimJM_generated.h"
+#endif
+
 //! single scan pattern
 static const byte SNGL_SCAN8x8[64][2] = {
   {0,0}, {1,0}, {0,1}, {0,2}, {1,1}, {2,0}, {3,0}, {2,1},
@@ -819,6 +823,11 @@ distblk compute_comp8x8_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **
 */
 distblk compute_sad8x8_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **mpr8x8, int pic_opix_x, distblk min_cost)
 {
+#if USE_SHIM==1
+  int imin_cost = dist_down(min_cost);
+  int cost = compute_sad8x8_cost_Shim(cur_img, mpr8x8, pic_opix_x, imin_cost);
+  return cost > imin_cost ? min_cost : dist_scale((distblk) cost);
+#else
   imgpel *cimg, *cmpr;
   int i32Cost = 0;
   int i, j;
@@ -839,6 +848,7 @@ distblk compute_sad8x8_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **m
     }
   }
   return dist_scale(i32Cost);
+#endif
 }
 
 /*!
@@ -849,6 +859,11 @@ distblk compute_sad8x8_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **m
 */
 distblk compute_sse8x8_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **mpr8x8, int pic_opix_x, distblk min_cost)
 {
+#if USE_SHIM==1
+  int imin_cost = dist_down(min_cost);
+  int cost = compute_sse8x8_cost_Shim(cur_img, mpr8x8, pic_opix_x, imin_cost);
+  return cost > imin_cost ? min_cost : dist_scale((distblk) cost);
+#else
   int i, j;
   imgpel *cimg, *cmpr;
   int imin_cost = dist_down(min_cost);
@@ -870,6 +885,7 @@ distblk compute_sse8x8_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **m
     }
   }
   return dist_scale(distortion);
+#endif
 }
 /*!
 *************************************************************************************
@@ -879,6 +895,9 @@ distblk compute_sse8x8_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **m
 */
 distblk compute_satd8x8_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **mpr8x8, int pic_opix_x, distblk min_cost)
 {
+#if USE_SHIM==1
+  return (dist_scale((distblk) compute_satd8x8_cost_Shim(cur_img, mpr8x8, pic_opix_x)));
+#else
   int i, j;
   short diff64[64];
 
@@ -896,5 +915,6 @@ distblk compute_satd8x8_cost(VideoParameters *p_Vid, imgpel **cur_img, imgpel **
   }
 
   return (dist_scale(HadamardSAD8x8 (diff64)));
+#endif
 }
 
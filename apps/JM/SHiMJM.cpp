@@ -39,9 +39,8 @@ static void get_horizontal(Pred &pred, Ref &ref) {
   pred[y][x] = ref[y][-1];
 }
 
-template <typename Pred, typename Ref>
-static void get_16x16_dc(Pred &pred, Ref &ref, 
-			 dbool &left_available, dbool &up_available) { 
+template <typename Ref>
+static dint get_16x16_dc(Ref &ref, dbool &left_available, dbool &up_available) { 
   auto &p = ref;
   dint s = 0;
   if (up_available && left_available) {
@@ -62,11 +61,11 @@ static void get_16x16_dc(Pred &pred, Ref &ref,
   } else {
     s = 128;
   }
-  pred[y][x] = s;
+  return s;
 }
 
-template <typename Pred, typename Ref>
-static void get_16x16_plane(Pred &pred, Ref &ref) {
+template <typename Ref>
+static void get_16x16_plane_coeffs(Ref &ref, dint &a, dint &b, dint &c) {
   auto p = ref.col_major();
   dint H = 0;
   dint V = 0;
@@ -74,38 +73,160 @@ static void get_16x16_plane(Pred &pred, Ref &ref) {
     H += (q+1)*(p(8+q,-1) - p(6-q,-1));
     V += (q+1)*(p(-1,8+q) - p(-1,6-q));
   }
-  dint a = 16 * (p(-1,15) + p(15,-1));
-  dint b = ((dint)(5 * H + 32) >> 6);
-  dint c = ((dint)(5 * V + 32) >> 6);
-  pred[y][x] = CLIP1Y((a+b*(x-7)+c*(y-7)+16) >> 5);
+  a = 16 * (p(-1,15) + p(15,-1));
+  b = ((dint)(5 * H + 32) >> 6);
+  c = ((dint)(5 * V + 32) >> 6);
 }
 
-template <typename Pred, typename Ref>
-static void get_4x4_dc(Pred &pred, Ref &ref, 
-		       dbool &left_available, dbool &up_available) {
-  auto p = ref.col_major();
+// The plane prediction at (x,y), as an inline expression
+static auto plane_16x16(dint &a, dint &b, dint &c, dint &max_val) {
+  return CLIP1Y((a+b*(x-7)+c*(y-7)+16) >> 5, max_val);
+}
+
+// Index into JM's predictor pels for an NxN block (intra4x4_pred/intra8x8_pred) of p[px,py],
+// using the notation of the standard: p[-1,-1] is above left, p[x,-1] is above (x < 2N), and
+// p[-1,y] is to the left.
+template <int N>
+static int pel(int px, int py) {
+  return py == -1 ? px + 1 : 2 * N + 1 + py;
+}
+
+// The filter a directional mode applies to the predictor pels for a single pixel
+struct Taps {
+  enum Kind { COPY, TWO, THREE, ONE_THREE };
+  Kind kind;
+  int a, b, c;
+};
+
+// The taps for pixel (x,y) of the given directional 4x4 or 8x8 mode, from 8.3.1.2 and 8.3.2.2
+// of the standard. This is all known during staging.
+template <int N>
+static Taps directional_taps(int mode, int x, int y) {
+  switch (mode) {
+  case VERT_PRED:
+    return {Taps::COPY, pel<N>(x,-1)};
+  case HOR_PRED:
+    return {Taps::COPY, pel<N>(-1,y)};
+  case DIAG_DOWN_LEFT_PRED:
+    if (x == N-1 && y == N-1) {
+      return {Taps::ONE_THREE, pel<N>(2*N-2,-1), pel<N>(2*N-1,-1)};
+    }
+    return {Taps::THREE, pel<N>(x+y,-1), pel<N>(x+y+1,-1), pel<N>(x+y+2,-1)};
+  case DIAG_DOWN_RIGHT_PRED:
+    if (x > y) {
+      return {Taps::THREE, pel<N>(x-y-2,-1), pel<N>(x-y-1,-1), pel<N>(x-y,-1)};
+    } else if (x < y) {
+      return {Taps::THREE, pel<N>(-1,y-x-2), pel<N>(-1,y-x-1), pel<N>(-1,y-x)};
+    }
+    return {Taps::THREE, pel<N>(0,-1), pel<N>(-1,-1), pel<N>(-1,0)};
+  case VERT_RIGHT_PRED: {
+    int z = 2*x - y;
+    int o = x - (y >> 1);
+    if (z >= 0 && z % 2 == 0) {
+      return {Taps::TWO, pel<N>(o-1,-1), pel<N>(o,-1)};
+    } else if (z > 0) {
+      return {Taps::THREE, pel<N>(o-2,-1), pel<N>(o-1,-1), pel<N>(o,-1)};
+    } else if (z == -1) {
+      return {Taps::THREE, pel<N>(-1,0), pel<N>(-1,-1), pel<N>(0,-1)};
+    }
+    return {Taps::THREE, pel<N>(-1,y-2*x-1), pel<N>(-1,y-2*x-2), pel<N>(-1,y-2*x-3)};
+  }
+  case HOR_DOWN_PRED: {
+    int z = 2*y - x;
+    int o = y - (x >> 1);
+    if (z >= 0 && z % 2 == 0) {
+      return {Taps::TWO, pel<N>(-1,o-1), pel<N>(-1,o)};
+    } else if (z > 0) {
+      return {Taps::THREE, pel<N>(-1,o-2), pel<N>(-1,o-1), pel<N>(-1,o)};
+    } else if (z == -1) {
+      return {Taps::THREE, pel<N>(-1,0), pel<N>(-1,-1), pel<N>(0,-1)};
+    }
+    return {Taps::THREE, pel<N>(x-2*y-1,-1), pel<N>(x-2*y-2,-1), pel<N>(x-2*y-3,-1)};
+  }
+  case VERT_LEFT_PRED: {
+    int o = x + (y >> 1);
+    if (y % 2 == 0) {
+      return {Taps::TWO, pel<N>(o,-1), pel<N>(o+1,-1)};
+    }
+    return {Taps::THREE, pel<N>(o,-1), pel<N>(o+1,-1), pel<N>(o+2,-1)};
+  }
+  case HOR_UP_PRED: {
+    int z = x + 2*y;
+    int o = y + (x >> 1);
+    if (z > 2*N-3) {
+      return {Taps::COPY, pel<N>(-1,N-1)};
+    } else if (z == 2*N-3) {
+      return {Taps::ONE_THREE, pel<N>(-1,N-2), pel<N>(-1,N-1)};
+    } else if (z % 2 == 0) {
+      return {Taps::TWO, pel<N>(-1,o), pel<N>(-1,o+1)};
+    }
+    return {Taps::THREE, pel<N>(-1,o), pel<N>(-1,o+1), pel<N>(-1,o+2)};
+  }
+  default:
+    std::cerr << "Not a directional mode: " << mode << std::endl;
+    exit(-1);
+  }
+}
+
+// A directional mode, unrolled during staging so each pixel reads its predictor pels directly
+template <int N, typename Mpr, typename Pels>
+static void get_NxN_directional(Mpr &mpr, Pels &pels, int mode) {
+  for (sint sr = 0; sr < N; sr = sr + 1) {
+    for (sint sc = 0; sc < N; sc = sc + 1) {
+      int r = sr;
+      int c = sc;
+      Taps taps = directional_taps<N>(mode, c, r);
+      if (taps.kind == Taps::COPY) {
+	mpr[mode][r][c] = pels(taps.a);
+      } else if (taps.kind == Taps::TWO) {
+	mpr[mode][r][c] = (pels(taps.a) + pels(taps.b) + 1) >> 1;
+      } else if (taps.kind == Taps::THREE) {
+	mpr[mode][r][c] = (pels(taps.a) + 2 * pels(taps.b) + pels(taps.c) + 2) >> 2;
+      } else {
+	mpr[mode][r][c] = (pels(taps.a) + 3 * pels(taps.b) + 2) >> 2;
+      }
+    }
+  }
+}
+
+template <int N, typename Mpr, typename Pels>
+static void get_NxN_dc(Mpr &mpr, Pels &pels, dint &left_available, dint &up_available) {
+  constexpr int shift = N == 4 ? 2 : 3;
+  dint up = 0;
+  dint left = 0;
+  for (sint k = 0; k < N; k = k + 1) {
+    up = up + pels(pel<N>(k,-1));
+    left = left + pels(pel<N>(-1,k));
+  }
   dint s = 0;
   if (up_available && left_available) {
-    s = (p(0,-1) + p(1,-1) + p(2,-1) + p(3,-1) + p(-1,0) + p(-1,1) + p(-1,2) + p(-1,3) + 4) >> 3;
-  } else if (up_available) {
-    s = (p(-1,0) + p(-1,1) + p(-1,2) + p(-1,3) + 2) >> 2;
+    s = RSHIFT_RND_SF(up + left, shift + 1);
   } else if (left_available) {
-    s = (p(0,-1) + p(1,-1) + p(2,-1) + p(3,-1) + 2) >> 2;
+    s = RSHIFT_RND_SF(left, shift);
+  } else if (up_available) {
+    s = RSHIFT_RND_SF(up, shift);
   } else {
-    s = 128;
+    // JM has already set this to the dc prediction value
+    s = pels(pel<N>(0,-1));
   }
-  pred[y][x] = s;
+  auto p = mpr.slice(range(DC_PRED,DC_PRED+1,1),range(0,N,1),range(0,N,1));
+  p[y][x] = s;
 }
 
-/*template <typename Pred, typename Ref>
-static void get_4x4_ddl(Pred &pred, Ref &ref, 
-			dbool &left_available, dbool &up_available) {
-  auto p = ref.col_major();
-  pred[3][3] = (p(6,-1) + 3 * p(7,-1) + 2) >> 2;
-  pred[y][x] = select(y == 3 && x == 3, 
-		      (p(6,-1) + 3 * p(7,-1) + 2) >> 2,
-		      (p(x + y,-1) + 2 * p(x + y + 1,-1) + p(x + y + 2,-1) + 2) >> 2);
-}*/
+// All the 4x4 or 8x8 luma modes, with a branch specialized for each
+template <int N, typename Mpr, typename Pels>
+static void get_intrapred_NxN(Mpr &mpr, Pels &pels, dint &mode,
+			      dint &left_available, dint &up_available) {
+  for (sint m = VERT_PRED; m <= HOR_UP_PRED; m = m + 1) {
+    if (mode == m) {
+      if (m == DC_PRED) {
+	get_NxN_dc<N>(mpr, pels, left_available, up_available);
+      } else {
+	get_NxN_directional<N>(mpr, pels, m);
+      }
+    }
+  }
+}
 
 // availability depends on:
 // 1. use_constrained_intra
@@ -131,28 +252,6 @@ static void set_intrapred_16x16(View<T,2,M> &mblk_recons,
   }
 }
 
-template <typename Pred, typename Orig>
-static dint sad_16x16(Pred &pred, Orig &orig_mblk, dint min_cost) {
-  dint i32_cost = 0;
-  for (dint i = 0; i < 16; i=i+1) {
-    for (dint j = 0; j < 16; j=j+1) {
-      i32_cost += cabs(orig_mblk(i,j) - pred(i,j));
-    }
-  }
-  return (i32_cost << LAMBDA_ACCURACY_BITS);
-}
-
-template <typename Pred, typename Orig>
-static void select_best(dint &best_cost, dint &best_mode, 
-			Pred &pred, Orig &&orig_mblk,
-			const dint &cur_mode) {
-  dyn_var<int32_t> cur_cost = sad_16x16(pred, orig_mblk, best_cost);
-  if (cur_cost < best_cost) {
-    best_cost = cur_cost;
-    best_mode = cur_mode;
-  }
-}
-
 // TODO support distblk in buildit (int64 in the current case I'm working on) because it fails. Using int32 instead
 static dyn_var<int> find_sad_16x16_Shim(Macroblock macroblock) {
   // set up our HMDAs
@@ -168,8 +267,8 @@ static dyn_var<int> find_sad_16x16_Shim(Macroblock macroblock) {
   // that can be mutated (so call like obj.with_extent().with_coarsening().to_immutable())
   auto intra_block = Block<short,2>::user({mbH, mbW}, {1,1}, {0,0}, {1,1}, {16,16},
 					  macroblock->p_vid->intra_block).virtually_refine(16,16);
-  auto mblk_recons = img_recons.slice(range(macroblock->pix_y,macroblock->pix_y+16,1), 
-				     range(macroblock->pix_x,macroblock->pix_x+16,1));
+  auto mblk_recons = img_recons.slice(span<16>(macroblock->pix_y), 
+				     span<16>(macroblock->pix_x));
   dbool up_available = false;
   dbool left_available = false;
   dbool all_available = false;
@@ -182,12 +281,51 @@ static dyn_var<int> find_sad_16x16_Shim(Macroblock macroblock) {
     print("Not supporting P444 joined.\\n");
     hexit(-1);
   }
-  dint best_cost = INT_MAX;
-  dint best_mode = 0;
-  // TODO optimization for converting into a reduction, or a special syntax for a reduction
-  // there are two reductions here--one within the SAD computation, and one for selecting 
-  // the best mode
-  for (sint mode = 0; mode < 4; mode=mode+1) {
+  dint max_val = macroblock->p_vid->max_imgpel_value;
+  // copy the neighbours the modes predict from, so the sweep below never reads outside the
+  // picture for unavailable modes
+  auto top = Block<imgpel,1>::stack<16>();
+  auto left = Block<imgpel,1>::stack<16>();
+  if (up_available) {
+    top[x] = mblk_recons[-1][x];
+  } else {
+    top[x] = 0;
+  }
+  if (left_available) {
+    left[y] = mblk_recons[y][-1];
+  } else {
+    left[y] = 0;
+  }
+  dint dc = get_16x16_dc(mblk_recons, left_available, up_available);
+  dint a = 0;
+  dint b = 0;
+  dint c = 0;
+  // the SAD of every mode in a single sweep over the original macroblock, generating each
+  // prediction on the fly. These are in the order of the modes. No mode's cost is known
+  // until the sweep ends, so unlike the other distortions here there's no early exit.
+  auto orig = img_orig.colocate(mblk_recons);
+  auto vertical_sad = habs(cast<int>(orig[y][x]) - cast<int>(top[x]));
+  auto horizontal_sad = habs(cast<int>(orig[y][x]) - cast<int>(left[y]));
+  auto dc_sad = habs(cast<int>(orig[y][x]) - dc);
+  darr<int,4> sads;
+  if (all_available) {
+    get_16x16_plane_coeffs(mblk_recons, a, b, c);
+    sum_each(sads, vertical_sad, horizontal_sad, dc_sad,
+	     habs(cast<int>(orig[y][x]) - plane_16x16(a, b, c, max_val)));
+  } else {
+    // plane isn't available, so leave it out of the sweep
+    darr<int,3> available_sads;
+    sum_each(available_sads, vertical_sad, horizontal_sad, dc_sad);
+    for (int mode = VERT_PRED_16; mode <= DC_PRED_16; mode++) {
+      sads[mode] = available_sads[mode];
+    }
+    sads[PLANE_16] = 0;
+  }
+  dint best_cost;
+  dint best_mode;
+  // Disabled and unavailable modes cost INT_MAX.
+  argmin<4>(best_mode, best_cost, [&](int mode) -> dint {
+    dint cost = INT_MAX;
     // check for disabled modes
     dbool break_out = false;
     if (macroblock->p_inp->intra_disable_inter_only==0 || 
@@ -202,41 +340,398 @@ static dyn_var<int> find_sad_16x16_Shim(Macroblock macroblock) {
 	break_out = true;
       }
     }
-    if (!break_out) {
-      // now run the modes based on what data is available
-      auto pred = Block<imgpel,3,true>::user({4,16,16}, macroblock->p_slice->mpr_16x16[0]);
-      if (mode == VERT_PRED_16 && up_available) {	
-	auto p = pred.slice(range(VERT_PRED_16,VERT_PRED_16+1,1),range(0,16,1),range(0,16,1));
-	get_vertical(p, mblk_recons);
-	select_best(best_cost, best_mode, p, img_orig.colocate(mblk_recons), mode);
-      } else if (mode == HOR_PRED_16 && left_available) {
-	auto p = pred.slice(range(HOR_PRED_16,HOR_PRED_16+1,1),range(0,16,1),range(0,16,1));
-	get_horizontal(p, mblk_recons);
-	select_best(best_cost, best_mode, p, img_orig.colocate(mblk_recons), mode);
-      } else if (mode == PLANE_16 && all_available) {
-	auto p = pred.slice(range(PLANE_16,PLANE_16+1,1),range(0,16,1),range(0,16,1));
-	get_16x16_plane(p, mblk_recons);
-	select_best(best_cost, best_mode, p, img_orig.colocate(mblk_recons), mode);
-      } else if (mode == DC_PRED_16) {
-	// DC mode
-	auto p = pred.slice(range(DC_PRED_16,DC_PRED_16+1,1),range(0,16,1),range(0,16,1));
-	get_16x16_dc(p, mblk_recons, left_available, up_available);
-	select_best(best_cost, best_mode, p, img_orig.colocate(mblk_recons), mode);
-      }
+    dbool available = true;
+    if (mode == VERT_PRED_16) {
+      available = up_available;
+    } else if (mode == HOR_PRED_16) {
+      available = left_available;
+    } else if (mode == PLANE_16) {
+      available = all_available;
+    }
+    if (!break_out && available) {
+      cost = sads[mode] << LAMBDA_ACCURACY_BITS;
     }
+    return cost;
+  });
+  // only the winner's prediction is needed after this
+  auto pred = Block<imgpel,3,true>::user({4,16,16}, macroblock->p_slice->mpr_16x16[0]);
+  if (best_mode == VERT_PRED_16) {
+    auto p = pred.slice(range(VERT_PRED_16,VERT_PRED_16+1,1),range(0,16,1),range(0,16,1));
+    get_vertical(p, mblk_recons);
+  } else if (best_mode == HOR_PRED_16) {
+    auto p = pred.slice(range(HOR_PRED_16,HOR_PRED_16+1,1),range(0,16,1),range(0,16,1));
+    get_horizontal(p, mblk_recons);
+  } else if (best_mode == PLANE_16) {
+    auto p = pred.slice(range(PLANE_16,PLANE_16+1,1),range(0,16,1),range(0,16,1));
+    p[y][x] = plane_16x16(a, b, c, max_val);
+  } else {
+    auto p = pred.slice(range(DC_PRED_16,DC_PRED_16+1,1),range(0,16,1),range(0,16,1));
+    p[y][x] = dc;
   }
 //  print("Best mode and cost = (%d,%d)\\n", best_mode, best_cost);
   macroblock->i16_mode = best_mode;
   return best_cost;
 }
 
+// The residual of a block, read from one of JM's diff buffers
+template <typename Diff>
+struct BufferResidual {
+  Diff diff;
+  // for reductions over the whole block
+  auto expr() { return cast<int>(diff[y][x]); }
+  // for the unrolled transforms
+  dint at(int r, int c) { return diff(r,c); }
+};
+
+// The residual of a block, read straight from the original and predicted pictures so the
+// difference is fused into the distortion
+template <typename Orig, typename Pred>
+struct PictureResidual {
+  Orig orig;
+  Pred pred;
+  auto expr() { return cast<int>(orig[y][x]) - cast<int>(pred[y][x]); }
+  dint at(int r, int c) { return orig(r,c) - pred(r,c); }
+};
+
+template <typename Residual>
+static dint sad(Residual &residual) {
+  return sum(habs(residual.expr()));
+}
+
+template <typename Residual>
+static dint sse(Residual &residual) {
+  return sum(residual.expr() * residual.expr());
+}
+
+// Like JM's thresholded distortions, these stop once the cost exceeds imin_cost, checking
+// every CheckEvery rows. The result is then a partial cost > imin_cost.
+template <int CheckEvery, typename Residual>
+static dint sad(Residual &residual, dint &imin_cost) {
+  return sum_until<CheckEvery>(habs(residual.expr()), imin_cost);
+}
+
+template <int CheckEvery, typename Residual>
+static dint sse(Residual &residual, dint &imin_cost) {
+  return sum_until<CheckEvery>(residual.expr() * residual.expr(), imin_cost);
+}
+
+// In place unnormalized Hadamard transform of the rows, then the columns. The butterflies
+// are unrolled during staging.
+template <int N>
+static void hadamard(dint (&m)[N][N]) {
+  for (sint slen = N/2; slen >= 1; slen = slen / 2) {
+    for (sint sj = 0; sj < N; sj = sj + 1) {
+      for (sint si = 0; si < N; si = si + 1) {
+	int len = slen;
+	int j = sj;
+	int i = si;
+	if ((i & len) == 0) {
+	  dint a = m[j][i];
+	  m[j][i] = a + m[j][i+len];
+	  m[j][i+len] = a - m[j][i+len];
+	}
+      }
+    }
+  }
+  for (sint slen = N/2; slen >= 1; slen = slen / 2) {
+    for (sint sj = 0; sj < N; sj = sj + 1) {
+      for (sint si = 0; si < N; si = si + 1) {
+	int len = slen;
+	int j = sj;
+	int i = si;
+	if ((j & len) == 0) {
+	  dint a = m[j][i];
+	  m[j][i] = a + m[j+len][i];
+	  m[j+len][i] = a - m[j+len][i];
+	}
+      }
+    }
+  }
+}
+
+// Same as HadamardSAD4x4 and HadamardSAD8x8 in JM. The coefficients come out in a different
+// order, but the sum of their magnitudes is the same.
+template <int N, typename Residual>
+static dint hadamard_sad(Residual &residual) {
+  static_assert(N == 4 || N == 8);
+  dint m[N][N];
+  for (sint sj = 0; sj < N; sj = sj + 1) {
+    for (sint si = 0; si < N; si = si + 1) {
+      int j = sj;
+      int i = si;
+      m[j][i] = residual.at(j,i);
+    }
+  }
+  hadamard<N>(m);
+  dint s = 0;
+  for (sint sj = 0; sj < N; sj = sj + 1) {
+    for (sint si = 0; si < N; si = si + 1) {
+      int j = sj;
+      int i = si;
+      s = s + habs(m[j][i]);
+    }
+  }
+  return N == 4 ? (s + 1) >> 1 : (s + 2) >> 2;
+}
+
+// Same as distI16x16_satd in JM (without the early exit): 4x4 transforms of the residual,
+// then a transform of their DC coefficients. JM halves every coefficient, so the rounding
+// here matches it exactly.
+template <typename Residual>
+static dint i16x16_satd(Residual &residual) {
+  dint dc[4][4];
+  dint s = 0;
+  for (sint sbj = 0; sbj < 4; sbj = sbj + 1) {
+    for (sint sbi = 0; sbi < 4; sbi = sbi + 1) {
+      int bj = sbj;
+      int bi = sbi;
+      dint m[4][4];
+      for (sint sj = 0; sj < 4; sj = sj + 1) {
+	for (sint si = 0; si < 4; si = si + 1) {
+	  int j = sj;
+	  int i = si;
+	  m[j][i] = residual.at(4*bj+j, 4*bi+i);
+	}
+      }
+      hadamard<4>(m);
+      for (sint sj = 0; sj < 4; sj = sj + 1) {
+	for (sint si = 0; si < 4; si = si + 1) {
+	  int j = sj;
+	  int i = si;
+	  if (j != 0 || i != 0) {
+	    s = s + habs(m[j][i] >> 1);
+	  }
+	}
+      }
+      dc[bj][bi] = (m[0][0] >> 1) >> 1;
+    }
+  }
+  hadamard<4>(dc);
+  for (sint sj = 0; sj < 4; sj = sj + 1) {
+    for (sint si = 0; si < 4; si = si + 1) {
+      int j = sj;
+      int i = si;
+      s = s + habs(dc[j][i] >> 1);
+    }
+  }
+  return s;
+}
+
+// The entries of JM's select_distortion table, over its diff buffers. These don't apply dist_scale.
+template <int N>
+static auto diff_residual(dyn_var<short*> &diff) {
+  auto block = Block<short,2>::user({N,N}, diff);
+  return BufferResidual<decltype(block)>{block};
+}
+
+static dint distortion4x4SAD_Shim(dyn_var<short*> diff) {
+  auto residual = diff_residual<4>(diff);
+  return sad(residual);
+}
+
+static dint distortion4x4SSE_Shim(dyn_var<short*> diff) {
+  auto residual = diff_residual<4>(diff);
+  return sse(residual);
+}
+
+static dint HadamardSAD4x4_Shim(dyn_var<short*> diff) {
+  auto residual = diff_residual<4>(diff);
+  return hadamard_sad<4>(residual);
+}
+
+static dint distortion8x8SAD_Shim(dyn_var<short*> diff) {
+  auto residual = diff_residual<8>(diff);
+  return sad(residual);
+}
+
+static dint distortion8x8SSE_Shim(dyn_var<short*> diff) {
+  auto residual = diff_residual<8>(diff);
+  return sse(residual);
+}
+
+static dint HadamardSAD8x8_Shim(dyn_var<short*> diff) {
+  auto residual = diff_residual<8>(diff);
+  return hadamard_sad<8>(residual);
+}
+
+static dint distortion8x8SADthres_Shim(dyn_var<short*> diff, dint imin_cost) {
+  auto residual = diff_residual<8>(diff);
+  return sad<1>(residual, imin_cost);
+}
+
+// The compute_*4x4_cost and compute_*8x8_cost functions in JM, fused with computing the residual.
+// The rows of cur_img start at the block, but the columns don't.
+template <int N, typename Func>
+static dint compute_cost(dyn_var<imgpel**> &cur_img, dyn_var<imgpel**> &prd_img, dint &pic_opix_x, 
+			 Func dist) {
+  auto cur_pic = Block<imgpel,2,true>::user({N, pic_opix_x + N}, cur_img);
+  auto cur = cur_pic.slice(range(0,N,1), span<N>(pic_opix_x));
+  auto prd_pic = Block<imgpel,2,true>::user({N,N}, prd_img);
+  auto prd = prd_pic.slice(range(0,N,1), range(0,N,1));
+  PictureResidual<decltype(cur),decltype(prd)> residual{cur, prd};
+  return dist(residual);
+}
+
+static dint compute_sad4x4_cost_Shim(dyn_var<imgpel**> cur_img, dyn_var<imgpel**> prd_img, dint pic_opix_x, 
+				     dint imin_cost) {
+  return compute_cost<4>(cur_img, prd_img, pic_opix_x, [&](auto &residual) { return sad<1>(residual, imin_cost); });
+}
+
+static dint compute_sse4x4_cost_Shim(dyn_var<imgpel**> cur_img, dyn_var<imgpel**> prd_img, dint pic_opix_x, 
+				     dint imin_cost) {
+  return compute_cost<4>(cur_img, prd_img, pic_opix_x, [&](auto &residual) { return sse<1>(residual, imin_cost); });
+}
+
+static dint compute_satd4x4_cost_Shim(dyn_var<imgpel**> cur_img, dyn_var<imgpel**> prd_img, dint pic_opix_x) {
+  return compute_cost<4>(cur_img, prd_img, pic_opix_x, [](auto &residual) { return hadamard_sad<4>(residual); });
+}
+
+static dint compute_sad8x8_cost_Shim(dyn_var<imgpel**> cur_img, dyn_var<imgpel**> prd_img, dint pic_opix_x, 
+				     dint imin_cost) {
+  return compute_cost<8>(cur_img, prd_img, pic_opix_x, [&](auto &residual) { return sad<1>(residual, imin_cost); });
+}
+
+static dint compute_sse8x8_cost_Shim(dyn_var<imgpel**> cur_img, dyn_var<imgpel**> prd_img, dint pic_opix_x, 
+				     dint imin_cost) {
+  return compute_cost<8>(cur_img, prd_img, pic_opix_x, [&](auto &residual) { return sse<1>(residual, imin_cost); });
+}
+
+static dint compute_satd8x8_cost_Shim(dyn_var<imgpel**> cur_img, dyn_var<imgpel**> prd_img, dint pic_opix_x) {
+  return compute_cost<8>(cur_img, prd_img, pic_opix_x, [](auto &residual) { return hadamard_sad<8>(residual); });
+}
+
+// The distI16x16 functions in JM, fused with computing the residual
+template <typename Func>
+static dint dist_i16x16(Macroblock &macroblock, dyn_var<imgpel**> &img_org, dyn_var<imgpel**> &pred_img,
+			Func dist) {
+  dint opix_y = macroblock->opix_y;
+  dint pix_x = macroblock->pix_x;
+  auto org_pic = Block<imgpel,2,true>::user({opix_y + 16, pix_x + 16}, img_org);
+  auto org = org_pic.slice(span<16>(opix_y), span<16>(pix_x));
+  auto prd_pic = Block<imgpel,2,true>::user({16,16}, pred_img);
+  auto prd = prd_pic.slice(range(0,16,1), range(0,16,1));
+  PictureResidual<decltype(org),decltype(prd)> residual{org, prd};
+  return dist(residual);
+}
+
+static dint distI16x16_sad_Shim(Macroblock macroblock, dyn_var<imgpel**> img_org, dyn_var<imgpel**> pred_img,
+			       dint imin_cost) {
+  return dist_i16x16(macroblock, img_org, pred_img, 
+		     [&](auto &residual) { return sad<1>(residual, imin_cost); });
+}
+
+static dint distI16x16_sse_Shim(Macroblock macroblock, dyn_var<imgpel**> img_org, dyn_var<imgpel**> pred_img,
+			       dint imin_cost) {
+  return dist_i16x16(macroblock, img_org, pred_img, 
+		     [&](auto &residual) { return sse<1>(residual, imin_cost); });
+}
+
+static dint distI16x16_satd_Shim(Macroblock macroblock, dyn_var<imgpel**> img_org, dyn_var<imgpel**> pred_img) {
+  return dist_i16x16(macroblock, img_org, pred_img, [](auto &residual) { return i16x16_satd(residual); });
+}
+
+// Same as get_intrapred_4x4 in JM. The predictor pels must already be set.
+static void get_intrapred_4x4_Shim(Macroblock macroblock, dint pl, dint mode,
+				   dint left_available, dint up_available) {
+  dyn_var<imgpel*> pred_pel = macroblock->intra4x4_pred[pl];
+  auto pels = Block<imgpel,1>::user({13}, pred_pel);
+  auto mpr = Block<imgpel,3,true>::user({9,4,4}, macroblock->p_slice->mpr_4x4[pl]);
+  get_intrapred_NxN<4>(mpr, pels, mode, left_available, up_available);
+}
+
+// Same as get_intrapred_8x8 in JM. The (filtered) predictor pels must already be set.
+static void get_intrapred_8x8_Shim(Macroblock macroblock, dint pl, dint mode,
+				   dint left_available, dint up_available) {
+  dyn_var<imgpel*> pred_pel = macroblock->intra8x8_pred[pl];
+  auto pels = Block<imgpel,1>::user({25}, pred_pel);
+  auto mpr = Block<imgpel,3,true>::user({9,8,8}, macroblock->p_slice->mpr_8x8[pl]);
+  get_intrapred_NxN<8>(mpr, pels, mode, left_available, up_available);
+}
+
+// Same as get_intrapred_chroma in JM, including its layout of the predictor pels
+// (the above left, then 16 above, then 16 to the left).
+static void get_intrapred_chroma_Shim(Macroblock macroblock, dint pl, dint mode,
+				      dint left_available, dint up_available) {
+  dyn_var<imgpel*> pred_pel = macroblock->intra16x16_pred[pl];
+  auto pels = Block<imgpel,1>::user({33}, pred_pel);
+  auto mpr = Block<imgpel,3,true>::user({4,16,16}, macroblock->p_slice->mpr_16x16[pl]);
+  dint cr_MB_x = macroblock->p_vid->mb_cr_size_x;
+  dint cr_MB_y = macroblock->p_vid->mb_cr_size_y;
+  if (mode == VERT_PRED_8) {
+    auto p = mpr.slice(range(VERT_PRED_16,VERT_PRED_16+1,1),range(0,cr_MB_y,1),range(0,cr_MB_x,1));
+    p[y][x] = pels[x+1];
+  } else if (mode == HOR_PRED_8) {
+    auto p = mpr.slice(range(HOR_PRED_16,HOR_PRED_16+1,1),range(0,cr_MB_y,1),range(0,cr_MB_x,1));
+    p[y][x] = pels[y+17];
+  } else if (mode == DC_PRED_8) {
+    dint s1 = 0;
+    dint s2 = 0;
+    for (sint k = 0; k < 16; k = k + 1) {
+      s1 = s1 + pels(1+k);
+      s2 = s2 + pels(17+k);
+    }
+    dint s0 = 0;
+    if (up_available) {
+      if (left_available) {
+	s0 = RSHIFT_RND_SF(s1 + s2, 5);
+      } else {
+	s0 = RSHIFT_RND_SF(s1, 4);
+      }
+    } else if (left_available) {
+      s0 = RSHIFT_RND_SF(s2, 4);
+    } else {
+      s0 = pels(1);
+    }
+    auto p = mpr.slice(range(DC_PRED_16,DC_PRED_16+1,1),range(0,16,1),range(0,16,1));
+    p[y][x] = s0;
+  } else if (mode == PLANE_8) {
+    dint ih = 0;
+    dint iv = 0;
+    for (sint k = 1; k < 8; k = k + 1) {
+      ih = ih + k * (pels(8+k) - pels(8-k));
+      iv = iv + k * (pels(24+k) - pels(24-k));
+    }
+    ih = ih + 8 * (pels(16) - pels(0));
+    iv = iv + 8 * (pels(32) - pels(0));
+    dint ib = (5 * ih + 32) >> 6;
+    dint ic = (5 * iv + 32) >> 6;
+    dint iaa = 16 * (pels(16) + pels(32));
+    dint max_val = macroblock->p_vid->max_imgpel_value;
+    auto p = mpr.slice(range(PLANE_16,PLANE_16+1,1),range(0,16,1),range(0,16,1));
+    p[y][x] = select(((iaa + (x-7)*ib + (y-7)*ic + 16) >> 5) < 0, 0,
+		     select(((iaa + (x-7)*ib + (y-7)*ic + 16) >> 5) > max_val, max_val,
+			    (iaa + (x-7)*ib + (y-7)*ic + 16) >> 5));
+  }
+}
+
+// The StageCache version of the kernels below. Bump it whenever they, or anything they call
+// (including in shim), change.
+static const string kernel_version = "1";
+
 int main(int argc, char **argv) {
   CompileOptions::isCPP = IS_CPP == 1;
   stringstream includes;
   includes << "#include \"global.h\"" << endl;
   includes << "#include \"mbuffer.h\"" << endl;
-  // 16x16
-  stage(find_sad_16x16_Shim, "find_sad_16x16_Shim", basename(__FILE__, "_generated"), 
-	includes.str(), includes.str());
-  // 4x4
+  stage_all(basename(__FILE__, "_generated"), includes.str(), includes.str(),
+	    Staged{find_sad_16x16_Shim, "find_sad_16x16_Shim", kernel_version},
+	    Staged{get_intrapred_4x4_Shim, "get_intrapred_4x4_Shim", kernel_version},
+	    Staged{get_intrapred_8x8_Shim, "get_intrapred_8x8_Shim", kernel_version},
+	    Staged{get_intrapred_chroma_Shim, "get_intrapred_chroma_Shim", kernel_version},
+	    Staged{distortion4x4SAD_Shim, "distortion4x4SAD_Shim", kernel_version},
+	    Staged{distortion4x4SSE_Shim, "distortion4x4SSE_Shim", kernel_version},
+	    Staged{HadamardSAD4x4_Shim, "HadamardSAD4x4_Shim", kernel_version},
+	    Staged{distortion8x8SAD_Shim, "distortion8x8SAD_Shim", kernel_version},
+	    Staged{distortion8x8SSE_Shim, "distortion8x8SSE_Shim", kernel_version},
+	    Staged{HadamardSAD8x8_Shim, "HadamardSAD8x8_Shim", kernel_version},
+	    Staged{distortion8x8SADthres_Shim, "distortion8x8SADthres_Shim", kernel_version},
+	    Staged{compute_sad4x4_cost_Shim, "compute_sad4x4_cost_Shim", kernel_version},
+	    Staged{compute_sse4x4_cost_Shim, "compute_sse4x4_cost_Shim", kernel_version},
+	    Staged{compute_satd4x4_cost_Shim, "compute_satd4x4_cost_Shim", kernel_version},
+	    Staged{compute_sad8x8_cost_Shim, "compute_sad8x8_cost_Shim", kernel_version},
+	    Staged{compute_sse8x8_cost_Shim, "compute_sse8x8_cost_Shim", kernel_version},
+	    Staged{compute_satd8x8_cost_Shim, "compute_satd8x8_cost_Shim", kernel_version},
+	    Staged{distI16x16_sad_Shim, "distI16x16_sad_Shim", kernel_version},
+	    Staged{distI16x16_sse_Shim, "distI16x16_sse_Shim", kernel_version},
+	    Staged{distI16x16_satd_Shim, "distI16x16_satd_Shim", kernel_version});
 }
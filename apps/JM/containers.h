@@ -57,6 +57,9 @@ public:
   dyn_var<imgpel**> p_cur_img = as_member_of(this, "pCurImg");
   dyn_var<storablepic_t*> enc_picture = as_member_of(this, "enc_picture");
   dyn_var<short*> intra_block = as_member_of(this, "intra_block");
+  dyn_var<short> mb_cr_size_x = as_member_of(this, "mb_cr_size_x");
+  dyn_var<short> mb_cr_size_y = as_member_of(this, "mb_cr_size_y");
+  dyn_var<short> max_imgpel_value = as_member_of(this, "max_imgpel_value");
 };
 DYN_VAR_PTR(videoparam_t)
 
@@ -78,6 +81,8 @@ public:
   DYN_VAR_BP(slice_t)
   dyn_var<int> P444_joined = as_member_of(this, "P444_joined");
   dyn_var<int> slice_type = as_member_of(this, "slice_type");
+  dyn_var<imgpel****> mpr_4x4 = as_member_of(this, "mpr_4x4");
+  dyn_var<imgpel****> mpr_8x8 = as_member_of(this, "mpr_8x8");
   dyn_var<imgpel****> mpr_16x16 = as_member_of(this, "mpr_16x16");
 };
 DYN_VAR_PTR(slice_t)
@@ -92,10 +97,14 @@ public:
   dyn_var<slice_t*> p_slice = as_member_of(this, "p_Slice");
   dyn_var<short> pix_y = as_member_of(this, "pix_y");
   dyn_var<short> pix_x = as_member_of(this, "pix_x");
+  dyn_var<short> opix_y = as_member_of(this, "opix_y");
   dyn_var<int> mb_addr_B_available = as_member_of(this, "mbAvailB");
   dyn_var<int> mb_addr_A_available = as_member_of(this, "mbAvailA");
   dyn_var<int> mb_addr_D_available = as_member_of(this, "mbAvailD");
   dyn_var<char> i16_mode = as_member_of(this, "i16mode");
+  dyn_var<imgpel**> intra4x4_pred = as_member_of(this, "intra4x4_pred");
+  dyn_var<imgpel**> intra8x8_pred = as_member_of(this, "intra8x8_pred");
+  dyn_var<imgpel**> intra16x16_pred = as_member_of(this, "intra16x16_pred");
 };
 DYN_VAR_PTR(macroblock_t)
   
@@ -13,7 +13,7 @@ using dint = dyn_var<int>;
 using dshort = dyn_var<short>;
 using dbool = dyn_var<bool>;
 
-#define CLIP1Y(x) select((x) < 0, 0, select((x) > 128, 128, (x)))
+#define CLIP1Y(x,max_val) select((x) < 0, 0, select((x) > (max_val), (max_val), (x)))
 
 #define PD(item) print(#item " = %d\\n", item)
 #define RSHIFT_RND(x,a) ((a) > 0) ? (((((x) + ((1 << ((a)-1) ))) >> (a)))) : (((x) << (-(a))))
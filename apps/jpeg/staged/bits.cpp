@@ -1,10 +1,28 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include "bits.h"
 
+void Bits::make_room() {
+  if (space_available() >= 8)
+    return;
+  if (!this->fd) {
+    // in memory, so just make room
+    uint8_t *grown = new uint8_t[this->capacity * 2];
+    memcpy(grown, this->bits, this->byte_idx);
+    delete[] this->bits;
+    this->bits = grown;
+    this->capacity *= 2;
+    return;
+  }
+  fwrite(this->bits, 1, this->byte_idx, this->fd);
+  this->byte_idx = 0;
+}
+
 void Bits::flush_bits() {
-  if (this->byte_idx == 0)
+  drain();
+  if (this->byte_idx == 0 || !this->fd)
     return;
   fwrite(this->bits, 1, this->byte_idx, this->fd);
   this->byte_idx = 0;
@@ -23,8 +41,51 @@ int Bits::space_available() {
   return this->capacity - this->byte_idx;
 }
 
+void Bits::drain_byte() {
+  make_room();
+  int64_t val3 = this->accum >> 56;
+  this->bits[this->byte_idx] = val3;
+  this->byte_idx++;
+  if (val3 == this->pending_stuff_on) {
+    this->bits[this->byte_idx] = this->pending_stuff_val;
+    this->byte_idx++;
+  }
+  this->bit_idx -= 8;
+  this->accum <<= 8;
+}
+
+void Bits::drain_word() {
+  make_room();
+  uint32_t word = this->accum >> 32;
+  // does any byte of word need stuffing? (the usual has-zero-byte trick)
+  uint32_t diff = word ^ ((uint32_t)(this->pending_stuff_on & 0xFF) * 0x01010101u);
+  bool needs_stuffing = this->pending_stuff_on >= 0 && this->pending_stuff_on <= 0xFF &&
+    ((diff - 0x01010101u) & ~diff & 0x80808080u);
+  if (needs_stuffing) {
+    for (int i = 0; i < 4; i++) {
+      drain_byte();
+    }
+    return;
+  }
+  this->bits[this->byte_idx] = word >> 24;
+  this->bits[this->byte_idx+1] = word >> 16;
+  this->bits[this->byte_idx+2] = word >> 8;
+  this->bits[this->byte_idx+3] = word;
+  this->byte_idx += 4;
+  this->bit_idx -= 32;
+  this->accum <<= 32;
+}
+
+void Bits::drain() {
+  while (this->bit_idx >= 8) {
+    drain_byte();
+  }
+}
+
 void Bits::pack(int64_t val, int nbits) {
   if (nbits <= 0 || nbits >= 64) return;
+  // anything batched up came from pack_and_stuff
+  drain();
   int64_t val2 = val;
   int64_t mask = ((int64_t)1 << nbits) - 1;
   val2 &= mask;
@@ -33,38 +94,35 @@ void Bits::pack(int64_t val, int nbits) {
   this->accum |= val2;
   this->bit_idx += nbits;
   while (this->bit_idx >= 8) {
+    make_room();
     int64_t val3 = this->accum >> 56;
     this->bits[this->byte_idx] = val3;
     this->byte_idx++;
-    if (space_available() == 0)
-      flush_bits();
     this->bit_idx -= 8;
     this->accum <<= 8;
   }
 }
 
-void Bits::pack_and_stuff(int64_t val, int nbits, int64_t stuff_on, int64_t stuff_val) {
-  if (nbits <= 0 || nbits >= 64) return;
-  int64_t val2 = val;
-  int64_t mask = ((int64_t)1 << nbits) - 1;
-  val2 &= mask;
-  int64_t shift_amt = 64 - nbits - this->bit_idx;
-  val2 <<= shift_amt;
-  this->accum |= val2;
-  this->bit_idx += nbits;
-  while (this->bit_idx >= 8) {
-    int64_t val3 = this->accum >> 56;
-    this->bits[this->byte_idx] = val3;
-    this->byte_idx++;
-    if (space_available() == 0)
-      flush_bits();
-    if (val3 == stuff_on) {
-      this->bits[this->byte_idx] = stuff_val;
-      this->byte_idx += 1;
-      if (space_available() == 0)
-	flush_bits();
-    }
-    this->bit_idx -= 8;
-    this->accum <<= 8;
+void Bits::append(Bits &other) {
+  drain();
+  other.drain();
+  assert(this->bit_idx == 0 && other.bit_idx == 0);
+  int copied = 0;
+  while (copied < other.byte_idx) {
+    make_room();
+    int n = space_available();
+    if (n > other.byte_idx - copied)
+      n = other.byte_idx - copied;
+    memcpy(this->bits + this->byte_idx, other.bits + copied, n);
+    this->byte_idx += n;
+    copied += n;
   }
 }
+
+void Bits::reset() {
+  this->byte_idx = 0;
+  this->bit_idx = 0;
+  this->accum = 0;
+  this->pending_stuff_on = 0xFF;
+  this->pending_stuff_val = 0;
+}
@@ -9,6 +9,11 @@ using namespace std;
 #define IS_POWER_OF_TWO(x) (x) > 0 && (((x) & ((x) - 1)) == 0)
 
 // Deletes bits when goes out of scope!
+// With a null fd, the bits are kept in memory (growing as needed) rather than
+// flushed, so they can be appended to another Bits later.
+// pack_and_stuff batches complete bytes in the accumulator and writes them out
+// (with stuffing) 4 at a time, so the bytes in bits lag behind what's been packed
+// until flush_bits or append.
 struct Bits {
   int capacity;
   int byte_idx;
@@ -16,10 +21,22 @@ struct Bits {
   FILE *fd;
   uint64_t accum;
   uint8_t *bits;
+  // the stuffing for the complete bytes still in the accumulator
+  int64_t pending_stuff_on;
+  int64_t pending_stuff_val;
 
-  Bits(FILE *fd, int capacity=1024) : capacity(capacity), byte_idx(0), bit_idx(0),
-    fd(fd), accum(0), bits(new uint8_t[capacity]) { 
-    assert(IS_POWER_OF_TWO(capacity));
+  // Output to a file is written out a buffer at a time, so it gets a big one. In memory,
+  // the buffer grows as needed, so it starts small: there can be a lot of them (e.g. one
+  // per restart segment), and each may only hold a few hundred bytes.
+  static constexpr int FILE_CAPACITY = 1<<16;
+  static constexpr int MEMORY_CAPACITY = 1024;
+
+  // capacity 0 picks one of the defaults above
+  Bits(FILE *fd=nullptr, int capacity=0) :
+    capacity(capacity > 0 ? capacity : fd ? FILE_CAPACITY : MEMORY_CAPACITY), byte_idx(0), bit_idx(0),
+    fd(fd), accum(0), bits(new uint8_t[this->capacity]), pending_stuff_on(0xFF), pending_stuff_val(0) { 
+    assert(IS_POWER_OF_TWO(this->capacity));
+    assert(this->capacity >= 16);
   }
 
   ~Bits() { delete[] bits; }
@@ -29,6 +46,46 @@ struct Bits {
   int space_available();
   void pack(int64_t val, int nbits);
   void pack_and_stuff(int64_t val, int nbits, int64_t stuff_on, int64_t stuff_val);
+  // append the complete bytes of other. Both must be byte aligned.
+  void append(Bits &other);
+  // empty it out, to be reused for a new stream
+  void reset();
+
+private:
+
+  // write out the complete bytes in the accumulator
+  void drain();
+  // write out the top 4 bytes of the accumulator
+  void drain_word();
+  // write out the top byte of the accumulator
+  void drain_byte();
+  // make sure there's room for at least 8 more bytes in bits
+  void make_room();
 
 };
 
+// inline since it's called for every code
+inline void Bits::pack_and_stuff(int64_t val, int nbits, int64_t stuff_on, int64_t stuff_val) {
+  if (nbits <= 0 || nbits >= 64) return;
+  if (nbits > 32) {
+    // keep room in the accumulator
+    pack_and_stuff(val >> 32, nbits - 32, stuff_on, stuff_val);
+    pack_and_stuff(val, 32, stuff_on, stuff_val);
+    return;
+  }
+  if (stuff_on != this->pending_stuff_on || stuff_val != this->pending_stuff_val) {
+    drain();
+    this->pending_stuff_on = stuff_on;
+    this->pending_stuff_val = stuff_val;
+  }
+  // bit_idx < 32 here, so this fits
+  uint64_t val2 = val;
+  uint64_t mask = ((uint64_t)1 << nbits) - 1;
+  val2 &= mask;
+  val2 <<= 64 - nbits - this->bit_idx;
+  this->accum |= val2;
+  this->bit_idx += nbits;
+  if (this->bit_idx >= 32) {
+    drain_word();
+  }
+}
@@ -0,0 +1,64 @@
+// -*-c++-*-
+
+#pragma once
+
+#include "staged/staged.h"
+
+// RGB to YCbCr as in JFIF, where RGB is rows x cols x 3 and YCbCr is 3 x rows x cols.
+// All three components are computed in one vectorized pass over RGB.
+
+///
+/// With doubles, truncating each component
+template <typename RGB_T, typename YCbCr_T>
+void color_double(RGB_T &RGB, YCbCr_T &YCbCr) {
+  shim::Iter<'i'> i;
+  shim::Iter<'j'> j;
+  auto RGBp = RGB.permute({2,0,1});
+  shim::Vectorize::apply();
+  shim::fuse([&]() {
+    YCbCr[0][i][j] =
+      shim::cast<int>(shim::cast<double>(RGBp[0][i][j])*0.299 +
+		      shim::cast<double>(RGBp[1][i][j])*0.587 +
+		      shim::cast<double>(RGBp[2][i][j])*0.114);
+    YCbCr[1][i][j] =
+      shim::cast<int>(shim::cast<double>(RGBp[0][i][j])*-0.168736 +
+		      shim::cast<double>(RGBp[1][i][j])*-0.33126 +
+		      shim::cast<double>(RGBp[2][i][j])*0.500002) + 128;
+    YCbCr[2][i][j] =
+      shim::cast<int>(shim::cast<double>(RGBp[0][i][j])*0.5 +
+		      shim::cast<double>(RGBp[1][i][j])*-0.418688 +
+		      shim::cast<double>(RGBp[2][i][j])*-0.081312) + 128;
+  });
+}
+
+///
+/// With the coefficients of color_double in 16-bit fixed point (15 fractional bits).
+/// Samples and coefficients both fit in int16_t and the sums fit in int, so the C compiler
+/// vectorizes this with 16-bit lanes and integer multiply-adds, with no conversions to
+/// and from double.
+/// The biases (and division rather than shifting, which truncates negative values
+/// like cast<int>) were picked by checking every RGB value against color_double. Y, Cb
+/// and Cr differ from it on 0.133%, 0.031% and 0.167% of RGB values, and only by 1
+/// there. color_double itself can't be matched exactly, since whether it truncates
+/// to n or n-1 when the exact result is the integer n depends on rounding error.
+template <typename RGB_T, typename YCbCr_T>
+void color_fixed(RGB_T &RGB, YCbCr_T &YCbCr) {
+  shim::Iter<'i'> i;
+  shim::Iter<'j'> j;
+  auto RGBp = RGB.permute({2,0,1});
+  shim::Vectorize::apply();
+  shim::fuse([&]() {
+    YCbCr[0][i][j] =
+      (shim::cast<int>(shim::cast<int16_t>(RGBp[0][i][j])) * 9798 +
+       shim::cast<int>(shim::cast<int16_t>(RGBp[1][i][j])) * 19235 +
+       shim::cast<int>(shim::cast<int16_t>(RGBp[2][i][j])) * 3735) >> 15;
+    YCbCr[1][i][j] =
+      (shim::cast<int>(shim::cast<int16_t>(RGBp[0][i][j])) * -5529 +
+       shim::cast<int>(shim::cast<int16_t>(RGBp[1][i][j])) * -10855 +
+       shim::cast<int>(shim::cast<int16_t>(RGBp[2][i][j])) * 16384 + 1) / 32768 + 128;
+    YCbCr[2][i][j] =
+      (shim::cast<int>(shim::cast<int16_t>(RGBp[0][i][j])) * 16384 +
+       shim::cast<int>(shim::cast<int16_t>(RGBp[1][i][j])) * -13719 +
+       shim::cast<int>(shim::cast<int16_t>(RGBp[2][i][j])) * -2665) / 32768 + 128;
+  });
+}
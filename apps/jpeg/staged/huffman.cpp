@@ -1,6 +1,11 @@
 #include <stdio.h>
+#include <stdint.h>
 #include <iostream>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "huffman.h"
+#include "huffman_decode.h"
 
 int luma_DC_huffbits[] = {0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0};
 int luma_DC_huffvals[] = {0,1,2,3,4,5,6,7,8,9,0xA,0xB};
@@ -89,71 +94,98 @@ HuffmanCodes generate_codes(int *DC_bits, int *DC_vals, int *AC_bits, int *AC_va
   return codes;
 }
 
+void build_decode_table(int *huffbits, int *huffvals, int table[HUFF_TABLE_INTS]) {
+  int huffsize[257];
+  int huffcode[257];
+  int lastp = generate_huffsize(huffbits, huffsize);
+  generate_huffcode(huffsize, huffcode);
+  for (int i = 0; i < HUFF_TABLE_INTS; i++) {
+    table[i] = 0;
+  }
+  // every lookahead that starts with a short code maps to it
+  for (int p = 0; p < lastp; p++) {
+    int len = huffsize[p];
+    if (len <= HUFF_LOOKAHEAD) {
+      int first = huffcode[p] << (HUFF_LOOKAHEAD - len);
+      for (int i = 0; i < (1 << (HUFF_LOOKAHEAD - len)); i++) {
+	table[HUFF_LOOK + first + i] = (len << 8) | huffvals[p];
+      }
+    }
+    table[HUFF_VALS + p] = huffvals[p];
+  }
+  int p = 0;
+  table[HUFF_MAXCODE] = -1;
+  for (int l = 1; l < 17; l++) {
+    if (huffbits[l] > 0) {
+      table[HUFF_VALOFFSET + l] = p - huffcode[p];
+      p += huffbits[l];
+      table[HUFF_MAXCODE + l] = huffcode[p - 1];
+    } else {
+      table[HUFF_MAXCODE + l] = -1;
+    }
+  }
+  // stops the search for corrupt codes
+  table[HUFF_MAXCODE + 17] = 0x7FFFFFFF;
+}
+
 void huffman_encode_block_proxy(HeapArray<int> obj, int color_idx, int last_val,
 				Bits &bits, int *zigzag, const HuffmanCodes &codes) {
   huffman_encode_block(obj.base->data, color_idx, last_val, bits, zigzag, codes);
 }
 
+// bit e is set if zz[e] != 0
+static inline uint64_t nonzero_mask(const int zz[64]) {
+  uint64_t mask = 0;
+#ifdef __SSE2__
+  __m128i zero = _mm_setzero_si128();
+  for (int e = 0; e < 64; e += 8) {
+    __m128i lo = _mm_loadu_si128((const __m128i*)&zz[e]);
+    __m128i hi = _mm_loadu_si128((const __m128i*)&zz[e+4]);
+    // saturating, so nonzero stays nonzero
+    __m128i packed = _mm_packs_epi32(lo, hi);
+    __m128i is_zero = _mm_cmpeq_epi16(packed, zero);
+    uint64_t zeros = _mm_movemask_epi8(_mm_packs_epi16(is_zero, is_zero)) & 0xFF;
+    mask |= (~zeros & 0xFF) << e;
+  }
+#else
+  for (int e = 0; e < 64; e++) {
+    mask |= (uint64_t)(zz[e] != 0) << e;
+  }
+#endif
+  return mask;
+}
+
 void huffman_encode_block(int *obj, int color_idx, int last_val,
 			  Bits &bits, int *zigzag, const HuffmanCodes &codes) {
-  // DC
   int base_lidx = color_idx * 8 * 8;
-  int dc = obj[base_lidx];
-  int temp = dc - last_val;
-  int temp2 = temp;
-  if (temp < 0) {
-    temp = -temp;
-    temp2--;
-  }
-  int nbits = 0;
-  while (temp > 0) {
-    nbits++;
-    temp >>= 1;
-  }
-  bits.pack_and_stuff(codes.dc_ehufco[nbits], codes.dc_ehufsz[nbits], 0xFF, 0);
-  if (nbits != 0) {
-    bits.pack_and_stuff(temp2, nbits, 0xFF, 0);
+  int zz[64];
+  for (int e = 0; e < 64; e++) {
+    zz[e] = obj[base_lidx+zigzag[e]];
   }
+  // DC
+  int temp = zz[0] - last_val;
+  int temp2 = temp < 0 ? temp - 1 : temp;
+  int nbits = magnitude_bits(temp);
+  pack_code_and_val(bits, codes.dc_ehufco[nbits], codes.dc_ehufsz[nbits], temp2, nbits);
   // AC
-  int run = 0;  
-  for (int e = 1; e < 64; e++) {
-    temp = obj[base_lidx+zigzag[e]];
-    if (temp == 0)
-      run++;
-    else {
-      while (run > 15) {
-	bits.pack_and_stuff(codes.ac_ehufco[0xF0], codes.ac_ehufsz[0xF0], 0xFF, 0);
-	run -= 16;
-      }
-      temp2 = temp;
-      if (temp < 0) {
-	temp = -temp;
-	temp2--;
-      }
-      nbits = 1;
-      temp >>= 1;
-      while (temp > 0) {
-	nbits++;
-	temp >>= 1;
-      }
-      int i = (run << 4) + nbits;
-      bits.pack_and_stuff(codes.ac_ehufco[i], codes.ac_ehufsz[i], 0xFF, 0);
-      bits.pack_and_stuff(temp2, nbits, 0xFF, 0);
-      run = 0;
+  // only visit the nonzeros. the runs of zeros are the gaps between them.
+  uint64_t nonzero = nonzero_mask(zz) & ~(uint64_t)1;
+  int last = 0;
+  while (nonzero) {
+    int e = __builtin_ctzll(nonzero);
+    nonzero &= nonzero - 1;
+    int run = e - last - 1;
+    while (run > 15) {
+      bits.pack_and_stuff(codes.ac_ehufco[0xF0], codes.ac_ehufsz[0xF0], 0xFF, 0);
+      run -= 16;
     }
+    temp = zz[e];
+    temp2 = temp < 0 ? temp - 1 : temp;
+    nbits = magnitude_bits(temp);
+    int i = (run << 4) + nbits;
+    pack_code_and_val(bits, codes.ac_ehufco[i], codes.ac_ehufsz[i], temp2, nbits);
+    last = e;
   }
-  if (run > 0)
+  if (last != 63)
     bits.pack_and_stuff(codes.ac_ehufco[0], codes.ac_ehufsz[0], 0xFF, 0);
 }
-
-void pack_DC(Bits &bits, int idx, const HuffmanCodes &codes) {
-  bits.pack_and_stuff(codes.dc_ehufco[idx], codes.dc_ehufsz[idx], 0xFF, 0);  
-}
-
-void pack_AC(Bits &bits, int idx, const HuffmanCodes &codes) {
-  bits.pack_and_stuff(codes.ac_ehufco[idx], codes.ac_ehufsz[idx], 0xFF, 0);
-}
-
-void pack_and_stuff(Bits &bits, int val, int nbits) {
-  bits.pack_and_stuff(val, nbits, 0xFF, 0);
-}
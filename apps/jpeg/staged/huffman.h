@@ -28,8 +28,35 @@ void huffman_encode_block_proxy(HeapArray<int> obj, int color_idx, int last_val,
 				int *zigzag, const HuffmanCodes &codes);
 void huffman_encode_block(int *obj, int color_idx, int last_val, Bits &bits, 
 			  int *zigzag, const HuffmanCodes &codes);
+
+// the number of bits needed for the magnitude of v
+inline int magnitude_bits(int v) {
+  int mag = v < 0 ? -v : v;
+  return mag == 0 ? 0 : 32 - __builtin_clz(mag);
+}
+
+// pack a code of the given size followed by the low nbits of val
+inline void pack_code_and_val(Bits &bits, int code, int size, int val, int nbits) {
+  int64_t mask = ((int64_t)1 << nbits) - 1;
+  int64_t packed = ((int64_t)code << nbits) | (val & mask);
+  bits.pack_and_stuff(packed, size + nbits, 0xFF, 0);
+}
+
 #if VERSION==2
-void pack_DC(Bits &bits, int idx, const HuffmanCodes &codes);
-void pack_AC(Bits &bits, int idx, const HuffmanCodes &codes);
-void pack_and_stuff(Bits &bits, int val, int nbits);
+// These are called from the staged Huffman encoder, so they're inline to let the
+// packing be optimized along with the generated code.
+
+inline void pack_AC(Bits &bits, int idx, const HuffmanCodes &codes) {
+  bits.pack_and_stuff(codes.ac_ehufco[idx], codes.ac_ehufsz[idx], 0xFF, 0);
+}
+
+// idx is the number of bits in val
+inline void pack_DC_and_val(Bits &bits, int idx, int val, const HuffmanCodes &codes) {
+  pack_code_and_val(bits, codes.dc_ehufco[idx], codes.dc_ehufsz[idx], val, idx);
+}
+
+// the low 4 bits of idx are the number of bits in val
+inline void pack_AC_and_val(Bits &bits, int idx, int val, const HuffmanCodes &codes) {
+  pack_code_and_val(bits, codes.ac_ehufco[idx], codes.ac_ehufsz[idx], val, idx & 0xF);
+}
 #endif
@@ -0,0 +1,20 @@
+#pragma once
+
+// Huffman decoding tables, flattened into ints so the staged decoder can index straight
+// into them at offsets fixed during staging.
+// A code of up to HUFF_LOOKAHEAD bits is decoded with a single lookup of the next
+// HUFF_LOOKAHEAD bits. Longer codes fall back to checking one length at a time.
+
+constexpr int HUFF_LOOKAHEAD = 9;
+// [1 << HUFF_LOOKAHEAD] (length << 8) | symbol, or 0 if the code is longer than the lookahead
+constexpr int HUFF_LOOK = 0;
+// [18] the largest code of each length, or -1 if there are none. 17 is a sentinel.
+constexpr int HUFF_MAXCODE = HUFF_LOOK + (1 << HUFF_LOOKAHEAD);
+// [18] the index into the symbols of each length's codes, minus the smallest code
+constexpr int HUFF_VALOFFSET = HUFF_MAXCODE + 18;
+// [256] the symbols, in code order
+constexpr int HUFF_VALS = HUFF_VALOFFSET + 18;
+constexpr int HUFF_TABLE_INTS = HUFF_VALS + 256;
+
+// huffbits and huffvals are as in a DHT segment, with huffbits[l] the number of codes of length l
+void build_decode_table(int *huffbits, int *huffvals, int table[HUFF_TABLE_INTS]);
@@ -6,8 +6,12 @@
 #else
 static_assert(false, "Set VERSION=1||2");
 #endif
+#include <algorithm>
 #include <chrono>
 #include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "bits.h"
 #include "syntax.h"
 
@@ -68,6 +72,84 @@ void read_ppm_body(FILE *fd, uint8_t *image, int H, int W) {
   assert(read == sz);
 }
 
+// Reads the body of a PPM a band of rows at a time on its own thread, so reading overlaps
+// with encoding. The bands go through a ring of NBUFFERS buffers: while the encoder works
+// on one band, the next is read into the other.
+struct BandReader {
+  static constexpr int NBUFFERS = 2;
+  FILE *fd;
+  int H;
+  int W;
+  int band_rows;
+  int nbands;
+  uint8_t *buffers[NBUFFERS];
+  // bands read so far, and bands the encoder is done with
+  int produced;
+  int consumed;
+  mutex lock;
+  condition_variable changed;
+  thread reader;
+
+  BandReader(FILE *fd, int H, int W, int band_rows) : fd(fd), H(H), W(W), band_rows(band_rows),
+    nbands((H + band_rows - 1) / band_rows), produced(0), consumed(0) {
+    for (int b = 0; b < NBUFFERS; b++)
+      buffers[b] = new uint8_t[band_rows*W*3];
+    reader = thread([this]() { run(); });
+  }
+
+  ~BandReader() {
+    reader.join();
+    for (int b = 0; b < NBUFFERS; b++)
+      delete[] buffers[b];
+  }
+
+  int rows(int b) {
+    return min(band_rows, H - b * band_rows);
+  }
+
+  // Wait for band b to be read. It stays valid until release.
+  uint8_t *acquire(int b) {
+    unique_lock<mutex> guard(lock);
+    changed.wait(guard, [&]() { return produced > b; });
+    return buffers[b % NBUFFERS];
+  }
+
+  // done with the oldest band, so its buffer can be reused
+  void release() {
+    {
+      lock_guard<mutex> guard(lock);
+      consumed++;
+    }
+    changed.notify_all();
+  }
+
+private:
+
+  void run() {
+    for (int b = 0; b < nbands; b++) {
+      {
+	unique_lock<mutex> guard(lock);
+	changed.wait(guard, [&]() { return produced - consumed < NBUFFERS; });
+      }
+      read_ppm_body(fd, buffers[b % NBUFFERS], rows(b), W);
+      {
+	lock_guard<mutex> guard(lock);
+	produced++;
+      }
+      changed.notify_all();
+    }
+  }
+};
+
+// pad out segment s and append it to bits, followed by a RSTn marker unless it's the last
+void write_segment(Bits &bits, Bits &segment, int s, int nsegments) {
+  segment.complete_byte_and_stuff(1, 0xFF, 0);
+  bits.append(segment);
+  if (s < nsegments - 1)
+    syntax_restart_marker(bits, s);
+  segment.reset();
+}
+
 void scale_quant(int quant[], int quality) {
   int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
   for (int i = 0; i < 8; i++) {
@@ -78,8 +160,35 @@ void scale_quant(int quant[], int quality) {
 }
 
 int main(int argc, char **argv) {
-  if (argc != 3) {
-    cerr << "Usage: ./jpeg <ppm> <jpg>" << endl;
+  if (argc < 3 || argc > 6) {
+    cerr << "Usage: ./jpeg <ppm> <jpg> [restart interval in MCUs] [444|422|420] [whole|stream]" << endl;
+    exit(-1);
+  }
+  // 0 means no restart intervals, so the MCUs are encoded serially
+  int restart_interval = argc >= 4 ? atoi(argv[3]) : 0;
+  if (restart_interval < 0 || restart_interval > 65535) {
+    cerr << "Restart interval must be in [0,65535]" << endl;
+    exit(-1);
+  }
+  // the luma sampling factors, so chroma is subsampled by Hs x Vs
+  string sampling = argc >= 5 ? argv[4] : "444";
+  int Hs = 1;
+  int Vs = 1;
+  if (sampling == "422") {
+    Hs = 2;
+  } else if (sampling == "420") {
+    Hs = 2;
+    Vs = 2;
+  } else if (sampling != "444") {
+    cerr << "Sampling must be one of 444, 422, or 420" << endl;
+    exit(-1);
+  }
+  // Streaming reads and encodes a row of MCUs at a time, so memory doesn't grow with the
+  // height of the image. Only the segments within a row of MCUs can be encoded in parallel
+  // though, rather than all of them.
+  string mode = argc == 6 ? argv[5] : "whole";
+  if (mode != "whole" && mode != "stream") {
+    cerr << "Mode must be one of whole or stream" << endl;
     exit(-1);
   }
   std::cerr << "Running STAGED jpeg" << std::endl;
@@ -95,9 +204,19 @@ int main(int argc, char **argv) {
   FILE *ifd = fopen(ppm.c_str(), "r");
   int H, W, max_val;
   read_ppm_header(ifd, H, W, max_val);
-  uint8_t *RGB = new uint8_t[H*W*3];
-  read_ppm_body(ifd, RGB, H, W);
-  fclose(ifd);
+
+  // split into segments that can be encoded independently
+  int mcus_per_row = (W + 8*Hs - 1) / (8*Hs);
+  int nmcus = mcus_per_row * ((H + 8*Vs - 1) / (8*Vs));
+  if (restart_interval >= nmcus)
+    restart_interval = 0;
+  int nsegments = restart_interval == 0 ? 1 : (nmcus + restart_interval - 1) / restart_interval;
+  // The Bits each segment is encoded into. When streaming, segment s uses slot s % nslots,
+  // and there are enough slots for every segment with MCUs in one row of MCUs.
+  int nslots = restart_interval == 0 ? 1 : mode == "whole" ? nsegments :
+    min(nsegments, (mcus_per_row - 1) / restart_interval + 2);
+  // a single segment goes straight to the output
+  Bits *segments = restart_interval == 0 ? &bits : new Bits[nslots];
 
   // prep quant
   scale_quant(luma_quant, 75);
@@ -108,7 +227,7 @@ int main(int argc, char **argv) {
   syntax_JFIF(bits);
   syntax_quant_table(bits, luma_quant, zigzag, true);
   syntax_quant_table(bits, chroma_quant, zigzag, false);
-  syntax_frame_header(bits, H, W);    
+  syntax_frame_header(bits, H, W, Hs, Vs);
   syntax_huffman_table(bits,
 		       luma_DC_huffbits, 17,
 		       luma_DC_huffvals, 12,
@@ -125,10 +244,47 @@ int main(int argc, char **argv) {
 		       chroma_AC_huffbits, 17,
 		       chroma_AC_huffvals, 162,
 		       false, 1);
+  if (restart_interval > 0)
+    syntax_restart_interval(bits, restart_interval);
   syntax_scan_header(bits);
 
   // staged code
-  jpeg(RGB, H, W, luma_quant, chroma_quant, zigzag, luma_codes, chroma_codes, bits);
+  auto encode = Vs == 2 ? jpeg420 : Hs == 2 ? jpeg422 : jpeg;
+  int segment_mcus = restart_interval == 0 ? max(nmcus, 1) : restart_interval;
+  // DC predictions for a segment that spans calls to encode
+  int dc_in[3] = {0, 0, 0};
+  int dc_out[3] = {0, 0, 0};
+  if (mode == "whole") {
+    uint8_t *RGB = new uint8_t[H*W*3];
+    read_ppm_body(ifd, RGB, H, W);
+    encode(RGB, H, W, 0, luma_quant, chroma_quant, zigzag, luma_codes, chroma_codes,
+	   segment_mcus, segments, nslots, dc_in, dc_out);
+    delete[] RGB;
+    if (restart_interval > 0) {
+      for (int s = 0; s < nsegments; s++)
+	write_segment(bits, segments[s], s, nsegments);
+    }
+  } else {
+    BandReader reader(ifd, H, W, 8*Vs);
+    // segments before this have been written out
+    int written = 0;
+    for (int b = 0; b < reader.nbands; b++) {
+      uint8_t *band = reader.acquire(b);
+      encode(band, reader.rows(b), W, b * mcus_per_row, luma_quant, chroma_quant, zigzag,
+	     luma_codes, chroma_codes, segment_mcus, segments, nslots, dc_in, dc_out);
+      reader.release();
+      memcpy(dc_in, dc_out, sizeof(dc_in));
+      if (restart_interval > 0) {
+	// the segments that end in this band
+	int done = b == reader.nbands - 1 ? nsegments : (b + 1) * mcus_per_row / restart_interval;
+	for (; written < done; written++)
+	  write_segment(bits, segments[written % nslots], written, nsegments);
+      }
+    }
+  }
+  fclose(ifd);
+  if (restart_interval > 0)
+    delete[] segments;
   bits.complete_byte_and_stuff(1, 0xFF, 0);
   syntax_EOI(bits);
   bits.flush_bits();
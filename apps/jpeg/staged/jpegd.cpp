@@ -0,0 +1,82 @@
+#include <iostream>
+#include "sjpegd.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "syntax.h"
+
+using namespace std;
+
+int zigzag[] = {
+  0,  1,  8, 16, 9, 2, 3, 10,
+  17, 24, 32, 25, 18, 11, 4,
+  5,  12, 19, 26, 33, 40, 48,
+  41, 34, 27, 20, 13, 6,  7,
+  14, 21, 28, 35, 42, 49, 56,
+  57, 50, 43, 36, 29, 22, 15,
+  23, 30, 37, 44, 51, 58, 59,
+  52, 45, 38, 31, 39, 46, 53,
+  60, 61, 54, 47, 55, 62, 63
+};
+
+uint8_t *read_file(const char *fn, size_t &len) {
+  FILE *fd = fopen(fn, "rb");
+  if (!fd) {
+    cerr << "Cannot open " << fn << endl;
+    exit(-1);
+  }
+  fseek(fd, 0, SEEK_END);
+  len = ftell(fd);
+  fseek(fd, 0, SEEK_SET);
+  uint8_t *data = new uint8_t[len];
+  size_t read = fread(data, 1, len, fd);
+  assert(read == len);
+  fclose(fd);
+  return data;
+}
+
+void write_ppm(const char *fn, uint8_t *image, int H, int W) {
+  FILE *fd = fopen(fn, "wb");
+  fprintf(fd, "P6\n%d %d\n255\n", W, H);
+  fwrite(image, 1, 3 * H * W, fd);
+  fclose(fd);
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    cerr << "Usage: ./jpegd <jpg> <ppm>" << endl;
+    exit(-1);
+  }
+  std::cerr << "Running STAGED jpeg decoder" << std::endl;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  size_t len;
+  uint8_t *jpg = read_file(argv[1], len);
+  // the markers are parsed up front, so the staged code only sees the entropy-coded segments
+  JpegFrame *frame = new JpegFrame();
+  parse_jpeg(jpg, len, *frame);
+  delete[] jpg;
+
+  int H = frame->H;
+  int W = frame->W;
+  int nmcus = ((H + 8*frame->Vs - 1) / (8*frame->Vs)) * ((W + 8*frame->Hs - 1) / (8*frame->Hs));
+  int restart_interval = frame->restart_interval;
+  if (restart_interval == 0 || restart_interval > nmcus)
+    restart_interval = nmcus;
+  int nsegments = (nmcus + restart_interval - 1) / restart_interval;
+  if ((int)frame->segments.size() != nsegments + 1) {
+    cerr << "Cannot decode JPEG: expected " << nsegments << " restart segments but found " <<
+      frame->segments.size() - 1 << endl;
+    exit(-1);
+  }
+
+  // staged code
+  uint8_t *RGB = new uint8_t[H*W*3];
+  auto decode = frame->Vs == 2 ? jpegd420 : frame->Hs == 2 ? jpegd422 : jpegd;
+  decode(frame->scan.data(), frame->segments.data(), H, W, &frame->quant[0][0],
+	 &frame->huff[0][0][0], zigzag, restart_interval, RGB);
+  write_ppm(argv[2], RGB, H, W);
+  delete[] RGB;
+  delete frame;
+  std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+  std::cout << "Program took " << std::chrono::duration_cast<std::chrono::nanoseconds> (stop - start).count()/1e9 << "s" << std::endl;
+}
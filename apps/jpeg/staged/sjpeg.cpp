@@ -8,6 +8,7 @@
 #include "blocks/c_code_generator.h"
 #include "blocks/rce.h"
 #include "staged/staged.h"
+#include "color.h"
 
 using namespace std;
 using namespace shim;
@@ -28,6 +29,8 @@ constexpr char huffmanCodesType[] = "const HuffmanCodes&";
 constexpr char bitsType[] = "Bits&";
 using HuffmanCodes = typename builder::name<huffmanCodesType>;
 using Bits = typename builder::name<bitsType>;
+constexpr char bitsArrType[] = "Bits*";
+using BitsArr = typename builder::name<bitsArrType>;
 
 // Question: things don't seem to be happy when I have instances of builder::builder.
 // When should I use one vs the other???
@@ -59,92 +62,64 @@ void color_one(RGB_T RGB, Block<int,3> YCbCr, dint comp) {
   }
 }
 
-template <typename RGB_T, typename YCbCr_T>
-void color(RGB_T &RGB, YCbCr_T &YCbCr) {
-//  shim::permute(RGB, std::tuple{2,0,1});
-  auto RGBp = RGB.permute({2,0,1});
-  YCbCr[0][i][j] = 
-    cast<int>(cast<double>(RGBp[0][i][j])*0.299 + 
-	      cast<double>(RGBp[1][i][j])*0.587 + 
-	      cast<double>(RGBp[2][i][j])*0.114);
-  YCbCr[1][i][j] = 
-    cast<int>(cast<double>(RGBp[0][i][j])*-0.168736 + 
-	      cast<double>(RGBp[1][i][j])*-0.33126 + 
-	      cast<double>(RGBp[2][i][j])*0.500002) + 128;
-  YCbCr[2][i][j] = 
-    cast<int>(cast<double>(RGBp[0][i][j])*0.5 + 
-	      cast<double>(RGBp[1][i][j])*-0.418688 + 
-	      cast<double>(RGBp[2][i][j])*-0.081312) + 128;
-//  shim::permute(RGB, {0,1,2});
-}
-
 // the external things to call for doing huffman
 // these are completely the wrong types but w/e
-//#if VERSION==1
-dyn_var<void(HEAP_T<int>,int,int,void*,void*,void*)> huffman_encode_block_proxy = builder::as_global("huffman_encode_block_proxy");
-dyn_var<void(HEAP_T<int>,int,int,void*,void*,void*)> huffman_encode_block = builder::as_global("huffman_encode_block");
-/*#else 
-// TODO I screwed this up somewhere
-dyn_var<void(void*,void*,void*)> pack_DC = builder::as_global("pack_DC");
+#if VERSION==1
+dyn_var<void(int*,int,int,void*,void*,void*)> huffman_encode_block = builder::as_global("huffman_encode_block");
+#else 
+// these are inline in huffman.h, so the packing ends up in the generated code
 dyn_var<void(void*,void*,void*)> pack_AC = builder::as_global("pack_AC");
-dyn_var<void(void*,void*,void*)> pack_and_stuff = builder::as_global("pack_and_stuff");
-void huffman_encode_block(View<int,3> obj, dint last_val,
-			  dyn_var<Bits> bits, Block<int,2> zigzag,
-			  dyn_var<HuffmanCodes> codes) {
+dyn_var<void(void*,void*,void*,void*)> pack_DC_and_val = builder::as_global("pack_DC_and_val");
+dyn_var<void(void*,void*,void*,void*)> pack_AC_and_val = builder::as_global("pack_AC_and_val");
+dyn_var<int(int)> magnitude_bits = builder::as_global("magnitude_bits");
+
+constexpr int zigzag_order[64] = {
+  0,  1,  8, 16, 9, 2, 3, 10, 
+  17, 24, 32, 25, 18, 11, 4,
+  5,  12, 19, 26, 33, 40, 48, 
+  41, 34, 27, 20, 13, 6,  7, 
+  14, 21, 28, 35, 42, 49, 56, 
+  57, 50, 43, 36, 29, 22, 15, 
+  23, 30, 37, 44, 51, 58, 59, 
+  52, 45, 38, 31, 39, 46, 53, 
+  60, 61, 54, 47, 55, 62, 63
+};
+
+// The zigzag order is fixed, so the scan over the AC coefficients is unrolled
+// during staging and each coefficient is read from a fixed spot in obj.
+void huffman_encode_block(View<int,3> &obj, dint &last_val, builder::builder bits,
+			  dyn_var<HuffmanCodes> &codes) {
   // DC
-  dint dc = obj(0,0,0);
-  dint temp = dc - last_val;
+  dint temp = obj(0,0,0) - last_val;
   dint temp2 = temp;
-  if (temp < 0) {
-    temp = -temp;
-    temp2 = temp2-1;
-  }
-  dint nbits = 0;
-  while (temp > 0) {
-    nbits=nbits+1;
-    temp = temp >> 1;
-  }
-  pack_DC(bits, nbits, codes);
-  if (nbits != 0) {
-    pack_and_stuff(bits, temp2, nbits);
-  }
+  if (temp < 0)
+    temp2 = temp2 - 1;
+  dint nbits = magnitude_bits(temp);
+  pack_DC_and_val(bits, nbits, temp2, codes);
   // AC
   dint run = 0;
-  for (dint e0 = 0; e0 < 8; e0 = e0+1) {
-    for (dint e1 = 0; e1 < 8; e1 = e1+1) {
-      if (e0==0 && e1==0) {
-      } else {
-	temp = obj.plidx(zigzag(e0,e1));
-	if (temp == 0)
-	  run = run + 1;
-	else {
-	  while (run > 15) {
-	    pack_AC(bits, 0xF0, codes);
-	    run = run - 16;
-	  }
-	  temp2 = temp;
-	  if (temp < 0) {
-	    temp = -temp;
-	    temp2 = temp2-1;
-	  }
-	  nbits = 1;
-	  temp = temp >> 1;
-	  while (temp > 0) {
-	    nbits++;
-	    temp = temp >> 1;
-	  }
-	  dint i = (run << 4) + nbits;
-	  pack_AC(bits, i, codes);
-	  pack_and_stuff(bits, temp2, nbits);
-	  run = 0;
-	}
+  for (sint e = 1; e < 64; e = e + 1) {
+    sint zz = zigzag_order[e];
+    temp = obj(0, zz / 8, zz % 8);
+    if (temp == 0) {
+      run = run + 1;
+    } else {
+      while (run > 15) {
+	pack_AC(bits, 0xF0, codes);
+	run = run - 16;
       }
+      temp2 = temp;
+      if (temp < 0)
+	temp2 = temp2 - 1;
+      nbits = magnitude_bits(temp);
+      pack_AC_and_val(bits, (run << 4) + nbits, temp2, codes);
+      run = 0;
     }
   }
   if (run > 0)
     pack_AC(bits, 0, codes);
 }
-#endif*/
+#endif
 
 void dct(View<int,3> obj) { 
 #define descale(x,n) ((x + ((1 << (n-1)))) >> n)
@@ -260,13 +235,130 @@ void quant(View<int,3> obj, Block<int,2> quant) {
   }
 }
 
+// Convert the part of an MCU row that a segment covers, from MCU column mc_first up to
+// (not including) mc_last, into band. The MCU row starts at pixel row r.
+// band is 3 x 8*Vs x (a whole MCU row of columns), and edge samples are replicated to pad
+// out partial MCUs. Replicating YCbCr is the same as replicating RGB and converting,
+// but converts fewer pixels.
+template <int Hs, int Vs, typename RGB_T>
+void color_band(RGB_T &RGB, Block<int,3> &band, dint r, dint mc_first, dint mc_last,
+		dyn_var<int> H, dyn_var<int> W) {
+  constexpr int MH = 8 * Vs;
+  constexpr int MW = 8 * Hs;
+  dint c = mc_first * MW;
+  dint cpad = mc_last * MW;
+  dint rend = r + MH;
+  if (rend > H)
+    rend = H;
+  dint cend = cpad;
+  if (cend > W)
+    cend = W;
+  dint nrows = rend - r;
+  auto src = RGB.slice(range(r,rend,1),range(c,cend,1),range(0,3,1));
+  auto dst = band.slice(range(0,3,1),range(0,nrows,1),range(c,cend,1));
+  color_fixed(src, dst);
+  if (nrows < MH) {
+    auto row_padding_area = band.slice(range(0,3,1),range(nrows,MH,1),range(c,cend,1));
+    row_padding_area[i][j][k] = band[i][nrows-1][k+c];
+  }
+  if (cend < cpad) {
+    auto col_padding_area = band.slice(range(0,3,1),range(0,MH,1),range(cend,cpad,1));
+    col_padding_area[i][j][k] = band[i][j][cend-1];
+  }
+}
+
+// encode the MCU whose left edge is at column c of band, using YCbCr as scratch space.
+// Luma is sampled Hs x Vs times as often as chroma, so an MCU is 8*Vs rows by 8*Hs columns.
+// YCbCr holds the MCU at full resolution, and coeffs the Hs*Vs luma blocks followed by
+// the Cb and Cr blocks. Without subsampling, these are the same Block.
+template <int Hs, int Vs>
+void encode_mcu(Block<int,3> &band, dint c,
+		Block<int,3> &YCbCr, Block<int,3> &coeffs,
+		Block<int,2> &luma_quant, Block<int,2> &chroma_quant,
+		dyn_var<int*> &zigzag,
+		dyn_var<HuffmanCodes> &luma_codes,
+		dyn_var<HuffmanCodes> &chroma_codes,
+		builder::builder bits,
+		dint &last_Y, dint &last_Cb, dint &last_Cr) {
+  constexpr int nY = Hs * Vs;
+  constexpr int MH = 8 * Vs;
+  constexpr int MW = 8 * Hs;
+  // offset
+  YCbCr[i][j][k] = band[i][j][k+c] - 128;
+  if constexpr (nY > 1) {
+    // luma stays at full resolution, so each 8x8 block is copied out
+    for (sint v = 0; v < Vs; v = v + 1) {
+      for (sint h = 0; h < Hs; h = h + 1) {
+	auto src = YCbCr.slice(range(0,1,1),range(v*8,v*8+8,1),range(h*8,h*8+8,1));
+	auto dst = coeffs.slice(range(v*Hs+h,v*Hs+h+1,1),range(0,8,1),range(0,8,1));
+	dst[i][j][k] = src[i][j][k];
+      }
+    }
+    // Chroma is coarser by Vs x Hs. Viewed at the resolution of the MCU, every pixel
+    // lands on the sample it's averaged into.
+    auto chroma = coeffs.slice(range(nY,nY+2,1),range(0,8,1),range(0,8,1));
+    auto chroma_fine = chroma.virtually_refine(1,Vs,Hs);
+    auto CbCr = YCbCr.slice(range(1,3,1),range(0,MH,1),range(0,MW,1));
+    constexpr int shift = nY == 4 ? 2 : 1;
+    chroma[i][j][k] = 0;
+    chroma_fine[i][j][k] = chroma_fine[i][j][k] + CbCr[i][j][k];
+    chroma[i][j][k] = (chroma[i][j][k] + (1 << (shift - 1))) >> shift;
+  }
+  for (sint b = 0; b < nY + 2; b = b + 1) {
+    auto blk = coeffs.slice(range(b,b+1,1),range(0,8,1),range(0,8,1));
+    dct(blk);
+    quant(blk, b < nY ? luma_quant : chroma_quant);
+  }
+#if VERSION==1
+  // the color_idx gives the base lidx for each
+  dyn_var<int*> raw = coeffs.allocator->raw();
+  for (sint b = 0; b < nY; b = b + 1) {
+    huffman_encode_block(raw, b, last_Y, bits, zigzag, luma_codes);
+    last_Y = coeffs((int)b,0,0);
+  }
+  huffman_encode_block(raw, nY, last_Cb, bits, zigzag, chroma_codes);
+  huffman_encode_block(raw, nY + 1, last_Cr, bits, zigzag, chroma_codes);
+#else
+  for (sint b = 0; b < nY; b = b + 1) {
+    auto Y = coeffs.slice(range(b,b+1,1),range(0,8,1),range(0,8,1));
+    huffman_encode_block(Y, last_Y, bits, luma_codes);
+    last_Y = Y(0,0,0);
+  }
+  auto Cb = coeffs.slice(range(nY,nY+1,1),range(0,8,1),range(0,8,1));
+  auto Cr = coeffs.slice(range(nY+1,nY+2,1),range(0,8,1),range(0,8,1));
+  huffman_encode_block(Cb, last_Cb, bits, chroma_codes);
+  huffman_encode_block(Cr, last_Cr, bits, chroma_codes);
+#endif
+  last_Cb = coeffs(nY,0,0);
+  last_Cr = coeffs(nY+1,0,0);
+}
+
+// The image is split into segments of restart_interval MCUs (in raster order). Segments are
+// independent (each has its own scratch Blocks and its DC predictions start at 0), so
+// they're encoded in parallel.
+// The caller pads out each segment and concatenates them with RSTn markers in between.
+// For a single serial stream, use restart_interval = number of MCUs.
+// Hs and Vs are the luma sampling factors (chroma is always 1x1), so <1,1> is 4:4:4,
+// <2,1> is 4:2:2, and <2,2> is 4:2:0.
+// input doesn't have to be the whole image, so it can be streamed in. It's H rows of whole
+// MCU rows, starting at MCU first_mcu of the image, and the last call's H includes the
+// partial MCU row at the bottom (if any). Segment s is written to segment_bits[s % nslots],
+// so the caller can reuse the Bits of segments it has already written out. A segment
+// that started in an earlier call picks up its DC predictions from dc_in, and one that
+// continues past the end of input leaves them in dc_out.
+template <int Hs, int Vs>
 void jpeg_staged(dyn_var<uint8_t*> input, dyn_var<int> H, dyn_var<int> W, 
+		 dyn_var<int> first_mcu,
 		 dyn_var<int*> luma_quant_arr, 
 		 dyn_var<int*> chroma_quant_arr,
 		 dyn_var<int*> zigzag, 
 		 dyn_var<HuffmanCodes> luma_codes, 
 		 dyn_var<HuffmanCodes> chroma_codes,
-		 dyn_var<Bits> bits) {
+		 dyn_var<int> restart_interval,
+		 dyn_var<BitsArr> segment_bits,
+		 dyn_var<int> nslots,
+		 dyn_var<int*> dc_in,
+		 dyn_var<int*> dc_out) {
 
   // Tables (these are already scaled)
   auto luma_quant = Block<int,2>::user({8,8}, luma_quant_arr);
@@ -274,69 +366,58 @@ void jpeg_staged(dyn_var<uint8_t*> input, dyn_var<int> H, dyn_var<int> W,
     
   // start it up
   auto RGB = Block<uint8_t,3>::user({H, W, 3}, input);
-  dint last_Y = 0;
-  dint last_Cb = 0;
-  dint last_Cr = 0;
+  dint mcus_per_row = (W + 8*Hs - 1) / (8*Hs);
+  dint last_mcu = first_mcu + mcus_per_row * ((H + 8*Vs - 1) / (8*Vs));
+  // the segments with any MCUs in input
+  dint first_segment = first_mcu / restart_interval;
+  dint end_segment = (last_mcu + restart_interval - 1) / restart_interval;
 
-  // NOTE: for comparing to unstaged, use the heap allocation (unstaged manually allocates the array)
-  //  auto YCbCr = Block<int,3>::stack<3,8,8>();
-  auto YCbCr = Block<int,3>::heap({3,8,8});
-  //	auto padded = Block<uint8_t,3>::stack<8,8,3>();
-  auto padded = Block<uint8_t,3>::heap({8,8,3});
-  
-  for (dint r = 0; r < H; r = r + 8) {
-    for (dint c = 0; c < W; c = c + 8) {
-      auto mcu = RGB.slice(range(r,r+8,1),range(c,c+8,1),range(0,3,1));
-      if (r+8>H || c+8>W) {
-	// need padding
-	dint row_pad = 0;
-	dint col_pad = 0;
-	if (r+8>H)
-	  row_pad = 8 - (H%8);
-	if (c+8>W)
-	  col_pad = 8 - (W%8);
-	// col major still
-	dint last_valid_row = 8 - row_pad;
-	dint last_valid_col = 8 - col_pad;
-	// copy over original
-	auto orig_padded = padded.slice(range(0,last_valid_row,1),range(0,last_valid_col,1),range(0,3,1));
-	orig_padded[i][j][k] = RGB[i+r][j+c][k];
-	// pad
-	auto row_padding_area = padded.slice(range(last_valid_row,last_valid_row+row_pad,1),range(0,8,1),range(0,3,1));
-	auto col_padding_area = padded.slice(range(0,8,1), range(last_valid_col,last_valid_col+col_pad,1), range(0,3,1));
-	row_padding_area[i][j][k] = padded[(last_valid_row-1)][j][k];
-	col_padding_area[i][j][k] = padded[i][(last_valid_col-1)][k];
-	color(padded, YCbCr);
-      } else {
-	// no padding needed
-	color(mcu, YCbCr);	
+  annotate_loop(Parallel());
+  for (dint s = first_segment; s < end_segment; s = s + 1) {
+    dint last_Y = 0;
+    dint last_Cb = 0;
+    dint last_Cr = 0;
+    // per segment, so each thread has its own
+    auto YCbCr = Block<int,3>::stack<3,8*Vs,8*Hs>();
+    auto coeffs = Hs * Vs > 1 ? Block<int,3>::stack<Hs*Vs+2,8,8>() : YCbCr;
+    // color converted a row of MCUs at a time, rather than per MCU
+    auto band = Block<int,3>::arena({3, 8*Vs, mcus_per_row*(8*Hs)}, ArenaInit::Overwritten);
+    dint first = s * restart_interval;
+    dint last = first + restart_interval;
+    if (first < first_mcu) {
+      first = first_mcu;
+      last_Y = dc_in[0];
+      last_Cb = dc_in[1];
+      last_Cr = dc_in[2];
+    }
+    if (last > last_mcu)
+      last = last_mcu;
+    for (dint m = first; m < last; m = m + 1) {
+      // relative to input
+      dint mr = (m - first_mcu) / mcus_per_row;
+      dint mc = (m - first_mcu) % mcus_per_row;
+      if (m == first || mc == 0) {
+	// up to the end of the row or the segment, whichever is first
+	dint mc_last = last - first_mcu - mr * mcus_per_row;
+	if (mc_last > mcus_per_row)
+	  mc_last = mcus_per_row;
+	color_band<Hs,Vs>(RGB, band, mr * (8*Vs), mc, mc_last, H, W);
       }
-      // offset
-      YCbCr[i][j][k] = YCbCr[i][j][k] - 128;
-      auto Y = YCbCr.slice(range(0,1,1),range(0,8,1),range(0,8,1));
-      auto Cb = YCbCr.slice(range(1,2,1),range(0,8,1),range(0,8,1));
-      auto Cr = YCbCr.slice(range(2,3,1),range(0,8,1),range(0,8,1));
-      dct(Y);      
-      dct(Cb);
-      dct(Cr);
-      quant(Y, luma_quant);
-      quant(Cb, chroma_quant);
-      quant(Cr, chroma_quant);
-      // get the base lidx for each
-//      huffman_encode_block(Y.allocator->stack<3*8*8>(), 0, last_Y, bits, zigzag, luma_codes);
-//      huffman_encode_block(Cb.allocator->stack<3*8*8>(), 1, last_Cb, bits, zigzag, chroma_codes);
-//      huffman_encode_block(Cr.allocator->stack<3*8*8>(), 2, last_Cr, bits, zigzag, chroma_codes);      
-
-      huffman_encode_block_proxy(Y.allocator->heap(), 0, last_Y, bits, zigzag, luma_codes);
-      huffman_encode_block_proxy(Cb.allocator->heap(), 1, last_Cb, bits, zigzag, chroma_codes);
-      huffman_encode_block_proxy(Cr.allocator->heap(), 2, last_Cr, bits, zigzag, chroma_codes);
-      last_Y = Y(0,0,0);
-      last_Cb = Cb(0,0,0);
-      last_Cr = Cr(0,0,0);
+      encode_mcu<Hs,Vs>(band, mc * (8*Hs), YCbCr, coeffs, luma_quant, chroma_quant, zigzag,
+			luma_codes, chroma_codes, segment_bits[s % nslots], last_Y, last_Cb, last_Cr);
+    }
+    if ((s + 1) * restart_interval > last_mcu) {
+      dc_out[0] = last_Y;
+      dc_out[1] = last_Cb;
+      dc_out[2] = last_Cr;
     }
   }
 }
 
+// The StageCache version of the kernels below. Bump it whenever they, or anything they call
+// (including in shim), change.
+static const std::string kernel_version = "1";
+
 int main(int argc, char **argv) {
   if (argc != 2) {
     cerr << "Usage: ./sjpeg <output_fn>" << endl;
@@ -345,5 +426,8 @@ int main(int argc, char **argv) {
   std::stringstream ss;
   ss << "#include \"huffman.h\"" << endl;
   ss << "#include \"bits.h\"" << endl;
-  stage(jpeg_staged, "jpeg", argv[1], ss.str(), ss.str());
+  stage_all(argv[1], ss.str(), ss.str(),
+	    Staged{jpeg_staged<1,1>, "jpeg", kernel_version},
+	    Staged{jpeg_staged<2,1>, "jpeg422", kernel_version},
+	    Staged{jpeg_staged<2,2>, "jpeg420", kernel_version});
 }
@@ -0,0 +1,328 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "blocks/c_code_generator.h"
+#include "blocks/rce.h"
+#include "staged/staged.h"
+#include "staged/bitstream.h"
+#include "huffman_decode.h"
+
+using namespace std;
+using namespace shim;
+using builder::dyn_var;
+using builder::static_var;
+
+using dint = dyn_var<int>;
+using sint = static_var<int>;
+
+Iter<'i'> i;
+Iter<'j'> j;
+Iter<'k'> k;
+
+#define descale(x,n) ((x + ((1 << (n-1)))) >> n)
+
+// Decode the next Huffman symbol with the table starting at base in tables.
+// base is fixed during staging, so every table access is to a constant offset.
+dint decode_symbol(Bitstream &bs, dyn_var<int*> &tables, int base) {
+  dint sym = 0;
+  dint look = bs.peek<int>(HUFF_LOOKAHEAD);
+  dint entry = tables[base + HUFF_LOOK + look];
+  if (entry != 0) {
+    bs.skip(entry >> 8);
+    sym = entry & 0xFF;
+  } else {
+    // longer than the lookahead, so check one length at a time
+    dint len = HUFF_LOOKAHEAD + 1;
+    dint code = bs.peek<int>(len);
+    while (code > tables[base + HUFF_MAXCODE + len]) {
+      len = len + 1;
+      code = bs.peek<int>(len);
+    }
+    // the sentinel at 17 stops corrupt codes
+    if (len < 17) {
+      bs.skip(len);
+      sym = tables[base + HUFF_VALS + code + tables[base + HUFF_VALOFFSET + len]];
+    }
+  }
+  return sym;
+}
+
+// Read the size bits that follow a symbol and sign extend them (F.2.2.1)
+dint receive_extend(Bitstream &bs, dint size) {
+  dint v = 0;
+  if (size > 0) {
+    v = bs.pop<int>(size);
+    dint half = 1;
+    half = half << (size - 1);
+    if (v < half)
+      v = v - (half << 1) + 1;
+  }
+  return v;
+}
+
+// Decode and dequantize the next block of coefficients into obj, which should be 0s
+void decode_block(Bitstream &bs, View<int,3> obj, View<int,3> quant, dint &pred,
+		  dyn_var<int*> &tables, int dc_base, int ac_base, dyn_var<int*> &zigzag) {
+  // DC
+  dint size = decode_symbol(bs, tables, dc_base);
+  pred = pred + receive_extend(bs, size);
+  obj[0][0][0] = pred * quant(0,0,0);
+  // AC, where each symbol is a run of 0s (upper nibble) and the size of the next coefficient
+  dint e = 1;
+  while (e < 64) {
+    dint rs = decode_symbol(bs, tables, ac_base);
+    dint run = rs >> 4;
+    size = rs & 15;
+    if (size == 0) {
+      if (run == 15) {
+	// ZRL
+	e = e + 16;
+      } else {
+	// EOB
+	e = 64;
+      }
+    } else {
+      e = e + run;
+      // only overruns with corrupt data
+      if (e < 64) {
+	dint zz = zigzag[e];
+	dint r = zz >> 3;
+	dint c = zz & 7;
+	obj[0][r][c] = receive_extend(bs, size) * quant(0,r,c);
+      }
+      e = e + 1;
+    }
+  }
+}
+
+// The inverse of dct in sjpeg.cpp (the islow IDCT from the IJG code).
+// Columns then rows, and leaves the level shifted samples in obj.
+void idct(View<int,3> obj) {
+  sint FIX_0_298631336 = 2446;
+  sint FIX_0_390180644 = 3196;
+  sint FIX_0_541196100 = 4433;
+  sint FIX_0_765366865 = 6270;
+  sint FIX_0_899976223 = 7373;
+  sint FIX_1_175875602 = 9633;
+  sint FIX_1_501321110 = 12299;
+  sint FIX_1_847759065 = 15137;
+  sint FIX_1_961570560 = 16069;
+  sint FIX_2_053119869 = 16819;
+  sint FIX_2_562915447 = 20995;
+  sint FIX_3_072711026 = 25172;
+
+  for (dint c = 0; c < 8; c=c+1) {
+    auto col = obj.slice(range(0,1,1), range(0,8,1), range(c,c+1,1));
+    // most columns only have a DC term after quantization
+    if (col(1,0) == 0 && col(2,0) == 0 && col(3,0) == 0 && col(4,0) == 0 &&
+	col(5,0) == 0 && col(6,0) == 0 && col(7,0) == 0) {
+      dint dc = col(0,0) << 2;
+      col[i][0] = dc;
+    } else {
+      dint z2 = col(2,0);
+      dint z3 = col(6,0);
+      dint z1 = (z2 + z3) * FIX_0_541196100;
+      dint tmp2 = z1 + z3 * -FIX_1_847759065;
+      dint tmp3 = z1 + z2 * FIX_0_765366865;
+      z2 = col(0,0);
+      z3 = col(4,0);
+      dint tmp0 = (z2 + z3) << 13;
+      dint tmp1 = (z2 - z3) << 13;
+      dint tmp10 = tmp0 + tmp3;
+      dint tmp13 = tmp0 - tmp3;
+      dint tmp11 = tmp1 + tmp2;
+      dint tmp12 = tmp1 - tmp2;
+      tmp0 = col(7,0);
+      tmp1 = col(5,0);
+      tmp2 = col(3,0);
+      tmp3 = col(1,0);
+      z1 = tmp0 + tmp3;
+      z2 = tmp1 + tmp2;
+      z3 = tmp0 + tmp2;
+      dint z4 = tmp1 + tmp3;
+      dint z5 = (z3 + z4) * FIX_1_175875602;
+      tmp0 = tmp0 * FIX_0_298631336;
+      tmp1 = tmp1 * FIX_2_053119869;
+      tmp2 = tmp2 * FIX_3_072711026;
+      tmp3 = tmp3 * FIX_1_501321110;
+      z1 = z1 * -FIX_0_899976223;
+      z2 = z2 * -FIX_2_562915447;
+      z3 = z3 * -FIX_1_961570560;
+      z4 = z4 * -FIX_0_390180644;
+      z3 = z3 + z5;
+      z4 = z4 + z5;
+      tmp0 = tmp0 + z1 + z3;
+      tmp1 = tmp1 + z2 + z4;
+      tmp2 = tmp2 + z2 + z3;
+      tmp3 = tmp3 + z1 + z4;
+      col[0][0] = descale(tmp10 + tmp3, 11);
+      col[7][0] = descale(tmp10 - tmp3, 11);
+      col[1][0] = descale(tmp11 + tmp2, 11);
+      col[6][0] = descale(tmp11 - tmp2, 11);
+      col[2][0] = descale(tmp12 + tmp1, 11);
+      col[5][0] = descale(tmp12 - tmp1, 11);
+      col[3][0] = descale(tmp13 + tmp0, 11);
+      col[4][0] = descale(tmp13 - tmp0, 11);
+    }
+  }
+  for (dint r = 0; r < 8; r=r+1) {
+    auto row = obj.slice(range(0,1,1),range(r,r+1,1),range(0,8,1));
+    dint z2 = row(2);
+    dint z3 = row(6);
+    dint z1 = (z2 + z3) * FIX_0_541196100;
+    dint tmp2 = z1 + z3 * -FIX_1_847759065;
+    dint tmp3 = z1 + z2 * FIX_0_765366865;
+    z2 = row(0);
+    z3 = row(4);
+    dint tmp0 = (z2 + z3) << 13;
+    dint tmp1 = (z2 - z3) << 13;
+    dint tmp10 = tmp0 + tmp3;
+    dint tmp13 = tmp0 - tmp3;
+    dint tmp11 = tmp1 + tmp2;
+    dint tmp12 = tmp1 - tmp2;
+    tmp0 = row(7);
+    tmp1 = row(5);
+    tmp2 = row(3);
+    tmp3 = row(1);
+    z1 = tmp0 + tmp3;
+    z2 = tmp1 + tmp2;
+    z3 = tmp0 + tmp2;
+    dint z4 = tmp1 + tmp3;
+    dint z5 = (z3 + z4) * FIX_1_175875602;
+    tmp0 = tmp0 * FIX_0_298631336;
+    tmp1 = tmp1 * FIX_2_053119869;
+    tmp2 = tmp2 * FIX_3_072711026;
+    tmp3 = tmp3 * FIX_1_501321110;
+    z1 = z1 * -FIX_0_899976223;
+    z2 = z2 * -FIX_2_562915447;
+    z3 = z3 * -FIX_1_961570560;
+    z4 = z4 * -FIX_0_390180644;
+    z3 = z3 + z5;
+    z4 = z4 + z5;
+    tmp0 = tmp0 + z1 + z3;
+    tmp1 = tmp1 + z2 + z4;
+    tmp2 = tmp2 + z2 + z3;
+    tmp3 = tmp3 + z1 + z4;
+    row[0] = descale(tmp10 + tmp3, 18);
+    row[7] = descale(tmp10 - tmp3, 18);
+    row[1] = descale(tmp11 + tmp2, 18);
+    row[6] = descale(tmp11 - tmp2, 18);
+    row[2] = descale(tmp12 + tmp1, 18);
+    row[5] = descale(tmp12 - tmp1, 18);
+    row[3] = descale(tmp13 + tmp0, 18);
+    row[4] = descale(tmp13 - tmp0, 18);
+  }
+}
+
+dint clamp_sample(dint x) {
+  dint clamped = hmax(0, hmin(255, x));
+  return clamped;
+}
+
+// Write the MCU to RGB, where its top left pixel is at (r,c). coeffs holds the Hs*Vs luma
+// blocks and then the Cb and Cr blocks, all as level shifted samples.
+// Uses the fixed point conversion from the IJG code.
+template <int Hs, int Vs>
+void color_mcu(Block<int,3> &coeffs, Block<uint8_t,3> &RGB, dint r, dint c,
+	       dyn_var<int> H, dyn_var<int> W) {
+  constexpr int nY = Hs * Vs;
+  // Chroma is coarser by Vs x Hs. Viewed at the resolution of the MCU, every pixel
+  // reads the sample that covers it.
+  auto chroma = coeffs.slice(range(nY,nY+2,1),range(0,8,1),range(0,8,1));
+  auto chroma_fine = chroma.virtually_refine(1,Vs,Hs);
+  // edge MCUs hang off the image
+  dint rows = hmin(8*Vs, H - r);
+  dint cols = hmin(8*Hs, W - c);
+  for (dint y = 0; y < rows; y = y + 1) {
+    for (dint x = 0; x < cols; x = x + 1) {
+      dint Y = 0;
+      if constexpr (nY == 1) {
+	Y = clamp_sample(coeffs(0,y,x) + 128);
+      } else {
+	Y = clamp_sample(coeffs((y >> 3) * Hs + (x >> 3), y & 7, x & 7) + 128);
+      }
+      dint Cb = clamp_sample(chroma_fine(0,y,x) + 128) - 128;
+      dint Cr = clamp_sample(chroma_fine(1,y,x) + 128) - 128;
+      RGB[r+y][c+x][0] = clamp_sample(Y + ((91881 * Cr + 32768) >> 16));
+      RGB[r+y][c+x][1] = clamp_sample(Y + ((-22554 * Cb - 46802 * Cr + 32768) >> 16));
+      RGB[r+y][c+x][2] = clamp_sample(Y + ((116130 * Cb + 32768) >> 16));
+    }
+  }
+}
+
+// The scan is split into segments of restart_interval MCUs (in raster order), which start
+// at byte segments[s] of scan. The caller takes out the RSTn markers and stuffed bytes.
+// Segments are independent (each has its own scratch Blocks and its DC predictions start at 0),
+// so they're decoded in parallel. For a single serial stream, use restart_interval = number of MCUs.
+// quant_arr holds each component's table in natural order and tables holds each component's
+// DC then AC decoding table.
+// Hs and Vs are the luma sampling factors (chroma is always 1x1), so <1,1> is 4:4:4,
+// <2,1> is 4:2:2, and <2,2> is 4:2:0.
+template <int Hs, int Vs>
+void jpegd_staged(dyn_var<uint8_t*> scan, dyn_var<int*> segments,
+		  dyn_var<int> H, dyn_var<int> W,
+		  dyn_var<int*> quant_arr,
+		  dyn_var<int*> tables,
+		  dyn_var<int*> zigzag,
+		  dyn_var<int> restart_interval,
+		  dyn_var<uint8_t*> output) {
+
+  constexpr int nY = Hs * Vs;
+  auto quant = Block<int,3>::user({3,8,8}, quant_arr);
+  auto RGB = Block<uint8_t,3>::user({H, W, 3}, output);
+  dint mcus_per_row = (W + 8*Hs - 1) / (8*Hs);
+  dint nmcus = mcus_per_row * ((H + 8*Vs - 1) / (8*Vs));
+  dint nsegments = (nmcus + restart_interval - 1) / restart_interval;
+
+  annotate_loop(Parallel());
+  for (dint s = 0; s < nsegments; s = s + 1) {
+    Bitstream bs(scan + segments[s], (segments[s+1] - segments[s]) * 8);
+    dint pred_Y = 0;
+    dint pred_Cb = 0;
+    dint pred_Cr = 0;
+    // per segment, so each thread has its own
+    auto coeffs = Block<int,3>::stack<nY+2,8,8>();
+    dint first = s * restart_interval;
+    dint last = first + restart_interval;
+    if (last > nmcus)
+      last = nmcus;
+    for (dint m = first; m < last; m = m + 1) {
+      dint r = (m / mcus_per_row) * (8*Vs);
+      dint c = (m % mcus_per_row) * (8*Hs);
+      coeffs[i][j][k] = 0;
+      for (sint b = 0; b < nY; b = b + 1) {
+	decode_block(bs, coeffs.slice(range(b,b+1,1),range(0,8,1),range(0,8,1)),
+		     quant.slice(range(0,1,1),range(0,8,1),range(0,8,1)), pred_Y,
+		     tables, 0, HUFF_TABLE_INTS, zigzag);
+      }
+      decode_block(bs, coeffs.slice(range(nY,nY+1,1),range(0,8,1),range(0,8,1)),
+		   quant.slice(range(1,2,1),range(0,8,1),range(0,8,1)), pred_Cb,
+		   tables, 2 * HUFF_TABLE_INTS, 3 * HUFF_TABLE_INTS, zigzag);
+      decode_block(bs, coeffs.slice(range(nY+1,nY+2,1),range(0,8,1),range(0,8,1)),
+		   quant.slice(range(2,3,1),range(0,8,1),range(0,8,1)), pred_Cr,
+		   tables, 4 * HUFF_TABLE_INTS, 5 * HUFF_TABLE_INTS, zigzag);
+      for (sint b = 0; b < nY + 2; b = b + 1) {
+	idct(coeffs.slice(range(b,b+1,1),range(0,8,1),range(0,8,1)));
+      }
+      color_mcu<Hs,Vs>(coeffs, RGB, r, c, H, W);
+    }
+  }
+}
+
+// The StageCache version of the kernels below. Bump it whenever they, or anything they call
+// (including in shim), change.
+static const std::string kernel_version = "1";
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    cerr << "Usage: ./sjpegd <output_fn>" << endl;
+    exit(-1);
+  }
+  stage_all(argv[1], "", "",
+	    Staged{jpegd_staged<1,1>, "jpegd", kernel_version},
+	    Staged{jpegd_staged<2,1>, "jpegd422", kernel_version},
+	    Staged{jpegd_staged<2,2>, "jpegd420", kernel_version});
+}
@@ -1,3 +1,6 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 #include "syntax.h"
 
 constexpr int SOF0 = 0xFFC0;
@@ -85,12 +88,10 @@ void syntax_JFIF(Bits &bits) {
   bits.pack(0x00, 8);
 }
 
-void syntax_frame_header(Bits &bits, int H, int W) {
+void syntax_frame_header(Bits &bits, int H, int W, int Hs, int Vs) {
   bits.pack(SOF0, 16);
   int Nf = 3;
   int Lf = 8 + 3 * Nf;
-  int Hs = 1;
-  int Vs = 1;
   bits.pack(Lf, 16);
   bits.pack(8, 8);
   bits.pack(H, 16);
@@ -101,12 +102,12 @@ void syntax_frame_header(Bits &bits, int H, int W) {
   bits.pack(Vs, 4);
   bits.pack(0, 8);
   bits.pack(2, 8);
-  bits.pack(Hs, 4);
-  bits.pack(Vs, 4);
+  bits.pack(1, 4);
+  bits.pack(1, 4);
   bits.pack(1, 8);
   bits.pack(3, 8);
-  bits.pack(Hs, 4);
-  bits.pack(Vs, 4);
+  bits.pack(1, 4);
+  bits.pack(1, 4);
   bits.pack(1, 8);
 }
 
@@ -131,6 +132,17 @@ void syntax_scan_header(Bits &bits) {
   bits.pack(0, 4);
 }
 
+void syntax_restart_interval(Bits &bits, int restart_interval) {
+  bits.pack(DRI, 16);
+  bits.pack(4, 16);
+  bits.pack(restart_interval, 16);
+}
+
+// the marker between the nth and n+1th restart intervals
+void syntax_restart_marker(Bits &bits, int n) {
+  bits.pack(RST0 + (n % 8), 16);
+}
+
 void syntax_quant_table(Bits &bits, int *quant, 
 			int *zigzag, bool is_luma) {
   int Lq = 67;
@@ -161,3 +173,220 @@ void syntax_huffman_table(Bits &bits, int *huffbits, int huffbits_len, int *huff
     bits.pack(huffvals[i], 8);
   }  
 }
+
+// DQT stores the coefficients in zigzag order. This is the natural position of each.
+static const int dezigzag[] = {
+  0,  1,  8, 16, 9, 2, 3, 10, 
+  17, 24, 32, 25, 18, 11, 4,
+  5,  12, 19, 26, 33, 40, 48, 
+  41, 34, 27, 20, 13, 6,  7, 
+  14, 21, 28, 35, 42, 49, 56, 
+  57, 50, 43, 36, 29, 22, 15, 
+  23, 30, 37, 44, 51, 58, 59, 
+  52, 45, 38, 31, 39, 46, 53, 
+  60, 61, 54, 47, 55, 62, 63
+};
+
+static void parse_error(const char *msg) {
+  cerr << "Cannot decode JPEG: " << msg << endl;
+  exit(-1);
+}
+
+static int parse_u8(const uint8_t *data, size_t len, size_t &pos) {
+  if (pos >= len)
+    parse_error("unexpected end of file");
+  return data[pos++];
+}
+
+static int parse_u16(const uint8_t *data, size_t len, size_t &pos) {
+  int hi = parse_u8(data, len, pos);
+  return (hi << 8) | parse_u8(data, len, pos);
+}
+
+// Copy out the entropy-coded data following an SOS, up to the first marker that isn't RSTn.
+// Leaves pos at that marker.
+static void parse_scan(const uint8_t *data, size_t len, size_t &pos, JpegFrame &frame) {
+  frame.scan.reserve(len - pos);
+  frame.segments.push_back(0);
+  while (true) {
+    int b = parse_u8(data, len, pos);
+    if (b != 0xFF) {
+      frame.scan.push_back(b);
+      continue;
+    }
+    size_t marker_pos = pos - 1;
+    int next = parse_u8(data, len, pos);
+    // fill bytes
+    while (next == 0xFF) {
+      marker_pos = pos - 1;
+      next = parse_u8(data, len, pos);
+    }
+    if (next == 0) {
+      frame.scan.push_back(0xFF);
+    } else if ((next | 0xFF00) >= RST0 && (next | 0xFF00) <= RST7) {
+      frame.segments.push_back(frame.scan.size());
+    } else {
+      pos = marker_pos;
+      break;
+    }
+  }
+  frame.segments.push_back(frame.scan.size());
+}
+
+void parse_jpeg(const uint8_t *data, size_t len, JpegFrame &frame) {
+  size_t pos = 0;
+  if (parse_u16(data, len, pos) != SOI)
+    parse_error("missing SOI");
+  // the tables, by destination. The scan picks which ones each component uses.
+  int quant[4][64];
+  bool have_quant[4] = {false, false, false, false};
+  int huffbits[2][4][17];
+  int huffvals[2][4][256];
+  bool have_huff[2][4] = {{false, false, false, false}, {false, false, false, false}};
+  int quant_sel[3];
+  // the component identifiers, in frame order
+  int component_ids[3];
+  bool have_frame = false;
+  bool have_scan = false;
+  while (true) {
+    if (parse_u8(data, len, pos) != 0xFF)
+      parse_error("expected a marker");
+    int marker = parse_u8(data, len, pos);
+    while (marker == 0xFF)
+      marker = parse_u8(data, len, pos);
+    marker |= 0xFF00;
+    if (marker == EOI)
+      break;
+    if (marker == SOI || (marker >= RST0 && marker <= RST7))
+      parse_error("unexpected marker");
+    int Lx = parse_u16(data, len, pos);
+    size_t end = pos + Lx - 2;
+    if (Lx < 2 || end > len)
+      parse_error("bad marker segment length");
+    switch (marker) {
+    case DQT:
+      while (pos < end) {
+	int Pq_Tq = parse_u8(data, len, pos);
+	int Tq = Pq_Tq & 0xF;
+	if ((Pq_Tq >> 4) != 0)
+	  parse_error("only 8-bit quantization tables are supported");
+	if (Tq > 3)
+	  parse_error("bad quantization table destination");
+	for (int k = 0; k < 64; k++) {
+	  quant[Tq][dezigzag[k]] = parse_u8(data, len, pos);
+	}
+	have_quant[Tq] = true;
+      }
+      break;
+    case DHT:
+      while (pos < end) {
+	int Tc_Th = parse_u8(data, len, pos);
+	int Tc = Tc_Th >> 4;
+	int Th = Tc_Th & 0xF;
+	if (Tc > 1 || Th > 3)
+	  parse_error("bad Huffman table destination");
+	int total = 0;
+	huffbits[Tc][Th][0] = 0;
+	for (int l = 1; l < 17; l++) {
+	  huffbits[Tc][Th][l] = parse_u8(data, len, pos);
+	  total += huffbits[Tc][Th][l];
+	}
+	if (total > 256)
+	  parse_error("too many Huffman codes");
+	for (int p = 0; p < total; p++) {
+	  huffvals[Tc][Th][p] = parse_u8(data, len, pos);
+	}
+	have_huff[Tc][Th] = true;
+      }
+      break;
+    case SOF0:
+    case SOF1: {
+      if (have_frame)
+	parse_error("multiple frames");
+      if (parse_u8(data, len, pos) != 8)
+	parse_error("only 8-bit samples are supported");
+      frame.H = parse_u16(data, len, pos);
+      frame.W = parse_u16(data, len, pos);
+      if (frame.H == 0 || frame.W == 0)
+	parse_error("DNL and empty images are not supported");
+      if (parse_u8(data, len, pos) != 3)
+	parse_error("only YCbCr images are supported");
+      for (int c = 0; c < 3; c++) {
+	component_ids[c] = parse_u8(data, len, pos);
+	for (int d = 0; d < c; d++) {
+	  if (component_ids[d] == component_ids[c])
+	    parse_error("duplicate component identifier");
+	}
+	int Hi_Vi = parse_u8(data, len, pos);
+	if (c == 0) {
+	  frame.Hs = Hi_Vi >> 4;
+	  frame.Vs = Hi_Vi & 0xF;
+	  if (Hi_Vi != 0x11 && Hi_Vi != 0x21 && Hi_Vi != 0x22)
+	    parse_error("only 4:4:4, 4:2:2, and 4:2:0 are supported");
+	} else if (Hi_Vi != 0x11) {
+	  parse_error("only 4:4:4, 4:2:2, and 4:2:0 are supported");
+	}
+	quant_sel[c] = parse_u8(data, len, pos);
+	if (quant_sel[c] > 3)
+	  parse_error("bad quantization table selector");
+      }
+      have_frame = true;
+      break;
+    }
+    case SOF2:
+    case SOF3:
+    case SOF5:
+    case SOF6:
+    case SOF7:
+    case SOF9:
+    case SOF10:
+    case SOF11:
+    case SOF13:
+    case SOF14:
+    case SOF15:
+      parse_error("only baseline JPEGs are supported");
+      break;
+    case DRI:
+      frame.restart_interval = parse_u16(data, len, pos);
+      break;
+    case SOS: {
+      if (!have_frame)
+	parse_error("SOS before SOF");
+      if (have_scan)
+	parse_error("only a single scan is supported");
+      if (parse_u8(data, len, pos) != 3)
+	parse_error("only scans of all three components are supported");
+      for (int c = 0; c < 3; c++) {
+	// an interleaved scan must list the components in frame order (B.2.3)
+	if (parse_u8(data, len, pos) != component_ids[c])
+	  parse_error("scan components are not in frame order");
+	int Td_Ta = parse_u8(data, len, pos);
+	int Td = Td_Ta >> 4;
+	int Ta = Td_Ta & 0xF;
+	if (Td > 3 || Ta > 3 || !have_huff[0][Td] || !have_huff[1][Ta])
+	  parse_error("missing Huffman table");
+	build_decode_table(huffbits[0][Td], huffvals[0][Td], frame.huff[c][0]);
+	build_decode_table(huffbits[1][Ta], huffvals[1][Ta], frame.huff[c][1]);
+	if (!have_quant[quant_sel[c]])
+	  parse_error("missing quantization table");
+	memcpy(frame.quant[c], quant[quant_sel[c]], sizeof(int) * 64);
+      }
+      int Ss = parse_u8(data, len, pos);
+      int Se = parse_u8(data, len, pos);
+      int Ah_Al = parse_u8(data, len, pos);
+      if (Ss != 0 || Se != 63 || Ah_Al != 0)
+	parse_error("only sequential scans are supported");
+      have_scan = true;
+      break;
+    }
+    default:
+      // APPn, COM, and anything else the decoder doesn't need
+      break;
+    }
+    pos = end;
+    if (marker == SOS)
+      parse_scan(data, len, pos, frame);
+  }
+  if (!have_scan)
+    parse_error("missing scan");
+}
@@ -1,17 +1,46 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
 #include "bits.h"
+#include "huffman_decode.h"
 
 using namespace std;
 
 void syntax_SOI(Bits &bits);
 void syntax_EOI(Bits &bits);
 void syntax_JFIF(Bits &bits);
-void syntax_frame_header(Bits &bits, int H, int W);
+// Hs and Vs are the luma sampling factors. Chroma is always 1x1.
+void syntax_frame_header(Bits &bits, int H, int W, int Hs=1, int Vs=1);
 void syntax_scan_header(Bits &bits);
+void syntax_restart_interval(Bits &bits, int restart_interval);
+void syntax_restart_marker(Bits &bits, int n);
 void syntax_quant_table(Bits &bits, int *quant, 
 			int *zigzag, bool is_luma);
 void syntax_huffman_table(Bits &bits, int *huffbits, int huffbits_len, 
 			  int *huffvals, int huffvals_len,
 			  bool is_dc, int ident);
 
+
+// What the decoder needs from the markers of a baseline JPEG (see parse_jpeg)
+struct JpegFrame {
+  int H = 0;
+  int W = 0;
+  // the luma sampling factors. Chroma is always 1x1.
+  int Hs = 1;
+  int Vs = 1;
+  // in MCUs, 0 if there are no restart markers
+  int restart_interval = 0;
+  // per component, in natural order
+  int quant[3][64];
+  // per component, the DC table then the AC table (see build_decode_table)
+  int huff[3][2][HUFF_TABLE_INTS];
+  // the entropy-coded data, with the stuffed 0s and the RSTn markers taken out
+  vector<uint8_t> scan;
+  // the byte offset within scan of each restart segment, followed by scan.size()
+  vector<int> segments;
+};
+
+// Parse a baseline JPEG with a single interleaved YCbCr scan, in 4:4:4, 4:2:2, or 4:2:0.
+// Exits on anything else.
+void parse_jpeg(const uint8_t *data, size_t len, JpegFrame &frame);
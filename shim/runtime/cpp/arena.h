@@ -0,0 +1,150 @@
+// -*-c++-*-
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "common/loop_type.h"
+
+namespace shim {
+
+///
+/// A bump allocator for short-lived buffers, i.e. per-macroblock or per-MCU scratch.
+/// Memory comes from a list of chunks that are kept around once allocated, so after the
+/// first few uses, allocating is just an add. Buffers are freed in LIFO order by resetting
+/// to a mark (see ArenaScope).
+/// Each thread has its own arena (see thread_arena), so there's no locking.
+struct Arena {
+
+  ///
+  /// The smallest chunk to allocate. Bigger requests get a chunk of their own size.
+  static constexpr size_t min_chunk = 1 << 20;
+
+  struct Mark {
+    size_t chunk;
+    size_t offset;
+  };
+
+  Arena() = default;
+  Arena(const Arena&) = delete;
+  Arena &operator=(const Arena&) = delete;
+
+  ~Arena() {
+    for (auto &chunk : chunks) {
+      std::free(chunk.data);
+    }
+  }
+
+  ///
+  /// Allocate bytes aligned to align, which must be a power of 2
+  void *alloc(size_t bytes, size_t align) {
+    while (cur < chunks.size()) {
+      Chunk &chunk = chunks[cur];
+      uintptr_t base = (uintptr_t)chunk.data;
+      size_t start = ((base + offset + align - 1) & ~(uintptr_t)(align - 1)) - base;
+      if (start + bytes <= chunk.size) {
+	offset = start + bytes;
+	return chunk.data + start;
+      }
+      // the next chunk is only reused if this request fits in it
+      if (cur + 1 < chunks.size() && bytes + align <= chunks[cur + 1].size) {
+	cur++;
+	offset = 0;
+      } else {
+	break;
+      }
+    }
+    size_t size = bytes + align > min_chunk ? bytes + align : min_chunk;
+    char *data = (char*)std::malloc(size);
+    if (!data) {
+      std::cerr << "Arena cannot allocate " << size << " bytes" << std::endl;
+      exit(-1);
+    }
+    // anything past the current chunk is unused, so replace it rather than growing the list
+    size_t at = chunks.empty() ? 0 : cur + 1;
+    if (at < chunks.size()) {
+      std::free(chunks[at].data);
+      chunks[at] = Chunk{data, size};
+    } else {
+      chunks.push_back(Chunk{data, size});
+    }
+    cur = at;
+    offset = 0;
+    return alloc(bytes, align);
+  }
+
+  Mark mark() const { return Mark{cur, offset}; }
+
+  ///
+  /// Free everything allocated since m
+  void reset(Mark m) {
+    cur = m.chunk;
+    offset = m.offset;
+  }
+
+private:
+
+  struct Chunk {
+    char *data;
+    size_t size;
+  };
+
+  std::vector<Chunk> chunks;
+  size_t cur = 0;
+  size_t offset = 0;
+
+};
+
+///
+/// The arena of the calling thread
+inline Arena &thread_arena() {
+  thread_local Arena arena;
+  return arena;
+}
+
+///
+/// Frees everything allocated from the calling thread's arena during its lifetime.
+/// Generated code declares one of these right before each arena buffer, so the buffer is
+/// freed when the variable holding it goes out of scope.
+struct ArenaScope {
+
+  ArenaScope() : arena(thread_arena()), start(arena.mark()) { }
+  ArenaScope(const ArenaScope&) = delete;
+  ArenaScope &operator=(const ArenaScope&) = delete;
+
+  ~ArenaScope() { arena.reset(start); }
+
+  Arena &arena;
+  Arena::Mark start;
+
+};
+
+///
+/// Where the calling thread's arena is up to, as one number that grows as it allocates and
+/// goes back down when a scope frees. For checking that scopes free what they allocate.
+inline uint64_t arena_position() {
+  Arena::Mark m = thread_arena().mark();
+  return ((uint64_t)m.chunk << 32) | m.offset;
+}
+
+inline ArenaScope arena_scope() {
+  return ArenaScope();
+}
+
+///
+/// Allocate sz Elems from the calling thread's arena, zeroing them if zero is set
+template <typename Elem>
+Elem *arena_alloc(loop_type sz, loop_type align, bool zero) {
+  size_t bytes = sizeof(Elem) * sz;
+  Elem *data = (Elem*)thread_arena().alloc(bytes, align < (loop_type)alignof(Elem) ? alignof(Elem) : align);
+  if (zero) {
+    memset(data, 0, bytes);
+  }
+  return data;
+}
+
+}
@@ -28,6 +28,8 @@ struct BaseHeapArray : public RefCounted {
   }
 
   Elem *data;
+  // false if the user made data, so they must delete it
+  bool owns_data = true;
 };
 
 template <typename Elem>
@@ -41,32 +43,41 @@ struct HeapArray {
 
   HeapArray(Elem *data) : base(new BaseHeapArray<Elem>()) {
     base->data = data;
+    base->owns_data = false;
     base->incr(); 
-    base->incr(); // increment twice so that it is never actually deleted by us. The user made it, so they must delete it.
   }
 
   ~HeapArray() {
-    base->decr();
-    if (base->can_free()) {
-      delete[] base->data;
-      delete base;
-      base = nullptr;
-    }
+    release();
   }
 
   // Copy constructor
   HeapArray(const HeapArray<Elem> &other) : base(other.base) { base->incr(); }
 
-  // Copy assignment
+  // Copy assignment. Take the new reference before dropping the old one, in case
+  // they're the same array.
   HeapArray<Elem> &operator=(const HeapArray<Elem> &other) {
     if (this == &other) {
       return *this;
     }
+    other.base->incr();
+    release();
     base = other.base;
     return *this;
   }
 
-  // Move constructors don't update the reference count, so don't need to manually specify them
+  // Moves hand over the reference, so they don't touch the count
+  HeapArray(HeapArray<Elem> &&other) noexcept : base(other.base) { other.base = nullptr; }
+
+  HeapArray<Elem> &operator=(HeapArray<Elem> &&other) noexcept {
+    if (this == &other) {
+      return *this;
+    }
+    release();
+    base = other.base;
+    other.base = nullptr;
+    return *this;
+  }
 
   Elem &operator[](loop_type lidx) const {
     return base->operator[](lidx);
@@ -78,6 +89,19 @@ struct HeapArray {
   
   BaseHeapArray<Elem> *base;
 
+private:
+
+  // Drop this reference, freeing the array if it was the last one (and we made it)
+  void release() {
+    if (base && base->decr() == 0) {
+      if (base->owns_data) {
+        delete[] base->data;
+      }
+      delete base;
+    }
+    base = nullptr;
+  }
+
 };
 
 }
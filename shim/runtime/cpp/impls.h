@@ -22,12 +22,17 @@ HeapArray<Elem> build_heaparr(loop_type sz) {
 
 template <typename Elem>
 void hmemset(Elem *data, Elem val, loop_type sz) {
-  memset(data, val, sz);
+  memset(data, val, sizeof(Elem) * sz);
 }
 
 template <typename Elem>
 void hmemset(HeapArray<Elem> &data, Elem val, loop_type sz) {
-  memset(data.base->data, val, sz);
+  memset(data.base->data, val, sizeof(Elem) * sz);
+}
+
+template <typename Elem>
+Elem *hdata(const HeapArray<Elem> &data) {
+  return data.base->data;
 }
 
 /*template <bool dummy=false>
@@ -2,19 +2,29 @@
 
 #pragma once
 
+#include <atomic>
+
+///
+/// An intrusive reference count.
+/// Generated code can share objects across the threads of a parallel loop, so the count is
+/// atomic. It's atomic whether or not a file is built with OpenMP, so RefCounted has the same
+/// layout in every translation unit. Increments are relaxed since a new reference can only
+/// come from an existing one. Decrements are acq_rel so that whichever thread drops the last
+/// reference sees every other thread's writes before freeing.
 struct RefCounted {
 
   RefCounted() : count(0) { }
 
-  int incr() { return ++count; }
+  int incr() { return count.fetch_add(1, std::memory_order_relaxed) + 1; }
 
-  int decr() { return --count; }
+  ///
+  /// Returns the number of references left. Only the caller that gets 0 may free.
+  int decr() { return count.fetch_sub(1, std::memory_order_acq_rel) - 1; }
 
-  bool can_free() const { return count == 0; }
+  bool can_free() const { return count.load(std::memory_order_acquire) == 0; }
 
 private:
 
-  mutable int count;
+  std::atomic<int> count;
 
 };
-
@@ -6,4 +6,5 @@
 #include <iostream>
 #include "common/loop_type.h"
 #include "heaparray.h"
+#include "arena.h"
 #include "impls.h"
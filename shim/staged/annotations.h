@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include <array>
+#include <iostream>
+#include <memory>
 #include <sstream>
 #include <vector>
 #include "builder/builder.h"
@@ -10,14 +13,33 @@
 
 namespace shim {
 
+// Optimizations can be attached in two ways:
+// 1. To the next inline statement (block[i][j] = ...) with X::apply(...). These are queued
+//    until the statement builds its loop nest, which decides which loop each one lands on.
+//    Staging fails if any are still queued at the end of the function.
+// 2. To the next actual loop with annotate_loop(X(...), Y(...), ...).
+// Multiple optimizations on the same loop compose in a fixed order in the code generator:
+// parallel/simd/collapse/schedule become one omp directive, then unroll.
+
 enum OptType {
-  LOOP_PARALLEL
+  LOOP_PARALLEL,
+  LOOP_VECTORIZE,
+  LOOP_TILE,
+  LOOP_SPLIT,
+  LOOP_COLLAPSE,
+  LOOP_UNROLL,
+  LOOP_SCHEDULE
 };
 
+struct Optimization;
+
+using OptList = std::vector<std::unique_ptr<Optimization>>;
+
 // force it to be a header-only
 struct Optimization {
-  // maintains all the current optimizations requested by the user
-  //  inline static std::vector<std::unique_ptr<Optimization>> opts;
+  // maintains all the current optimizations requested by the user for the next
+  // inline statement. They are consumed when that statement builds its loop nest.
+  inline static OptList opts;
 
   inline static std::string opt_prefix = "opt";
   
@@ -25,14 +47,35 @@ struct Optimization {
 
   explicit Optimization(OptType opt_type) : opt_type(opt_type) { }
 
-  //  template <typename T, typename...Args>
-  //  static void apply(Args...args) {
-  //    Optimization::opts.emplace_back(std::make_unique<T>(args...));    
-  //  }
+  virtual ~Optimization() = default;
+
+  // the annotation attached to the loop this applies to. Empty if this
+  // optimization changes the structure of the loop nest instead.
+  virtual std::string annotation() const { return ""; }
+
+  // true if this goes on the outermost loop of an inline statement, rather than the innermost
+  bool is_outer() const {
+    return opt_type == LOOP_PARALLEL || opt_type == LOOP_COLLAPSE || opt_type == LOOP_SCHEDULE;
+  }
+
+  template <typename T, typename...Args>
+  static void apply(Args...args) {
+    Optimization::opts.emplace_back(std::make_unique<T>(args...));    
+  }
+
+  // take ownership of all the pending optimizations
+  static OptList consume() {
+    OptList consumed = std::move(Optimization::opts);
+    Optimization::opts.clear();
+    return consumed;
+  }
   
 };
 
-// This is for parallelizing an actual loop (not an inline one)
+// This is for parallelizing the outermost loop of the next inline statement, i.e.
+// Parallel::apply(8);
+// frame[i][j] = ...; // the i loop runs on 8 threads
+// Use annotate_loop(Parallel(nworkers)) to parallelize an actual loop instead.
 // Just plain CPU parallelism
 struct Parallel : Optimization {
 
@@ -43,17 +86,327 @@ struct Parallel : Optimization {
 
   static void apply(int nworkers=0) {
 #if ENABLE_OPTS == 1
+    Optimization::apply<Parallel>(nworkers);
+#endif
+  }
+  
+  explicit Parallel(int nworkers=0) : Optimization(LOOP_PARALLEL), nworkers(nworkers) { }
+
+  std::string annotation() const override {
     std::stringstream ss;
     ss << Optimization::opt_prefix << ":" << repr << ":" << nworkers;
-    builder::annotate(ss.str());
+    return ss.str();
+  }
+
+};
+
+// This is for vectorizing the innermost loop of the next inline statement, i.e.
+// Vectorize::apply(8);
+// YCbCr[i][j][k] = ...; // the k loop is vectorized
+struct Vectorize : Optimization {
+
+  inline static std::string repr = "simd";
+
+  // preferred number of lanes. 0 means let the compiler choose
+  int width;
+
+  static void apply(int width=0) {
+#if ENABLE_OPTS == 1
+    Optimization::apply<Vectorize>(width);
 #endif
-    //    Optimization::apply<CPUParallel>(nworkers);
   }
+
+  explicit Vectorize(int width) : Optimization(LOOP_VECTORIZE), width(width) { }
+
+  std::string annotation() const override {
+    std::stringstream ss;
+    ss << Optimization::opt_prefix << ":" << repr << ":" << width;
+    return ss.str();
+  }
+
+};
+
+// Common base for optimizations that strip-mine one dimension of an inline statement.
+// dim is the dimension of the block being written.
+struct StripMine : Optimization {
+
+  int dim;
   
-  explicit Parallel(int nworkers) : Optimization(LOOP_PARALLEL), nworkers(nworkers) { }
+  // number of iterations per strip
+  int size;
+
+  StripMine(OptType opt_type, int dim, int size) : Optimization(opt_type), dim(dim), size(size) { 
+    if (size <= 0) {
+      std::cerr << "Strip size must be positive, got " << size << std::endl;
+      exit(-1);
+    }
+  }
+
+};
+
+// This is for cache blocking the next inline statement. All the tile loops are placed
+// outside of all the point loops, i.e.
+// Tile::apply(0, 64);
+// Tile::apply(1, 64);
+// frame[i][j] = ...; // for ti { for tj { for i in ti's tile { for j in tj's tile { ... } } } }
+// Partial tiles at the end of a dimension are handled by clamping to the extent.
+struct Tile : StripMine {
+
+  inline static std::string repr = "tile";
+
+  static void apply(int dim, int size) {
+#if ENABLE_OPTS == 1
+    Optimization::apply<Tile>(dim, size);
+#endif
+  }
+
+  Tile(int dim, int size) : StripMine(LOOP_TILE, dim, size) { }
+
+};
+
+// This is for strip-mining one dimension of the next inline statement in place, i.e.
+// Split::apply(1, 8);
+// frame[i][j] = ...; // for i { for tj { for j in tj's strip { ... } } }
+// A partial strip at the end of the dimension is handled by clamping to the extent.
+struct Split : StripMine {
+
+  inline static std::string repr = "split";
+
+  static void apply(int dim, int factor) {
+#if ENABLE_OPTS == 1
+    Optimization::apply<Split>(dim, factor);
+#endif
+  }
+
+  Split(int dim, int factor) : StripMine(LOOP_SPLIT, dim, factor) { }
 
 };
 
+// The strip size requested for dim by an optimization of type opt_type, or 0 if there is none.
+inline int strip_size(const OptList &opts, OptType opt_type, int dim) {
+  int size = 0;
+  for (auto &opt : opts) {
+    if (opt->opt_type == opt_type) {
+      auto strip = static_cast<const StripMine*>(opt.get());
+      if (strip->dim == dim) {
+	size = strip->size;
+      }
+    }
+  }
+  return size;
+}
+
+// Verify that strip-mining optimizations refer to dims that exist, and that a dim 
+// is not both tiled and split.
+inline void verify_strips(const OptList &opts, int rank) {
+  for (auto &opt : opts) {
+    if (opt->opt_type == LOOP_TILE || opt->opt_type == LOOP_SPLIT) {
+      int dim = static_cast<const StripMine*>(opt.get())->dim;
+      if (dim < 0 || dim >= rank) {
+	std::cerr << "Cannot strip-mine dim " << dim << " of a rank " << rank << " inline statement" << std::endl;
+	exit(-1);
+      }
+      if (strip_size(opts, LOOP_TILE, dim) > 0 && strip_size(opts, LOOP_SPLIT, dim) > 0) {
+	std::cerr << "Dim " << dim << " cannot be both tiled and split" << std::endl;
+	exit(-1);
+      }
+    }
+  }
+}
+
+// Collapse the next n loops into one iteration space for a parallel or simd loop.
+// The loops must be perfectly nested.
+struct Collapse : Optimization {
+
+  inline static std::string repr = "collapse";
+
+  int n;
+
+  static void apply(int n) {
+#if ENABLE_OPTS == 1
+    Optimization::apply<Collapse>(n);
+#endif
+  }
+
+  explicit Collapse(int n) : Optimization(LOOP_COLLAPSE), n(n) { 
+    if (n <= 0) {
+      std::cerr << "Collapse amount must be positive, got " << n << std::endl;
+      exit(-1);
+    }
+  }
+
+  std::string annotation() const override {
+    std::stringstream ss;
+    ss << Optimization::opt_prefix << ":" << repr << ":" << n;
+    return ss.str();
+  }
+
+};
+
+// Unroll a loop by factor. For an inline statement, this unrolls the innermost loop at staging 
+// time (with a remainder loop), so it composes with Vectorize on the same loop.
+struct Unroll : Optimization {
+
+  inline static std::string repr = "unroll";
+
+  int factor;
+
+  static void apply(int factor) {
+#if ENABLE_OPTS == 1
+    Optimization::apply<Unroll>(factor);
+#endif
+  }
+
+  explicit Unroll(int factor) : Optimization(LOOP_UNROLL), factor(factor) { 
+    if (factor <= 0) {
+      std::cerr << "Unroll factor must be positive, got " << factor << std::endl;
+      exit(-1);
+    }
+  }
+
+  std::string annotation() const override {
+    std::stringstream ss;
+    ss << Optimization::opt_prefix << ":" << repr << ":" << factor;
+    return ss.str();
+  }
+
+};
+
+// The omp schedule of a parallel loop. kind is static, dynamic, or guided. chunk=0 means use 
+// the omp default.
+struct Schedule : Optimization {
+
+  inline static std::string repr = "schedule";
+
+  std::string kind;
+
+  int chunk;
+
+  static void apply(std::string kind, int chunk=0) {
+#if ENABLE_OPTS == 1
+    Optimization::apply<Schedule>(kind, chunk);
+#endif
+  }
+
+  Schedule(std::string kind, int chunk=0) : Optimization(LOOP_SCHEDULE), kind(kind), chunk(chunk) { 
+    if (kind != "static" && kind != "dynamic" && kind != "guided") {
+      std::cerr << "Unknown schedule kind: " << kind << std::endl;
+      exit(-1);
+    }
+  }
+
+  std::string annotation() const override {
+    std::stringstream ss;
+    ss << Optimization::opt_prefix << ":" << repr << ":" << kind << ":" << chunk;
+    return ss.str();
+  }
+
+};
+
+// The unroll factor requested in opts, or 0 if there is none.
+inline int unroll_factor(const OptList &opts) {
+  int factor = 0;
+  for (auto &opt : opts) {
+    if (opt->opt_type == LOOP_UNROLL) {
+      factor = static_cast<const Unroll*>(opt.get())->factor;
+    }
+  }
+  return factor;
+}
+
+// Verify that a Collapse on an inline statement only covers loops that can be collapsed,
+// i.e. that are perfectly nested and have bounds that don't depend on each other. Counting
+// from the outermost loop (the first tile loop, if tiled), that stops
+// - at a fixed index between loops, since it's declared between them
+// - at the point loop of a tiled dim, which is bounded by its tile
+// - after the strip loop of a split dim, since its point loop is bounded by the strip
+// - at an unrolled loop, unless it's the only one, since its parent also holds the remainder loop
+// is_iter says which dims of the statement are indexed by an Iter.
+template <size_t Rank>
+void verify_collapse(const OptList &opts, const std::array<bool,Rank> &is_iter) {
+  int n = 0;
+  for (auto &opt : opts) {
+    if (opt->opt_type == LOOP_COLLAPSE) {
+      n = static_cast<const Collapse*>(opt.get())->n;
+    }
+  }
+  if (n == 0) {
+    return;
+  }
+  int innermost = -1;
+  int ntiles = 0;
+  for (int d = 0; d < (int)Rank; d++) {
+    if (is_iter[d]) {
+      innermost = d;
+      if (strip_size(opts, LOOP_TILE, d) > 0) {
+	ntiles++;
+      }
+    }
+  }
+  int nested = ntiles;
+  for (int d = 0; d < (int)Rank; d++) {
+    if (!is_iter[d]) {
+      if (nested > 0) break;
+      continue;
+    }
+    if (strip_size(opts, LOOP_TILE, d) > 0) {
+      break;
+    }
+    if (strip_size(opts, LOOP_SPLIT, d) > 0) {
+      nested++;
+      break;
+    }
+    if (d == innermost && unroll_factor(opts) > 1) {
+      if (nested == 0) nested++;
+      break;
+    }
+    nested++;
+  }
+  if (n > nested) {
+    std::cerr << "Cannot collapse " << n << " loops of an inline statement, since only the outer " 
+	      << nested << " are perfectly nested with independent bounds" << std::endl;
+    exit(-1);
+  }
+}
+
+// Attach several optimizations to the next actual loop, i.e.
+// annotate_loop(Parallel(8), Collapse(2), Schedule("dynamic", 4));
+// for (dvar<loop_type> r = 0; r < H; r = r + 1) { for (...) { ... } }
+template <typename...Opts>
+void annotate_loop(Opts...opts) {
+#if ENABLE_OPTS == 1
+  std::stringstream ss;
+  std::string delim = "";
+  ((ss << delim << opts.annotation(), delim = ";"), ...);
+  builder::annotate(ss.str());
+#endif
+}
+
+// Attach the optimizations in opts that target a loop of an inline statement.
+// Must be called right before the loop is generated. Unroll is done during staging
+// for inline statements, so it isn't attached here.
+inline void annotate_inline_loop(const OptList &opts, bool is_outermost, bool is_innermost) {
+#if ENABLE_OPTS == 1
+  std::stringstream ss;
+  std::string delim = "";
+  for (auto &opt : opts) {
+    if (opt->opt_type == LOOP_UNROLL) {
+      continue;
+    }
+    if ((opt->is_outer() && is_outermost) || (!opt->is_outer() && is_innermost)) {
+      std::string annot = opt->annotation();
+      if (!annot.empty()) {
+	ss << delim << annot;
+	delim = ";";
+      }
+    }
+  }
+  if (!ss.str().empty()) {
+    builder::annotate(ss.str());
+  }
+#endif
+}
+
 struct Comment {
   inline static std::string repr = "comment";
   static void apply(std::string msg) {
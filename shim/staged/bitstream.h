@@ -7,10 +7,17 @@
 
 namespace shim {
 
+///
+/// Reads an MSB-first bitstream in the generated code.
+/// The next bits are kept left-aligned in a 64-bit cache, which is refilled with a single
+/// unaligned big-endian load of 8 bytes (or byte by byte within 8 bytes of the end), so
+/// peek, pop, and skip are just shifts and masks on the cache. After a refill, the cache
+/// holds at least 56 bits unless the stream runs out.
+/// length is in bits. Reading past the last byte gives 0s.
 struct Bitstream {
-  
-  Bitstream(builder::dyn_var<uint8_t*> bitstream, builder::dyn_var<uint64_t> length) : 
-    bitstream(bitstream), length(length), cursor(0) { }
+
+  Bitstream(builder::dyn_var<uint8_t*> bitstream, builder::dyn_var<uint64_t> length) :
+    bitstream(bitstream), length(length), nbytes((length + 7) / 8), pos(0), cache(0), bits(0) { }
 
   ///
   /// Peek n bits in the bitstream
@@ -19,8 +26,7 @@ struct Bitstream {
   builder::dyn_var<Ret> peek(builder::dyn_var<int> n);
 
   ///
-  /// Assume byte-aligned and peek n bits in the bitstream 
-  /// n can be max 64 bits, but is not checked
+  /// Same as peek. Kept for existing callers, since alignment no longer matters.
   template <typename Ret=uint64_t>
   builder::dyn_var<Ret> peek_aligned(builder::dyn_var<int> n);
 
@@ -31,8 +37,7 @@ struct Bitstream {
   builder::dyn_var<Ret> pop(builder::dyn_var<int> n);
 
   ///
-  /// Assume byte-aligned and peek n bits in the bitstream and move the cursor n bits
-  /// n can be max 64 bits, but is not checked
+  /// Same as pop. Kept for existing callers, since alignment no longer matters.
   template <typename Ret=uint64_t>
   builder::dyn_var<Ret> pop_aligned(builder::dyn_var<int> n);
 
@@ -44,97 +49,110 @@ struct Bitstream {
   builder::dyn_var<Ret> pop_check(builder::dyn_var<int> n, builder::dyn_var<Ret> should_be);
 
   ///
-  /// Assuem byte-aligned and peek n bits in the bitstream and move the cursor n bits.
-  /// Check if value matches requested data and fail otherwise.
-  /// n can be max 64 bits, but is not checked
+  /// Same as pop_check. Kept for existing callers, since alignment no longer matters.
   template <typename Ret=uint64_t>
   builder::dyn_var<Ret> pop_check_aligned(builder::dyn_var<int> n, builder::dyn_var<Ret> should_be);
 
-  /// 
+  ///
   /// Move the cursor n bits
   void skip(builder::dyn_var<unsigned int> n);
 
+  ///
+  /// Move the cursor to the next byte boundary, if it isn't on one already
+  void align();
+
+  ///
+  /// The cursor, in bits from the start of the bitstream
+  builder::dyn_var<uint64_t> position();
+
   ///
   /// Check if there are at least n bits left in the bitstream.
-  /// 1 = at least n bits, 0 = nit at least n bits
+  /// 1 = at least n bits, 0 = not at least n bits
   builder::dyn_var<int> exists(builder::dyn_var<unsigned int> n);
 
-  builder::dyn_var<int> dummy_stuff() {
-    for (builder::dyn_var<int> i = 0; i < 10; i = i+1) { }
-    return 0;
-  }
-
   builder::dyn_var<uint8_t*> bitstream;
   builder::dyn_var<uint64_t> length;
-  builder::dyn_var<uint64_t> cursor;
+
+private:
+
+  ///
+  /// Top up the cache to at least 56 bits, or as many as are left
+  void refill();
+
+  ///
+  /// Peek n bits from the cache, where n is at most 56
+  builder::dyn_var<uint64_t> peek_cache(builder::dyn_var<int> n);
+
+  builder::dyn_var<uint64_t> nbytes;
+  // the next byte to load into the cache
+  builder::dyn_var<uint64_t> pos;
+  // the next bits, starting at the MSB. Anything past bits is either 0 or the
+  // actual bits that follow, so refills can OR over it.
+  builder::dyn_var<uint64_t> cache;
+  builder::dyn_var<int> bits;
+
 };
 
-template <typename Ret>
-builder::dyn_var<Ret> Bitstream::peek(builder::dyn_var<int> n) {
-  builder::dyn_var<uint64_t> bit_idx = cursor % 8;
-  builder::dyn_var<Ret> peeked = 0;
-  if (n == 0) {
-    peeked = 0;
-  } else if (bit_idx == 0) {
-    // this is byte aligned
-    peeked = peek_aligned<Ret>(n);
-  } else {    
-    // not byte aligned
-    // read up to factor bits, where factor is how many bits til aligned
-    builder::dyn_var<uint64_t> byte_idx = cursor / 8;
-    builder::dyn_var<int> bits_left = n;
-    builder::dyn_var<uint8_t> byte = bitstream[byte_idx];
-    byte_idx = byte_idx + 1;
-
-    builder::dyn_var<int> factor = 0;
-    if (bits_left < (8-bit_idx)) {
-      factor = bits_left;
+inline void Bitstream::refill() {
+  if (bits <= 56) {
+    if (pos + 8 <= nbytes) {
+      builder::dyn_var<uint64_t> word = load_be64(bitstream + pos);
+      cache = cache | (word >> bits);
+      // only count whole bytes, which leaves 56 to 63 bits
+      builder::dyn_var<int> added = (63 - bits) >> 3;
+      pos = pos + added;
+      bits = bits + added * 8;
     } else {
-      factor = 8 - bit_idx;
+      // the tail, where a full load would read past the end
+      while (bits <= 56 && pos < nbytes) {
+	builder::dyn_var<uint64_t> byte = bitstream[pos];
+	cache = cache | (byte << (56 - bits));
+	pos = pos + 1;
+	bits = bits + 8;
+      }
     }
-    byte = shim::rshift(byte, 8 - (factor+bit_idx));
-    // now clear out any MSB bits that aren't needed
-    builder::dyn_var<uint8_t> mask = lshift(1, factor) - 1;
-    peeked = byte & mask; //band(byte, mask);
-    bits_left = bits_left - factor;
-    // now we are aligned, so we can read the remainder
-    peeked = shim::lshift(peeked, bits_left);
-    // temporarily adjust the cursor though
-    cursor = cursor + factor;
-    peeked = peeked | peek_aligned(bits_left); //bor(peeked, peek_aligned(bits_left));
-    cursor = cursor - factor;
   }
-  // if put this within the conditionals, codegen barfs
+}
+
+inline builder::dyn_var<uint64_t> Bitstream::peek_cache(builder::dyn_var<int> n) {
+  builder::dyn_var<uint64_t> peeked = 0;
+  if (bits < n) {
+    refill();
+  }
+  // shifting by 64 is undefined
+  if (n > 0) {
+    peeked = cache >> (64 - n);
+  }
   return peeked;
 }
 
 template <typename Ret>
-builder::dyn_var<Ret> Bitstream::peek_aligned(builder::dyn_var<int> n) {
-  // read a byte at a time 
+builder::dyn_var<Ret> Bitstream::peek(builder::dyn_var<int> n) {
   builder::dyn_var<Ret> peeked = 0;
-  builder::dyn_var<uint64_t> byte_idx = cursor / 8;
-  builder::dyn_var<int> bits_left = n;
-  builder::dyn_var<int> upper = n-8;
-  builder::dyn_var<int> dummy = 0;
-  for (builder::dyn_var<int> i = 0; i < upper; i = i + 8) {
-    builder::dyn_var<uint8_t> byte = bitstream[byte_idx];
-    byte_idx = byte_idx + 1;
-    builder::dyn_var<Ret> shifted = shim::lshift(peeked, 8 * dummy);
-    peeked = shifted | byte;
-    dummy = 1;
-    bits_left = bits_left - 8;
-  }
-
-  // if n was not a multiple of 8, will have some stragglers here
-  if (bits_left > 0) {
-    peeked = shim::lshift(peeked, bits_left);
-    builder::dyn_var<uint8_t> byte = bitstream[byte_idx];
-    byte = shim::rshift(byte, 8-bits_left);
-    peeked = peeked | byte; //bor(peeked, byte);
+  if (n <= 56) {
+    peeked = peek_cache(n);
+  } else {
+    // too wide for one refill, so read the top 32 bits, then the rest, then rewind
+    builder::dyn_var<uint64_t> saved_pos = pos;
+    builder::dyn_var<uint64_t> saved_cache = cache;
+    builder::dyn_var<int> saved_bits = bits;
+    builder::dyn_var<uint64_t> upper = peek_cache(32);
+    skip(32);
+    builder::dyn_var<uint64_t> lower = peek_cache(n - 32);
+    pos = saved_pos;
+    cache = saved_cache;
+    bits = saved_bits;
+    peeked = (upper << (n - 32)) | lower;
   }
+  // if put this within the conditionals, codegen barfs
   return peeked;
 }
 
+template <typename Ret>
+builder::dyn_var<Ret> Bitstream::peek_aligned(builder::dyn_var<int> n) {
+  return peek<Ret>(n);
+}
+
 template <typename Ret>
 builder::dyn_var<Ret> Bitstream::pop(builder::dyn_var<int> n) {
   builder::dyn_var<Ret> popped = peek<Ret>(n);
@@ -144,18 +162,15 @@ builder::dyn_var<Ret> Bitstream::pop(builder::dyn_var<int> n) {
 
 template <typename Ret>
 builder::dyn_var<Ret> Bitstream::pop_aligned(builder::dyn_var<int> n) {
-  builder::dyn_var<Ret> popped = peek_aligned<Ret>(n);
-  skip(n);
-  return popped;
+  return pop<Ret>(n);
 }
 
 template <typename Ret>
 builder::dyn_var<Ret> Bitstream::pop_check(builder::dyn_var<int> n, builder::dyn_var<Ret> should_be) {
-  builder::dyn_var<Ret> popped = peek<Ret>(n);
-  skip(n);
+  builder::dyn_var<Ret> popped = pop<Ret>(n);
   if (popped != should_be) {
     // TODO better error message (print expected then got)
-    shim::print_string("Invalid data");
+    shim::print("Invalid data\n");
     shim::hexit(-1);
   }
   return popped;
@@ -163,23 +178,44 @@ builder::dyn_var<Ret> Bitstream::pop_check(builder::dyn_var<int> n, builder::dyn
 
 template <typename Ret>
 builder::dyn_var<Ret> Bitstream::pop_check_aligned(builder::dyn_var<int> n, builder::dyn_var<Ret> should_be) {
-  builder::dyn_var<Ret> popped = peek_aligned<Ret>(n);
-  skip(n);
-  if (popped != should_be) {
-    // TODO better error message (print expected then got)
-    shim::print_string("Invalid data");
-    shim::hexit(-1);
+  return pop_check<Ret>(n, should_be);
+}
+
+inline void Bitstream::skip(builder::dyn_var<unsigned int> n) {
+  if (n <= bits) {
+    // bits is at most 63, so this shift is defined
+    cache = cache << n;
+    bits = bits - n;
+  } else {
+    // drop the cache and jump straight to the byte holding the new cursor
+    builder::dyn_var<uint64_t> rest = n - bits;
+    cache = 0;
+    bits = 0;
+    pos = pos + (rest >> 3);
+    refill();
+    builder::dyn_var<int> within = rest & 7;
+    if (within > bits) {
+      // past the end
+      within = bits;
+    }
+    cache = cache << within;
+    bits = bits - within;
   }
-  return popped;
 }
 
-void Bitstream::skip(builder::dyn_var<unsigned int> n) {
-  cursor = cursor + n;
+inline void Bitstream::align() {
+  // the cache always ends on a byte boundary
+  skip(bits & 7);
+}
+
+inline builder::dyn_var<uint64_t> Bitstream::position() {
+  builder::dyn_var<uint64_t> p = pos * 8 - bits;
+  return p;
 }
 
-builder::dyn_var<int> Bitstream::exists(builder::dyn_var<unsigned int> n) {
+inline builder::dyn_var<int> Bitstream::exists(builder::dyn_var<unsigned int> n) {
   builder::dyn_var<int> ok = 0;
-  if (cursor+n < length) {
+  if (position() + n <= length) {
     ok = 1;
   }
   return ok;
@@ -0,0 +1,217 @@
+// -*-c++-*-
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+#include <unistd.h>
+#include "builder/static_var.h"
+
+namespace shim {
+
+///
+/// A cache of generated functions, so regenerating unchanged kernels doesn't re-run
+/// extraction.
+/// Each function has a slot, keyed on its name, its extra args (by value), and the compile
+/// options, and the slot holds the code last generated for it along with what it was
+/// generated from. That's the function's version if it was given one (see Staged), and
+/// otherwise the generator binary itself (which contains the staged code and any static
+/// values it captures). A slot is only reused if that matches, and is overwritten
+/// otherwise, so stale entries don't pile up.
+/// Without a version, any change to the generator misses for all of its functions, and since
+/// the build only re-runs a generator after it's rebuilt, that's nearly every run. So the
+/// generators in the build version every function. A version lets a function hit as long as
+/// it doesn't change, but it must change whenever the function (or anything it calls) does.
+/// Args that can't be told apart by value (e.g. pointers) aren't cached at all.
+/// The cache is off unless a directory is given, either with SHIM_STAGE_CACHE in the
+/// environment or by setting StageCache::dir.
+struct StageCache {
+
+  ///
+  /// Where entries are stored. Empty disables the cache.
+  static inline std::string dir = std::getenv("SHIM_STAGE_CACHE") ? std::getenv("SHIM_STAGE_CACHE") : "";
+
+  ///
+  /// 64-bit FNV-1a. This is only for telling generated code apart, not for security.
+  static uint64_t hash(uint64_t h, const void *data, size_t len) {
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; i++) {
+      h ^= bytes[i];
+      h *= 1099511628211ull;
+    }
+    return h;
+  }
+
+  static uint64_t hash(uint64_t h, const std::string &s) {
+    return hash(h, s.data(), s.size());
+  }
+
+  ///
+  /// The hash of the running generator, or 0 if it can't be read
+  static uint64_t binary_hash() {
+    static uint64_t h = [] {
+      std::error_code ec;
+      std::filesystem::path exe = std::filesystem::read_symlink("/proc/self/exe", ec);
+      if (ec) return (uint64_t)0;
+      std::ifstream in(exe, std::ios::binary);
+      if (!in) return (uint64_t)0;
+      std::vector<char> buf(1 << 16);
+      uint64_t acc = 14695981039346656037ull;
+      while (in.read(buf.data(), buf.size()) || in.gcount() > 0) {
+	acc = hash(acc, buf.data(), in.gcount());
+      }
+      return acc;
+    }();
+    return h;
+  }
+
+  static bool enabled() {
+    return !dir.empty();
+  }
+
+  ///
+  /// Whether args of type Arg can be told apart by value
+  template <typename Arg>
+  struct hashable : std::bool_constant<std::is_arithmetic_v<Arg> || std::is_enum_v<Arg>> { };
+  template <typename T, size_t N>
+  struct hashable<std::array<T,N>> : hashable<T> { };
+  template <typename T>
+  struct hashable<std::vector<T>> : hashable<T> { };
+  template <typename T>
+  struct hashable<builder::static_var<T>> : hashable<T> { };
+
+  ///
+  /// Add an extra arg of the staged function to a key, by value
+  template <typename Arg>
+  static uint64_t hash_arg(uint64_t h, const Arg &arg) {
+    static_assert(hashable<Arg>::value, "Cannot hash this arg by value");
+    if constexpr (std::is_arithmetic_v<Arg> || std::is_enum_v<Arg>) {
+      h = hash(h, &arg, sizeof(Arg));
+    } else if constexpr (is_static_var<Arg>::value) {
+      h = hash_arg(h, static_cast<const typename is_static_var<Arg>::type&>(arg));
+    } else {
+      // arrays and vectors
+      size_t n = arg.size();
+      h = hash(h, &n, sizeof(n));
+      for (const auto &elem : arg) {
+	h = hash_arg(h, elem);
+      }
+    }
+    return hash(h, typeid(Arg).name());
+  }
+
+  ///
+  /// The slot of the function name staged with args under the given options, or empty if
+  /// args can't be hashed
+  template <typename...Args>
+  static std::string slot(const std::string &name, const std::string &options, const Args&...args) {
+    if constexpr (!(hashable<Args>::value && ...)) {
+      return "";
+    } else {
+      uint64_t h = 14695981039346656037ull;
+      h = hash(h, name);
+      h = hash(h, options);
+      ((h = hash_arg(h, args)), ...);
+      std::stringstream ss;
+      ss << name << "_" << std::hex << h;
+      return ss.str();
+    }
+  }
+
+  ///
+  /// What a function with the given version (which may be empty) was generated from, or
+  /// empty if that can't be determined
+  static std::string origin(const std::string &version) {
+    if (!version.empty()) return "version " + version;
+    uint64_t h = binary_hash();
+    if (h == 0) return "";
+    std::stringstream ss;
+    ss << "binary " << std::hex << h;
+    return ss.str();
+  }
+
+  ///
+  /// Read the signatures and source in a slot. Returns false on a miss, including when the
+  /// slot holds code generated from something else.
+  static bool load(const std::string &slot, const std::string &origin,
+		   std::vector<std::string> &sigs, std::string &src) {
+    std::ifstream in(std::filesystem::path(dir) / (slot + ".gen"), std::ios::binary);
+    if (!in) return false;
+    std::string line;
+    if (!std::getline(in, line) || line != origin) return false;
+    if (!std::getline(in, line)) return false;
+    size_t nsigs = std::stoul(line);
+    for (size_t i = 0; i < nsigs; i++) {
+      if (!std::getline(in, line)) return false;
+      sigs.push_back(line);
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    src = ss.str();
+    return true;
+  }
+
+  ///
+  /// Save a generated function to its slot, replacing what was there. The entry is written
+  /// to a temporary and renamed, so concurrent generators never see a partial entry.
+  static void store(const std::string &slot, const std::string &origin,
+		    const std::vector<std::string> &sigs, const std::string &src) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+      std::cerr << "Cannot create the stage cache " << dir << ": " << ec.message() << std::endl;
+      return;
+    }
+    std::filesystem::path path = std::filesystem::path(dir) / (slot + ".gen");
+    std::string tmp = path.string() + "." + std::to_string(::getpid());
+    {
+      std::ofstream out(tmp, std::ios::binary);
+      out << origin << std::endl;
+      out << sigs.size() << std::endl;
+      for (auto &sig : sigs) {
+	out << sig << std::endl;
+      }
+      out << src;
+    }
+    std::filesystem::rename(tmp, path, ec);
+  }
+
+private:
+
+  template <typename T>
+  struct is_static_var : std::false_type { };
+  template <typename T>
+  struct is_static_var<builder::static_var<T>> : std::true_type {
+    using type = T;
+  };
+
+};
+
+///
+/// Write contents to path unless it already holds exactly that. This leaves the timestamps
+/// of unchanged generated files alone, so the build doesn't recompile them. Since those
+/// files can then be older than the generator, a build rule that runs a generator should
+/// output a stamp rather than the generated files (see CMakeLists.txt).
+inline void write_if_changed(const std::string &path, const std::string &contents) {
+  {
+    std::ifstream in(path, std::ios::binary);
+    if (in) {
+      std::stringstream ss;
+      ss << in.rdbuf();
+      if (ss.str() == contents) return;
+    }
+  }
+  std::ofstream out(path, std::ios::binary);
+  out << contents;
+}
+
+}
@@ -10,6 +10,7 @@
 #include "annotations.h"
 #include "object.h"
 #include "passes.h"
+#include "cache.h"
 
 namespace shim {
 // fixes the syntax for staged function args of the form
@@ -76,46 +77,114 @@ public:
   }
 
   // apply string-matching based optimizations
+  // Multiple optimizations on a loop are combined in this order:
+  // 1. #pragma omp parallel for [simd] [num_threads] [collapse] [schedule] [simdlen] 
+  //    (or #pragma omp simd [collapse] [simdlen] if not parallel)
+  // 2. unroll. This is #pragma GCC unroll if it's alone. Otherwise it can't precede the omp
+  //    directive, so it becomes #pragma omp unroll partial (OpenMP 5.1) after it. Nothing
+  //    else may go between the directive and the loop, so the target compiler only gets the
+  //    hint if it supports OpenMP 5.1, or isn't using OpenMP (and ignores the directive).
   void visit(block::for_stmt::Ptr s) {
     std::stringstream ss;
     std::string annot = s->annotation;
     // first split on different annotations
     std::vector<std::string> annots = split_on(annot, ";");
-    if (annots.size() > 1) {
-      std::cerr << "Only supporting single opt applications currently." << std::endl;
+    bool parallel = false;
+    int nworkers = 0;
+    bool simd = false;
+    int simdlen = 0;
+    int collapse = 0;
+    int unroll = 0;
+    std::string schedule = "";
+    int chunk = 0;
+    for (auto &a : annots) {
+      std::vector<std::string> comps = split_on(a, ":");
+      if (!is_same(comps[0], Optimization::opt_prefix)) {
+	std::cerr << "Unknown AST annotation: " << annot << std::endl;
+	exit(48);
+      }
+      // okay, it's an optimization!
+      if (comps.size() < 3) {
+	std::cerr << "Not enough components in optimization: " << a << std::endl;
+	exit(-1);
+      }
+      if (is_same(comps[1], Parallel::repr)) {
+	parallel = true;
+	nworkers = stoi(comps[2]);
+      } else if (is_same(comps[1], Vectorize::repr)) {
+	simd = true;
+	simdlen = stoi(comps[2]);
+      } else if (is_same(comps[1], Collapse::repr)) {
+	collapse = stoi(comps[2]);
+      } else if (is_same(comps[1], Unroll::repr)) {
+	unroll = stoi(comps[2]);
+      } else if (is_same(comps[1], Schedule::repr)) {
+	if (comps.size() < 4) {
+	  std::cerr << "Not enough components in optimization: " << a << std::endl;
+	  exit(-1);
+	}
+	schedule = comps[2];
+	chunk = stoi(comps[3]);
+      } else {
+	std::cerr << "Unknown optimization: " << a << std::endl;
+	exit(-1);
+      }
+    }
+    if (!schedule.empty() && !parallel) {
+      std::cerr << "A schedule requires a parallel loop: " << annot << std::endl;
       exit(-1);
     }
-    if (!annots.empty()) {
-      std::vector<std::string> comps = split_on(annots[0], ":");
-      if (!comps[0].compare(0, Optimization::opt_prefix.size(), Optimization::opt_prefix)) {
-	// okay, it's an optimization!
-	if (comps.size() == 1) {
-	  std::cerr << "Not enough components in optimization: " << annots[0] << std::endl;
-	  exit(-1);
+    if (collapse > 0 && !parallel && !simd) {
+      std::cerr << "Collapse requires a parallel or simd loop: " << annot << std::endl;
+      exit(-1);
+    }
+    if (parallel || simd) {
+      std::stringstream prg;
+      if (parallel) {
+	prg << "#pragma omp parallel for";
+	if (simd) {
+	  prg << " simd";
 	}
-	if (!comps[1].compare(0, Parallel::repr.size(), Parallel::repr)) {
-	  std::stringstream prg;
-	  prg << "#pragma omp parallel for";
-	  int nworkers = stoi(comps[2]);
-	  if (nworkers > 0) {
-	    prg << " num_threads(" << nworkers << ")" << std::endl;
-	  } else {
-	    prg << std::endl;
-	  }
-
-	  ss << prg.str();
-	  printer::indent(ss, curr_indent);
+	if (nworkers > 0) {
+	  prg << " num_threads(" << nworkers << ")";
 	}
-	block::c_code_generator::visit(s);
-	ss << last;
       } else {
-	std::cerr << "Unknown AST annotation: " << annot << std::endl;
-	exit(48);
+	prg << "#pragma omp simd";
       }
-    } else {
-      block::c_code_generator::visit(s);
-      ss << last;
+      if (collapse > 0) {
+	prg << " collapse(" << collapse << ")";
+      }
+      if (!schedule.empty()) {
+	prg << " schedule(" << schedule;
+	if (chunk > 0) {
+	  prg << "," << chunk;
+	}
+	prg << ")";
+      }
+      if (simd && simdlen > 0) {
+	prg << " simdlen(" << simdlen << ")";
+      }
+      ss << prg.str() << std::endl;
+      printer::indent(ss, curr_indent);
+    }
+    if (unroll > 0) {
+      if (parallel || simd) {
+	ss << "#if _OPENMP >= 202011" << std::endl;
+	printer::indent(ss, curr_indent);
+	ss << "#pragma omp unroll partial(" << unroll << ")" << std::endl;
+	printer::indent(ss, curr_indent);
+	ss << "#elif !defined(_OPENMP)" << std::endl;
+	printer::indent(ss, curr_indent);
+	ss << "#pragma GCC unroll " << unroll << std::endl;
+	printer::indent(ss, curr_indent);
+	ss << "#endif" << std::endl;
+      } else {
+	ss << "#pragma GCC unroll " << unroll << std::endl;
+      }
+      printer::indent(ss, curr_indent);
     }
+    block::c_code_generator::visit(s);
+    ss << last;
     last = ss.str();
   }
 
@@ -127,29 +196,9 @@ private:
   
 };
 
-struct CompileOptions {
-  static inline bool isCPP = true;
-};
-
-// isCPP just dictates whether or not the functions are wrapped with extern in the c code
-template <typename Func, typename...Args>
-void stage(Func func, std::string name, std::string fn_prefix, std::string pre_hdr, std::string pre_src, Args...args) {
-  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-  std::ofstream src;
-  std::ofstream hdr;
-  std::string header = fn_prefix + (CompileOptions::isCPP ? ".hpp" : ".h");  
-  std::string source = CompileOptions::isCPP ? fn_prefix + ".cpp" : fn_prefix + ".c";
-  hdr.open(header);
-  src.open(source);
-  if (name.empty()) name = "__my_staged_func";
-  auto ast = builder::builder_context().extract_function_ast(func, name, args...);
-  // run buildit passes
-  block::eliminate_redundant_vars(ast);
-
-  // run shim passes
-  ReplaceStackBuilder replace_stack_builder;
-  ast->accept(&replace_stack_builder);
-
+///
+/// Write the includes and macros that every generated file needs
+inline void write_prelude(std::ostream &hdr, std::ostream &src, std::string pre_hdr, std::string pre_src) {
   hdr << "#pragma once" << std::endl;
   hdr << pre_hdr;
   src << pre_src;
@@ -158,9 +207,11 @@ void stage(Func func, std::string name, std::string fn_prefix, std::string pre_h
     src << "#include <math.h>" << std::endl;
     src << "#include <stdbool.h>" << std::endl;
     src << "#include <stdlib.h>" << std::endl;
+    src << "#include <stdint.h>" << std::endl;
     hdr << "#include <stdbool.h>" << std::endl;
   } else {
     src << "#include <cstdio>" << std::endl;
+    src << "#include <cstdint>" << std::endl;
   } 
   // Plain C does not support the HeapArray and things like that!
   if (CompileOptions::isCPP)
@@ -194,18 +245,115 @@ void stage(Func func, std::string name, std::string fn_prefix, std::string pre_h
   src << "#define SHIM_BUILD_STACK_DOUBLE(name,x) double name[x]" << std::endl;
 
   src << "#define TERNARY(cond,t,f) (cond) ? (t) : (f)" << std::endl;
+  src << "#define SHIM_MIN(a,b) ((a) < (b) ? (a) : (b))" << std::endl;
+  src << "#define SHIM_MAX(a,b) ((a) > (b) ? (a) : (b))" << std::endl;
+  src << "#define SHIM_ABS(a) ((a) < 0 ? -(a) : (a))" << std::endl;
 
   src << "void print_newline() { printf(\"\\n\"); }" << std::endl;
-  std::stringstream src2;
-  std::vector<std::string> sigs = hmda_cpp_code_generator::generate_code(ast, src2, 0);
+  // compilers turn this into a single load (and byte swap), without needing alignment
+  src << "static inline uint64_t shim_load_be64(const uint8_t *p) {" << std::endl;
+  src << "  return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | "
+      << "((uint64_t)p[3] << 32) |" << std::endl;
+  src << "    ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | (uint64_t)p[7];"
+      << std::endl;
+  src << "}" << std::endl;
+}
+
+///
+/// Extract and generate the code for func, adding its signature to the header.
+/// version identifies func for the StageCache, and can be empty.
+template <typename Func, typename...Args>
+void generate_staged(Func func, std::string name, std::string version, std::ostream &hdr, std::ostream &src,
+		     Args...args) {
+  if (name.empty()) name = "__my_staged_func";
+  std::vector<std::string> sigs;
+  std::string code;
+  std::string slot;
+  std::string origin;
+  if (StageCache::enabled()) {
+    slot = StageCache::slot(name, CompileOptions::repr(), args...);
+    origin = StageCache::origin(version);
+  }
+  bool cached = !slot.empty() && !origin.empty();
+  if (!cached || !StageCache::load(slot, origin, sigs, code)) {
+    // don't let optimizations requested by a previous stage leak into this one
+    Optimization::opts.clear();
+    auto ast = builder::builder_context().extract_function_ast(func, name, args...);
+    if (!Optimization::opts.empty()) {
+      std::cerr << "Optimizations were applied in " << name << " with no inline statement after them. "
+		<< "Use annotate_loop for an actual loop." << std::endl;
+      exit(-1);
+    }
+    // run buildit passes
+    block::eliminate_redundant_vars(ast);
+
+    // run shim passes
+    ReplaceStackBuilder replace_stack_builder;
+    ast->accept(&replace_stack_builder);
+
+    std::stringstream src2;
+    sigs = hmda_cpp_code_generator::generate_code(ast, src2, 0);
+    code = src2.str();
+    if (cached) {
+      StageCache::store(slot, origin, sigs, code);
+    }
+  } else {
+    std::cout << "Reusing cached " << name << std::endl;
+  }
   for (auto sig : sigs) {
     hdr << sig << ";" << std::endl;
   }
-  src << src2.str();
-  hdr.flush();
-  hdr.close();
-  src.flush();
-  src.close();
+  src << code;
+}
+
+// isCPP just dictates whether or not the functions are wrapped with extern in the c code.
+// Files whose contents didn't change aren't rewritten, so the build doesn't recompile them.
+template <typename Func, typename...Args>
+void stage(Func func, std::string name, std::string fn_prefix, std::string pre_hdr, std::string pre_src, Args...args) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::stringstream src;
+  std::stringstream hdr;
+  std::string header = fn_prefix + (CompileOptions::isCPP ? ".hpp" : ".h");  
+  std::string source = CompileOptions::isCPP ? fn_prefix + ".cpp" : fn_prefix + ".c";
+  write_prelude(hdr, src, pre_hdr, pre_src);
+  generate_staged(func, name, "", hdr, src, args...);
+  write_if_changed(header, hdr.str());
+  write_if_changed(source, src.str());
+  std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+  std::cout << "Staging took " << std::chrono::duration_cast<std::chrono::nanoseconds> (stop - start).count()/1e9 << "s" << std::endl;  
+}
+
+///
+/// A function to stage with stage_all, along with its name in the generated code.
+/// An optional version lets the StageCache reuse its code while other functions in the
+/// generator change (see StageCache), i.e. Staged{f, "f", "2"}. It must change whenever
+/// the function or anything it calls does.
+template <typename Func>
+struct Staged {
+  Func func;
+  std::string name;
+  std::string version = "";
+};
+
+template <typename Func>
+Staged(Func, std::string) -> Staged<Func>;
+template <typename Func>
+Staged(Func, std::string, std::string) -> Staged<Func>;
+
+///
+/// Stage several functions (with no extra args) into the same generated files, i.e.
+/// stage_all("kernels", hdr, src, Staged{f, "f"}, Staged{g, "g"});
+template <typename...Funcs>
+void stage_all(std::string fn_prefix, std::string pre_hdr, std::string pre_src, Staged<Funcs>...funcs) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::stringstream src;
+  std::stringstream hdr;
+  std::string header = fn_prefix + (CompileOptions::isCPP ? ".hpp" : ".h");  
+  std::string source = CompileOptions::isCPP ? fn_prefix + ".cpp" : fn_prefix + ".c";
+  write_prelude(hdr, src, pre_hdr, pre_src);
+  (generate_staged(funcs.func, funcs.name, funcs.version, hdr, src), ...);
+  write_if_changed(header, hdr.str());
+  write_if_changed(source, src.str());
   std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
   std::cout << "Staging took " << std::chrono::duration_cast<std::chrono::nanoseconds> (stop - start).count()/1e9 << "s" << std::endl;  
 }
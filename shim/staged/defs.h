@@ -6,6 +6,7 @@
 #define ENABLE_OPTS 1
 
 #include <array>
+#include <string>
 #include "builder/dyn_var.h"
 #include "builder/static_var.h"
 #include "builder/array.h"
@@ -36,4 +37,14 @@ template <typename T, int Rank>
 using darr = std::array<T,Rank>;
 #endif
 
+struct CompileOptions {
+  static inline bool isCPP = true;
+
+  ///
+  /// The options that change the generated code, for keying the StageCache
+  static std::string repr() {
+    return isCPP ? "cpp" : "c";
+  }
+};
+
 }
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <iostream>
+#include <limits>
 #include <type_traits>
 #include "builder/dyn_var.h"
 #include "builder/array.h"
@@ -10,6 +12,7 @@
 #include "fwddecls.h"
 #include "traits.h"
 #include "defs.h"
+#include "location.h"
 
 namespace shim {
 
@@ -142,6 +145,79 @@ struct GetCoreT<TemplateCast<To,CompoundExpr>> { using Core_T = To; };
 template <typename Cond, typename TBranch, typename FBranch>
 struct GetCoreT<TernaryCond<Cond,TBranch,FBranch>> { using Core_T = typename GetCoreT<TBranch>::Core_T; };
 
+///
+/// True if T is one of the types in Tuple
+template <typename Tuple, typename T>
+struct TupleContains { };
+
+template <typename T, typename...Ts>
+struct TupleContains<std::tuple<Ts...>,T> {
+  static constexpr bool value = (std::is_same<T,Ts>::value || ...);
+};
+
+///
+/// Append the types of Tuple1 that aren't already in Tuple0
+template <typename Tuple0, typename Tuple1>
+struct UniqueTupleCat { };
+
+template <typename Tuple0>
+struct UniqueTupleCat<Tuple0,std::tuple<>> { using type = Tuple0; };
+
+template <typename...Ts, typename T, typename...Us>
+struct UniqueTupleCat<std::tuple<Ts...>,std::tuple<T,Us...>> {
+  using type = typename UniqueTupleCat<typename std::conditional<TupleContains<std::tuple<Ts...>,T>::value,
+								  std::tuple<Ts...>, 
+								  std::tuple<Ts...,T>>::type,
+				       std::tuple<Us...>>::type;
+};
+
+///
+/// The unique Iters used within a compound expression, in the order they first appear.
+/// Unspecialized template has no Iters
+template <typename T>
+struct ExprIters { using type = std::tuple<>; };
+
+///
+/// The unique Iters used within all of Ts
+template <typename...Ts>
+struct ExprItersOf { using type = std::tuple<>; };
+
+template <typename T, typename...Ts>
+struct ExprItersOf<T,Ts...> {
+  using type = typename UniqueTupleCat<typename ExprIters<T>::type,
+				       typename ExprItersOf<Ts...>::type>::type;
+};
+
+template <char C>
+struct ExprIters<Iter<C>> { using type = std::tuple<Iter<C>>; };
+
+template <typename BlockLike, typename...Idxs>
+struct ExprIters<Ref<BlockLike,std::tuple<Idxs...>>> { using type = typename ExprItersOf<Idxs...>::type; };
+
+template <typename Functor, typename CompoundExpr>
+struct ExprIters<Unary<Functor,CompoundExpr>> { using type = typename ExprIters<CompoundExpr>::type; };
+
+template <typename Functor, typename CompoundExpr0, typename CompoundExpr1>
+struct ExprIters<Binary<Functor,CompoundExpr0,CompoundExpr1>> { 
+  using type = typename ExprItersOf<CompoundExpr0,CompoundExpr1>::type;
+};
+
+template <typename To, typename CompoundExpr>
+struct ExprIters<TemplateCast<To,CompoundExpr>> { using type = typename ExprIters<CompoundExpr>::type; };
+
+template <typename Cond, typename TBranch, typename FBranch>
+struct ExprIters<TernaryCond<Cond,TBranch,FBranch>> { 
+  using type = typename ExprItersOf<Cond,TBranch,FBranch>::type;
+};
+
+///
+/// The extent of an Iter, taken from where it's used directly as an index. known is the
+/// extent if it's known during staging.
+struct IterExtent {
+  dvar<loop_type> extent;
+  loop_type known = not_static;
+};
+
 ///
 /// Represents a compound expression. This class just implements the overloads, but all the realization
 /// and such happens in the derived classes.
@@ -266,6 +342,11 @@ struct Iter : public Expr<Iter<Ident>> {
     return iters[idx];
   }
 
+  ///
+  /// An Iter alone doesn't know its extent
+  template <char C>
+  bool iter_extent(IterExtent &extent) { return false; }
+
 private:
 
   ///
@@ -292,6 +373,38 @@ struct TemplateCast : public Expr<TemplateCast<To,CompoundExpr>> {
   template <typename LhsIdxs, unsigned long N>
   dvar<To> realize(const LhsIdxs &lhs_idxs, const darr<loop_type,N> &iters);
 
+  ///
+  /// Set extent to the extent of Iter C if it's used directly as an index within this expression
+  template <char C>
+  bool iter_extent(IterExtent &extent);
+
+private:
+
+  CompoundExpr compound_expr;
+
+};
+
+///
+/// A unary operation on a compound expression.
+template <typename Functor, typename CompoundExpr>
+struct Unary : public Expr<Unary<Functor,CompoundExpr>> {
+
+  /// 
+  /// The core type
+  using Core_T = typename GetCoreT<CompoundExpr>::Core_T;
+
+  Unary(const CompoundExpr &compound_expr) : compound_expr(compound_expr) { }
+
+  ///
+  /// Realize the operation on the compound expression
+  template <typename LhsIdxs, unsigned long N>
+  dvar<Core_T> realize(const LhsIdxs &lhs_idxs, const darr<loop_type,N> &iters);
+
+  ///
+  /// Set extent to the extent of Iter C if it's used directly as an index within this expression
+  template <char C>
+  bool iter_extent(IterExtent &extent);
+
 private:
 
   CompoundExpr compound_expr;
@@ -318,6 +431,11 @@ struct TernaryCond : public Expr<TernaryCond<Cond,TBranch,FBranch>> {
   template <typename LhsIdxs, unsigned long N>
   dvar<Core_T> realize(const LhsIdxs &lhs_idxs, const darr<loop_type,N> &iters);
 
+  ///
+  /// Set extent to the extent of Iter C if it's used directly as an index within this expression
+  template <char C>
+  bool iter_extent(IterExtent &extent);
+
   Cond cond;
   TBranch tbranch;
   FBranch fbranch;
@@ -357,6 +475,11 @@ struct Binary : public Expr<Binary<Functor, CompoundExpr0, CompoundExpr1>> {
   /// Iter) since the Iter wouldn't exist.
   operator dvar<Core_T>();
 
+  ///
+  /// Set extent to the extent of Iter C if it's used directly as an index within this expression
+  template <char C>
+  bool iter_extent(IterExtent &extent);
+
 private:
   
   CompoundExpr0 compound_expr0;
@@ -635,6 +758,54 @@ dvar<typename GetCoreT<CompoundExpr0>::Core_T> Binary<Functor,CompoundExpr0,Comp
   }
 }
 
+template <typename Functor, typename CompoundExpr>
+template <typename LhsIdxs, unsigned long N>
+dvar<typename GetCoreT<CompoundExpr>::Core_T> Unary<Functor,CompoundExpr>::realize(const LhsIdxs &lhs_idxs, 
+										 const darr<loop_type,N> &iters) {
+  if constexpr (std::is_fundamental<CompoundExpr>::value) {
+    return Functor()(compound_expr);
+  } else {
+    dvar<Core_T> op = dispatch_realize(compound_expr, lhs_idxs, iters);
+    return Functor()(op);
+  }
+}
+
+///
+/// Look for the extent of Iter C within an Expr, or return false if not an Expr.
+template <char C, typename T>
+bool dispatch_iter_extent(T &to_search, IterExtent &extent) {
+  if constexpr (is_expr<T>::value) {
+    return to_search.template iter_extent<C>(extent);
+  } else {
+    return false;
+  }
+}
+
+template <typename Functor, typename CompoundExpr0, typename CompoundExpr1>
+template <char C>
+bool Binary<Functor,CompoundExpr0,CompoundExpr1>::iter_extent(IterExtent &extent) {
+  return dispatch_iter_extent<C>(compound_expr0, extent) || dispatch_iter_extent<C>(compound_expr1, extent);
+}
+
+template <typename Functor, typename CompoundExpr>
+template <char C>
+bool Unary<Functor,CompoundExpr>::iter_extent(IterExtent &extent) {
+  return dispatch_iter_extent<C>(compound_expr, extent);
+}
+
+template <typename To, typename CompoundExpr>
+template <char C>
+bool TemplateCast<To,CompoundExpr>::iter_extent(IterExtent &extent) {
+  return dispatch_iter_extent<C>(compound_expr, extent);
+}
+
+template <typename Cond, typename TBranch, typename FBranch>
+template <char C>
+bool TernaryCond<Cond,TBranch,FBranch>::iter_extent(IterExtent &extent) {
+  return dispatch_iter_extent<C>(cond, extent) || dispatch_iter_extent<C>(tbranch, extent) ||
+    dispatch_iter_extent<C>(fbranch, extent);
+}
+
 ///
 /// Unspecialized functor for calling the appropriate external cast operation 
 template <typename To, typename From>
@@ -792,4 +963,451 @@ constexpr int Iter<Ident>::find_iter_idx() {
   return idx;
 }
 
+///
+/// Absolute value of either a compound expression or a value
+template <typename T>
+auto habs(T val) {
+  if constexpr (is_expr<T>::value) {
+    return Unary<AbsFunctor,T>(val);
+  } else {
+    return abs_wrapper(val);
+  }
+}
+
+///
+/// The part of extent d that's a multiple of Lanes, i.e. the bound of the loop that spreads
+/// iterations across the lanes of a reduction
+template <int Lanes, unsigned long Rank>
+LoopBound_T lanes_extent(const LocParam<Rank> &extents, int d) {
+  if (extents.known[d] != not_static) {
+    return (LoopBound_T)(extents.known[d] / Lanes * Lanes);
+  }
+  return extents.loc[d] / Lanes * Lanes;
+}
+
+///
+/// Reduces a compound expression over all the Iters used within it, i.e.
+/// dvar<int> s = sum(habs(orig[y][x] - pred[y][x]));
+/// The extent of each Iter comes from the first Ref that uses it directly as an index.
+/// The innermost loop accumulates into Lanes independent partial results, which are combined
+/// with a tree at the end, so consecutive iterations don't form a serial dependency chain.
+/// This changes the order of operations, so it's only exact for integral types.
+/// If CheckEvery > 0, the reduction stops early once the partial result exceeds a threshold
+/// (see sum_until).
+template <typename Functor, typename CompoundExpr, int Lanes, int CheckEvery=0>
+struct Reduction {
+
+  ///
+  /// The core type
+  using Core_T = typename GetCoreT<CompoundExpr>::Core_T;
+
+  ///
+  /// The Iters to loop over, outermost first
+  using Iters_T = typename ExprIters<CompoundExpr>::type;
+
+  static constexpr unsigned long Rank_T = std::tuple_size<Iters_T>::value;
+
+  static_assert(Rank_T > 0, "A reduction needs at least one Iter");
+  static_assert(Lanes > 0, "A reduction needs at least one lane");
+  static_assert(CheckEvery == 0 || Rank_T > 1, "An early exit needs an outer Iter to check between");
+
+  ///
+  /// init is the identity of Functor
+  Reduction(const CompoundExpr &compound_expr, Core_T init, const dvar<Core_T> *threshold=nullptr) :
+    compound_expr(compound_expr), init(init), threshold(threshold) { }
+
+  ///
+  /// Generate the loops for the reduction
+  operator dvar<Core_T>();
+
+private:
+
+  ///
+  /// Find the extent of each Iter
+  template <int Depth>
+  void find_extents(LocParam<Rank_T> &extents);
+
+  ///
+  /// Create the loop for the Iter at Depth and continue the loop nest within it
+  template <int Depth, typename...LoopVars>
+  void realize_loop_nest(darr<Core_T,Lanes> &lanes, const LocParam<Rank_T> &extents, LoopVars...vars);
+
+  ///
+  /// Accumulate a single point into acc
+  template <typename...LoopVars>
+  void accumulate(dvar<Core_T> &acc, LoopVars...vars);
+
+  ///
+  /// Combine lanes [Begin,End) with a tree
+  template <int Begin, int End>
+  dvar<Core_T> combine_lanes(darr<Core_T,Lanes> &lanes);
+
+  CompoundExpr compound_expr;
+  Core_T init;
+  const dvar<Core_T> *threshold;
+
+};
+
+///
+/// Sum compound_expr over its Iters
+template <int Lanes=4, typename CompoundExpr>
+Reduction<AddFunctor,CompoundExpr,Lanes> sum(CompoundExpr compound_expr) {
+  using Core_T = typename GetCoreT<CompoundExpr>::Core_T;
+  return {compound_expr, Core_T(0)};
+}
+
+///
+/// Sum compound_expr over its Iters, but stop once the partial sum exceeds threshold, i.e.
+/// dvar<int> s = sum_until<4>(habs(orig[y][x] - pred[y][x]), best);
+/// The partial sum is checked after every CheckEvery iterations of the outermost Iter (every
+/// CheckEvery rows of a 2D block), so the granularity is fixed during staging and the inner
+/// loops stay free of branches. A result > threshold may only be a partial sum. For nonnegative
+/// summands, it's still a lower bound, so it loses any comparison against threshold.
+/// threshold must outlive the conversion of the result to a dvar.
+template <int CheckEvery=1, int Lanes=4, typename CompoundExpr>
+Reduction<AddFunctor,CompoundExpr,Lanes,CheckEvery> sum_until(CompoundExpr compound_expr, 
+							      const dvar<typename GetCoreT<CompoundExpr>::Core_T> &threshold) {
+  static_assert(CheckEvery > 0, "Must check the partial sum at least every CheckEvery > 0 rows");
+  using Core_T = typename GetCoreT<CompoundExpr>::Core_T;
+  return {compound_expr, Core_T(0), &threshold};
+}
+
+///
+/// Minimum of compound_expr over its Iters
+template <int Lanes=4, typename CompoundExpr>
+Reduction<MinFunctor,CompoundExpr,Lanes> min(CompoundExpr compound_expr) {
+  using Core_T = typename GetCoreT<CompoundExpr>::Core_T;
+  return {compound_expr, std::numeric_limits<Core_T>::max()};
+}
+
+///
+/// Maximum of compound_expr over its Iters
+template <int Lanes=4, typename CompoundExpr>
+Reduction<MaxFunctor,CompoundExpr,Lanes> max(CompoundExpr compound_expr) {
+  using Core_T = typename GetCoreT<CompoundExpr>::Core_T;
+  return {compound_expr, std::numeric_limits<Core_T>::lowest()};
+}
+
+template <typename Functor, typename CompoundExpr, int Lanes, int CheckEvery>
+Reduction<Functor,CompoundExpr,Lanes,CheckEvery>::operator dvar<typename GetCoreT<CompoundExpr>::Core_T>() {
+  LocParam<Rank_T> extents;
+  find_extents<0>(extents);
+  darr<Core_T,Lanes> lanes;
+  for (svar<int> l = 0; l < Lanes; l=l+1) {
+    lanes[l] = init;
+  }
+  realize_loop_nest<0>(lanes, extents);
+  return combine_lanes<0,Lanes>(lanes);
+}
+
+template <typename Functor, typename CompoundExpr, int Lanes, int CheckEvery>
+template <int Depth>
+void Reduction<Functor,CompoundExpr,Lanes,CheckEvery>::find_extents(LocParam<Rank_T> &extents) {
+  if constexpr (Depth < (int)Rank_T) {
+    using I = typename std::tuple_element<Depth,Iters_T>::type;
+    IterExtent extent;
+    if (!compound_expr.template iter_extent<I::Ident_T>(extent)) {
+      std::cerr << "Cannot find the extent of Iter '" << I::Ident_T << "' in a reduction. " << 
+	"It must be used directly as an index somewhere." << std::endl;
+      exit(-1);
+    }
+    extents.loc[Depth] = extent.extent;
+    extents.known[Depth] = extent.known;
+    find_extents<Depth+1>(extents);
+  }
+}
+
+template <typename Functor, typename CompoundExpr, int Lanes, int CheckEvery>
+template <int Depth, typename...LoopVars>
+void Reduction<Functor,CompoundExpr,Lanes,CheckEvery>::realize_loop_nest(darr<Core_T,Lanes> &lanes, 
+									 const LocParam<Rank_T> &extents,
+									 LoopVars...vars) {
+  if constexpr (Depth == 0 && CheckEvery > 0) {
+    // stop after the first group of rows that takes the partial result past the threshold
+    dvar<bool> exceeded = false;
+    for (dvar<loop_type> iter = 0; iter < extents.at(Depth) && !exceeded; iter = iter + 1) {
+      realize_loop_nest<Depth+1>(lanes, extents, vars..., iter);
+      if constexpr (CheckEvery == 1) {
+	exceeded = combine_lanes<0,Lanes>(lanes) > *threshold;
+      } else {
+	if ((iter + 1) % CheckEvery == 0) {
+	  exceeded = combine_lanes<0,Lanes>(lanes) > *threshold;
+	}
+      }
+    }
+  } else if constexpr (Depth < (int)Rank_T - 1) {
+    for (dvar<loop_type> iter = 0; iter < extents.at(Depth); iter = iter + 1) {
+      realize_loop_nest<Depth+1>(lanes, extents, vars..., iter);
+    }
+  } else if constexpr (Lanes == 1) {
+    for (dvar<loop_type> iter = 0; iter < extents.at(Depth); iter = iter + 1) {
+      accumulate(lanes[0], vars..., iter);
+    }
+  } else {
+    // each lane gets every Lanes'th iteration, then the remainder goes to the first lane
+    for (dvar<loop_type> iter = 0; iter < lanes_extent<Lanes>(extents, Depth); iter = iter + Lanes) {
+      for (svar<int> l = 0; l < Lanes; l=l+1) {
+	dvar<loop_type> liter = iter + l;
+	accumulate(lanes[l], vars..., liter);
+      }
+    }
+    for (dvar<loop_type> iter = lanes_extent<Lanes>(extents, Depth); iter < extents.at(Depth); iter = iter + 1) {
+      accumulate(lanes[0], vars..., iter);
+    }
+  }
+}
+
+template <typename Functor, typename CompoundExpr, int Lanes, int CheckEvery>
+template <typename...LoopVars>
+void Reduction<Functor,CompoundExpr,Lanes,CheckEvery>::accumulate(dvar<Core_T> &acc, LoopVars...vars) {
+  darr<loop_type,Rank_T> iters{vars...};
+  dvar<Core_T> val = dispatch_realize(compound_expr, Iters_T(), iters);
+  acc = Functor()(acc, val);
+}
+
+template <typename Functor, typename CompoundExpr, int Lanes, int CheckEvery>
+template <int Begin, int End>
+dvar<typename GetCoreT<CompoundExpr>::Core_T> Reduction<Functor,CompoundExpr,Lanes,CheckEvery>::combine_lanes(darr<Core_T,Lanes> &lanes) {
+  if constexpr (End - Begin == 1) {
+    return lanes[Begin];
+  } else {
+    constexpr int mid = (Begin + End) / 2;
+    dvar<Core_T> lhs = combine_lanes<Begin,mid>(lanes);
+    dvar<Core_T> rhs = combine_lanes<mid,End>(lanes);
+    return Functor()(lhs, rhs);
+  }
+}
+
+///
+/// Reduces several compound expressions over the same Iters within a single loop nest, so
+/// anything they read in common is only loaded once per point. The loop nest comes from the
+/// Iters of the first expression, and the others can't use any Iters beyond those. Each
+/// expression gets its own Lanes partial results, like with Reduction.
+template <typename Functor, int Lanes, typename...CompoundExprs>
+struct MultiReduction {
+
+  static constexpr int N = sizeof...(CompoundExprs);
+
+  static_assert(N > 0, "A reduction needs at least one expression");
+  static_assert(Lanes > 0, "A reduction needs at least one lane");
+
+  using First_T = typename std::tuple_element<0,std::tuple<CompoundExprs...>>::type;
+
+  ///
+  /// The core type
+  using Core_T = typename GetCoreT<First_T>::Core_T;
+
+  ///
+  /// The Iters to loop over, outermost first
+  using Iters_T = typename ExprIters<First_T>::type;
+
+  static constexpr unsigned long Rank_T = std::tuple_size<Iters_T>::value;
+
+  static_assert(Rank_T > 0, "A reduction needs at least one Iter");
+  static_assert((std::is_same<Core_T,typename GetCoreT<CompoundExprs>::Core_T>::value && ...),
+		"Every expression in a multi-reduction must have the same core type");
+
+  ///
+  /// init is the identity of Functor
+  MultiReduction(const std::tuple<CompoundExprs...> &compound_exprs, Core_T init) : 
+    compound_exprs(compound_exprs), init(init) { }
+
+  ///
+  /// Generate the loops for the reduction, putting the result of the k'th expression in results[k]
+  template <unsigned long M>
+  void realize(darr<Core_T,M> &results);
+
+private:
+
+  ///
+  /// Find the extent of each Iter
+  template <int Depth>
+  void find_extents(LocParam<Rank_T> &extents);
+
+  ///
+  /// Find the extent of Iter C from the first expression, starting at K, that uses it directly
+  template <char C, int K>
+  bool find_extent(IterExtent &extent);
+
+  ///
+  /// Create the loop for the Iter at Depth and continue the loop nest within it
+  template <int Depth, typename...LoopVars>
+  void realize_loop_nest(darr<Core_T,N*Lanes> &lanes, const LocParam<Rank_T> &extents, LoopVars...vars);
+
+  ///
+  /// Accumulate a single point of each expression into its lane
+  template <int K, typename...LoopVars>
+  void accumulate(darr<Core_T,N*Lanes> &lanes, int lane, LoopVars...vars);
+
+  ///
+  /// Combine lanes [Begin,End) with a tree
+  template <int Begin, int End>
+  dvar<Core_T> combine_lanes(darr<Core_T,N*Lanes> &lanes);
+
+  ///
+  /// Combine the lanes of expressions [K,N) into their results. The lanes of expression k
+  /// are [k*Lanes,(k+1)*Lanes).
+  template <int K, unsigned long M>
+  void combine_each(darr<Core_T,N*Lanes> &lanes, darr<Core_T,M> &results);
+
+  std::tuple<CompoundExprs...> compound_exprs;
+  Core_T init;
+
+};
+
+///
+/// Sum each compound expression over the same Iters in a single loop nest, i.e.
+/// darr<int,2> costs;
+/// sum_each(costs, habs(orig[y][x] - top[x]), habs(orig[y][x] - left[y]));
+/// costs[0] and costs[1] are the sums of the first and second expressions.
+template <int Lanes=4, typename Core, unsigned long M, typename...CompoundExprs>
+void sum_each(darr<Core,M> &results, CompoundExprs...compound_exprs) {
+  static_assert(M == sizeof...(CompoundExprs), "Need a result for each expression");
+  MultiReduction<AddFunctor,Lanes,CompoundExprs...> reduction{std::make_tuple(compound_exprs...), Core(0)};
+  reduction.realize(results);
+}
+
+template <typename Functor, int Lanes, typename...CompoundExprs>
+template <unsigned long M>
+void MultiReduction<Functor,Lanes,CompoundExprs...>::realize(darr<Core_T,M> &results) {
+  LocParam<Rank_T> extents;
+  find_extents<0>(extents);
+  darr<Core_T,N*Lanes> lanes;
+  for (svar<int> l = 0; l < N*Lanes; l=l+1) {
+    lanes[l] = init;
+  }
+  realize_loop_nest<0>(lanes, extents);
+  combine_each<0>(lanes, results);
+}
+
+template <typename Functor, int Lanes, typename...CompoundExprs>
+template <int K, unsigned long M>
+void MultiReduction<Functor,Lanes,CompoundExprs...>::combine_each(darr<Core_T,N*Lanes> &lanes, 
+								  darr<Core_T,M> &results) {
+  if constexpr (K < N) {
+    results[K] = combine_lanes<K*Lanes,(K+1)*Lanes>(lanes);
+    combine_each<K+1>(lanes, results);
+  }
+}
+
+template <typename Functor, int Lanes, typename...CompoundExprs>
+template <int Depth>
+void MultiReduction<Functor,Lanes,CompoundExprs...>::find_extents(LocParam<Rank_T> &extents) {
+  if constexpr (Depth < (int)Rank_T) {
+    using I = typename std::tuple_element<Depth,Iters_T>::type;
+    IterExtent extent;
+    if (!find_extent<I::Ident_T,0>(extent)) {
+      std::cerr << "Cannot find the extent of Iter '" << I::Ident_T << "' in a reduction. " << 
+	"It must be used directly as an index somewhere." << std::endl;
+      exit(-1);
+    }
+    extents.loc[Depth] = extent.extent;
+    extents.known[Depth] = extent.known;
+    find_extents<Depth+1>(extents);
+  }
+}
+
+template <typename Functor, int Lanes, typename...CompoundExprs>
+template <char C, int K>
+bool MultiReduction<Functor,Lanes,CompoundExprs...>::find_extent(IterExtent &extent) {
+  if constexpr (K < N) {
+    if (std::get<K>(compound_exprs).template iter_extent<C>(extent)) {
+      return true;
+    }
+    return find_extent<C,K+1>(extent);
+  } else {
+    return false;
+  }
+}
+
+template <typename Functor, int Lanes, typename...CompoundExprs>
+template <int Depth, typename...LoopVars>
+void MultiReduction<Functor,Lanes,CompoundExprs...>::realize_loop_nest(darr<Core_T,N*Lanes> &lanes, 
+								       const LocParam<Rank_T> &extents,
+								       LoopVars...vars) {
+  if constexpr (Depth < (int)Rank_T - 1) {
+    for (dvar<loop_type> iter = 0; iter < extents.at(Depth); iter = iter + 1) {
+      realize_loop_nest<Depth+1>(lanes, extents, vars..., iter);
+    }
+  } else if constexpr (Lanes == 1) {
+    for (dvar<loop_type> iter = 0; iter < extents.at(Depth); iter = iter + 1) {
+      accumulate<0>(lanes, 0, vars..., iter);
+    }
+  } else {
+    // same split as Reduction, but for every expression at once
+    for (dvar<loop_type> iter = 0; iter < lanes_extent<Lanes>(extents, Depth); iter = iter + Lanes) {
+      for (svar<int> l = 0; l < Lanes; l=l+1) {
+	dvar<loop_type> liter = iter + l;
+	accumulate<0>(lanes, l, vars..., liter);
+      }
+    }
+    for (dvar<loop_type> iter = lanes_extent<Lanes>(extents, Depth); iter < extents.at(Depth); iter = iter + 1) {
+      accumulate<0>(lanes, 0, vars..., iter);
+    }
+  }
+}
+
+template <typename Functor, int Lanes, typename...CompoundExprs>
+template <int K, typename...LoopVars>
+void MultiReduction<Functor,Lanes,CompoundExprs...>::accumulate(darr<Core_T,N*Lanes> &lanes, int lane,
+								LoopVars...vars) {
+  if constexpr (K < N) {
+    darr<loop_type,Rank_T> iters{vars...};
+    dvar<Core_T> val = dispatch_realize(std::get<K>(compound_exprs), Iters_T(), iters);
+    lanes[K*Lanes+lane] = Functor()(lanes[K*Lanes+lane], val);
+    accumulate<K+1>(lanes, lane, vars...);
+  }
+}
+
+template <typename Functor, int Lanes, typename...CompoundExprs>
+template <int Begin, int End>
+dvar<typename MultiReduction<Functor,Lanes,CompoundExprs...>::Core_T> 
+MultiReduction<Functor,Lanes,CompoundExprs...>::combine_lanes(darr<Core_T,N*Lanes> &lanes) {
+  if constexpr (End - Begin == 1) {
+    return lanes[Begin];
+  } else {
+    constexpr int mid = (Begin + End) / 2;
+    dvar<Core_T> lhs = combine_lanes<Begin,mid>(lanes);
+    dvar<Core_T> rhs = combine_lanes<mid,End>(lanes);
+    return Functor()(lhs, rhs);
+  }
+}
+
+///
+/// Helper for argmin. Select the smallest of vals[Begin,End) with a tree.
+template <int Begin, int End, typename Idx, typename Val, unsigned long N>
+void argmin_tree(darr<Val,N> &vals, dvar<Idx> &best_idx, dvar<Val> &best_val) {
+  if constexpr (End - Begin == 1) {
+    best_idx = Begin;
+    best_val = vals[Begin];
+  } else {
+    constexpr int mid = (Begin + End) / 2;
+    dvar<Idx> lidx;
+    dvar<Val> lval;
+    argmin_tree<Begin,mid>(vals, lidx, lval);
+    dvar<Idx> ridx;
+    dvar<Val> rval;
+    argmin_tree<mid,End>(vals, ridx, rval);
+    // the right half only wins if it's strictly smaller, so ties go to the smaller index
+    dvar<bool> take_right = rval < lval;
+    best_idx = ternary_cond_wrapper(take_right, ridx, lidx);
+    best_val = ternary_cond_wrapper(take_right, rval, lval);
+  }
+}
+
+///
+/// Find the index and value of the smallest of N candidates, i.e.
+/// argmin<4>(best_mode, best_cost, [&](int mode) -> dvar<int> { ...return the cost of mode... });
+/// cost is called for each candidate in order during staging. Ties go to the smaller index, like
+/// a sequential scan with <, but the comparisons form a tree.
+template <int N, typename Idx, typename Val, typename Func>
+void argmin(dvar<Idx> &best_idx, dvar<Val> &best_val, Func cost) {
+  static_assert(N > 0, "argmin needs at least one candidate");
+  darr<Val,N> vals;
+  for (svar<int> k = 0; k < N; k=k+1) {
+    vals[k] = cost(k);
+  }
+  argmin_tree<0,N>(vals, best_idx, best_val);
+}
+
 }
@@ -2,8 +2,58 @@
 
 #pragma once
 
+#include <type_traits>
+#include "fwrappers.h"
+
 namespace shim {
 
+///
+/// The type an operand of a functor holds, i.e. T for a dyn_var<T>
+template <typename T>
+struct OperandT { using type = T; };
+
+#ifndef UNSTAGED
+template <typename T>
+struct OperandT<builder::dyn_var<T>> { using type = T; };
+#endif
+
+///
+/// The type to take the min or max of two operands in. That's the type of the dyn_var, if
+/// either is one, since a literal converts to it.
+template <typename T, typename U>
+using MinMaxT = typename std::conditional<std::is_fundamental<T>::value,
+					  typename OperandT<U>::type, typename OperandT<T>::type>::type;
+
+#ifndef UNSTAGED
+// calls the min and max wrappers for dtype
+#define DISPATCH_MIN_MAX(dtype)						\
+  template <>								\
+  struct DispatchMinMax<dtype> {					\
+    template <typename T, typename U>					\
+    auto min(T op0, U op1) {						\
+      return min_##dtype(op0, op1);					\
+    }									\
+    template <typename T, typename U>					\
+    auto max(T op0, U op1) {						\
+      return max_##dtype(op0, op1);					\
+    }									\
+  }
+
+template <typename Elem>
+struct DispatchMinMax { };
+DISPATCH_MIN_MAX(uint8_t);
+DISPATCH_MIN_MAX(uint16_t);
+DISPATCH_MIN_MAX(uint32_t);
+DISPATCH_MIN_MAX(uint64_t);
+DISPATCH_MIN_MAX(char);
+DISPATCH_MIN_MAX(int8_t);
+DISPATCH_MIN_MAX(int16_t);
+DISPATCH_MIN_MAX(int32_t);
+DISPATCH_MIN_MAX(int64_t);
+DISPATCH_MIN_MAX(float);
+DISPATCH_MIN_MAX(double);
+#endif
+
 // These functors are completely generic so they can work with fundamentals, exprs, and dyn_vars
 
 ///
@@ -33,6 +83,41 @@ struct NegateFunctor {
   }
 };
 
+///
+/// Absolute value
+struct AbsFunctor {
+  template <typename T>
+  auto operator()(const T op) {
+    return abs_wrapper(op);
+  }
+};
+
+///
+/// Minimum
+struct MinFunctor {
+  template <typename T, typename U>
+  auto operator()(const T op0, const U op1) {
+#ifndef UNSTAGED
+    return DispatchMinMax<MinMaxT<T,U>>().min(op0, op1);
+#else
+    return hmin<MinMaxT<T,U>>(op0, op1);
+#endif
+  }
+};
+
+///
+/// Maximum
+struct MaxFunctor {
+  template <typename T, typename U>
+  auto operator()(const T op0, const U op1) {
+#ifndef UNSTAGED
+    return DispatchMinMax<MinMaxT<T,U>>().max(op0, op1);
+#else
+    return hmax<MinMaxT<T,U>>(op0, op1);
+#endif
+  }
+};
+
 ///
 /// Addition
 struct AddFunctor {
@@ -0,0 +1,192 @@
+// -*-c++-*-
+
+#pragma once
+
+#include <array>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "defs.h"
+#include "fwddecls.h"
+#include "annotations.h"
+
+namespace shim {
+
+///
+/// The shared loop nest body of a group of fused inline statements. This is passed
+/// as the rhs of the first statement in the group, and runs every statement's body
+/// at each point of the shared iteration space.
+template <unsigned long Rank>
+struct FusedBody {
+
+  using Body_T = std::function<void(const darr<loop_type,Rank>&)>;
+
+  const std::vector<Body_T> *bodies;
+
+  void operator()(const darr<loop_type,Rank> &iters) const {
+    for (auto &body : *bodies) {
+      body(iters);
+    }
+  }
+
+};
+
+template <typename T>
+struct is_fused_body { static constexpr bool value = false; };
+
+template <unsigned long Rank>
+struct is_fused_body<FusedBody<Rank>> { static constexpr bool value = true; };
+
+///
+/// Type-erased group of fused inline statements
+struct FusedGroupBase {
+
+  virtual ~FusedGroupBase() = default;
+
+  ///
+  /// Generate the code for all the statements in this group
+  virtual void flush(const OptList &opts) = 0;
+
+};
+
+///
+/// Consecutive inline statements that write the same rank with Iters in the same
+/// dimensions. These can share a single loop nest.
+template <unsigned long Rank>
+struct FusedGroup : FusedGroupBase {
+
+  using Mask_T = std::array<bool,Rank>;
+
+  ///
+  /// Which dims of the lhs are indexed by an Iter
+  Mask_T mask;
+
+  ///
+  /// Builds the loop nest of the first statement around a FusedBody
+  std::function<void(const OptList&, FusedBody<Rank>)> realize;
+
+  ///
+  /// Each statement's work at a single point of the shared loop nest
+  std::vector<typename FusedBody<Rank>::Body_T> bodies;
+
+  ///
+  /// Each statement on its own, for when the extents don't match
+  std::vector<std::function<void(const OptList&)>> standalones;
+
+  ///
+  /// The extents of each statement's lhs
+  std::vector<std::function<Loc_T<Rank>()>> extents;
+
+  explicit FusedGroup(Mask_T mask) : mask(mask) { }
+
+  void flush(const OptList &opts) override {
+    if (bodies.size() == 1) {
+      standalones[0](opts);
+      return;
+    }
+    // the extents are only known at runtime, so only use the fused nest if they match
+    // in the dims being iterated over
+    Loc_T<Rank> first = extents[0]();
+    dvar<bool> same = true;
+    for (size_t s = 1; s < extents.size(); s++) {
+      Loc_T<Rank> ext = extents[s]();
+      for (int d = 0; d < (int)Rank; d++) {
+	if (mask[d]) {
+	  same = same && first[d] == ext[d];
+	}
+      }
+    }
+    if (same) {
+      realize(opts, FusedBody<Rank>{&bodies});
+    } else {
+      for (auto &standalone : standalones) {
+	standalone(opts);
+      }
+    }
+  }
+
+};
+
+///
+/// Collects the inline statements within a call to fuse
+struct FusionRegion {
+
+  ///
+  /// The region currently being staged, if any
+  inline static FusionRegion *active = nullptr;
+
+  ///
+  /// The optimizations requested for the region. These apply to every loop nest
+  /// generated from it.
+  OptList opts;
+
+  ///
+  /// The statements that haven't been generated yet
+  std::unique_ptr<FusedGroupBase> group;
+
+  FusionRegion() {
+    if (FusionRegion::active) {
+      std::cerr << "Fused regions cannot be nested" << std::endl;
+      exit(-1);
+    }
+    opts = Optimization::consume();
+    FusionRegion::active = this;
+  }
+
+  ~FusionRegion() {
+    if (FusionRegion::active == this) {
+      FusionRegion::active = nullptr;
+    }
+  }
+
+  ///
+  /// Generate the code for the pending group, if any
+  void flush() {
+    if (group) {
+      std::unique_ptr<FusedGroupBase> pending = std::move(group);
+      pending->flush(opts);
+    }
+  }
+
+  ///
+  /// The pending group if it can take a statement with the given mask. Otherwise, flush
+  /// the pending group and start a new one.
+  template <unsigned long Rank>
+  FusedGroup<Rank> &group_for(const typename FusedGroup<Rank>::Mask_T &mask) {
+    auto fused = dynamic_cast<FusedGroup<Rank>*>(group.get());
+    if (!fused || fused->mask != mask) {
+      flush();
+      group = std::make_unique<FusedGroup<Rank>>(mask);
+      fused = static_cast<FusedGroup<Rank>*>(group.get());
+    }
+    return *fused;
+  }
+
+};
+
+///
+/// Fuse the loop nests of consecutive compatible inline statements staged within func, i.e.
+/// fuse([&]() {
+///   YCbCr[0][i][j] = RGB[0][i][j] * ...;
+///   YCbCr[1][i][j] = RGB[0][i][j] * ...;
+/// }); // one i loop and one j loop computing both statements
+/// Statements are compatible if their lhs have the same rank, have Iters in the same dims,
+/// and have the same extents in those dims. The extents are checked at runtime, falling
+/// back to the unfused nests.
+/// Like with Parallel, the user promises that fusing is legal: no statement may read
+/// a value written by an earlier statement in the region at a different point.
+/// Optimizations requested before fuse apply to each of the loop nests generated. Other
+/// staged code within func runs when it's reached, so it should not depend on the inline
+/// statements in the region.
+template <typename Func>
+void fuse(Func func) {
+  FusionRegion region;
+  func();
+  FusionRegion::active = nullptr;
+  region.flush();
+}
+
+}
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <limits>
 #include "builder/array.h"
 #include "defs.h"
 
@@ -82,6 +83,10 @@ CONSTEXPR_HEAP_NAME(int64_t);
 CONSTEXPR_HEAP_NAME(float);
 CONSTEXPR_HEAP_NAME(double);
 
+// The guard that frees arena allocations at the end of their scope
+constexpr char arena_scope_name[] = "shim::ArenaScope";
+using ARENA_SCOPE_T = typename builder::name<arena_scope_name>;
+
 // Based on Elem, return the appropriate constexpr char name for HeapArray
 template <typename Elem>
 constexpr auto build_heap_name() {
@@ -92,9 +97,21 @@ constexpr auto build_heap_name() {
 template <typename Elem>
 using HEAP_T = typename builder::name<build_heap_name<Elem>()>;
 #endif
+///
+/// How an arena Block starts out. Overwritten skips zeroing, for Blocks whose first use
+/// writes every element.
+enum struct ArenaInit { Zeroed, Overwritten };
+
 /// The type for location information in blocks and views
 
 template <unsigned long Rank>
 using Loc_T = darr<loop_type,Rank>;
 
+/// The values of location information that are known during staging (see MeshLocation).
+/// Anything only known at runtime is not_static.
+template <unsigned long Rank>
+using Static_T = std::array<loop_type,Rank>;
+
+constexpr loop_type not_static = std::numeric_limits<loop_type>::min();
+
 }
@@ -22,10 +22,38 @@ builder::dyn_var<int(int)> cabs = builder::as_global("abs");
 builder::dyn_var<void(bool,char*)> hassert = builder::as_global("SHIM_ASSERT");
 
 builder::dyn_var<void*(void*,void*,void*)> ternary_cond_wrapper = builder::as_global("TERNARY");
+builder::dyn_var<uint64_t(uint8_t*)> load_be64 = builder::as_global("shim_load_be64");
 
 // Note: the arg tyoe for these casts isn't right, but I don't want to write every combination
 // of dyn_var<to(from)>, and buildit doesn't seem to care.
 #ifndef UNSTAGED
+// hmin and hmax are for loop bounds. Min and max of other values go through the wrapper for
+// their type (see MinFunctor), so the result isn't narrowed to a loop_type.
+builder::dyn_var<loop_type(loop_type,loop_type)> hmin = builder::as_global("SHIM_MIN");
+builder::dyn_var<loop_type(loop_type,loop_type)> hmax = builder::as_global("SHIM_MAX");
+builder::dyn_var<uint8_t(uint8_t,uint8_t)> min_uint8_t = builder::as_global("SHIM_MIN");
+builder::dyn_var<uint16_t(uint16_t,uint16_t)> min_uint16_t = builder::as_global("SHIM_MIN");
+builder::dyn_var<uint32_t(uint32_t,uint32_t)> min_uint32_t = builder::as_global("SHIM_MIN");
+builder::dyn_var<uint64_t(uint64_t,uint64_t)> min_uint64_t = builder::as_global("SHIM_MIN");
+builder::dyn_var<char(char,char)> min_char = builder::as_global("SHIM_MIN");
+builder::dyn_var<int8_t(int8_t,int8_t)> min_int8_t = builder::as_global("SHIM_MIN");
+builder::dyn_var<int16_t(int16_t,int16_t)> min_int16_t = builder::as_global("SHIM_MIN");
+builder::dyn_var<int32_t(int32_t,int32_t)> min_int32_t = builder::as_global("SHIM_MIN");
+builder::dyn_var<int64_t(int64_t,int64_t)> min_int64_t = builder::as_global("SHIM_MIN");
+builder::dyn_var<float(float,float)> min_float = builder::as_global("SHIM_MIN");
+builder::dyn_var<double(double,double)> min_double = builder::as_global("SHIM_MIN");
+builder::dyn_var<uint8_t(uint8_t,uint8_t)> max_uint8_t = builder::as_global("SHIM_MAX");
+builder::dyn_var<uint16_t(uint16_t,uint16_t)> max_uint16_t = builder::as_global("SHIM_MAX");
+builder::dyn_var<uint32_t(uint32_t,uint32_t)> max_uint32_t = builder::as_global("SHIM_MAX");
+builder::dyn_var<uint64_t(uint64_t,uint64_t)> max_uint64_t = builder::as_global("SHIM_MAX");
+builder::dyn_var<char(char,char)> max_char = builder::as_global("SHIM_MAX");
+builder::dyn_var<int8_t(int8_t,int8_t)> max_int8_t = builder::as_global("SHIM_MAX");
+builder::dyn_var<int16_t(int16_t,int16_t)> max_int16_t = builder::as_global("SHIM_MAX");
+builder::dyn_var<int32_t(int32_t,int32_t)> max_int32_t = builder::as_global("SHIM_MAX");
+builder::dyn_var<int64_t(int64_t,int64_t)> max_int64_t = builder::as_global("SHIM_MAX");
+builder::dyn_var<float(float,float)> max_float = builder::as_global("SHIM_MAX");
+builder::dyn_var<double(double,double)> max_double = builder::as_global("SHIM_MAX");
+builder::dyn_var<int(int)> abs_wrapper = builder::as_global("SHIM_ABS");
 builder::dyn_var<uint8_t(uint8_t)> cast_uint8_t = builder::as_global("SHIM_CAST_UINT8_T");
 builder::dyn_var<uint16_t(uint16_t)> cast_uint16_t = builder::as_global("SHIM_CAST_UINT16_T");
 builder::dyn_var<uint32_t(uint32_t)> cast_uint32_t = builder::as_global("SHIM_CAST_UINT32_T");
@@ -39,6 +67,13 @@ builder::dyn_var<float(float)> cast_float = builder::as_global("SHIM_CAST_FLOAT"
 builder::dyn_var<double(double)> cast_double = builder::as_global("SHIM_CAST_DOUBLE");
 #else
 
+template <typename T>
+T hmin(T a, T b) { return a < b ? a : b; }
+template <typename T>
+T hmax(T a, T b) { return a > b ? a : b; }
+template <typename T>
+T abs_wrapper(T a) { return a < 0 ? -a : a; }
+
 template <typename T>
 uint8_t cast_uint8_t(T x) { return (uint8_t)x; }
 template <typename T>
@@ -98,6 +133,18 @@ builder::dyn_var<HEAP_T<int64_t>(loop_type)> build_heaparr_int64_t = builder::as
 builder::dyn_var<HEAP_T<float>(loop_type)> build_heaparr_float = builder::as_global("shim::build_heaparr<float>");
 builder::dyn_var<HEAP_T<double>(loop_type)> build_heaparr_double = builder::as_global("shim::build_heaparr<double>");
 
+builder::dyn_var<uint8_t*(HEAP_T<uint8_t>)> heap_data_uint8_t = builder::as_global("shim::hdata<uint8_t>");
+builder::dyn_var<uint16_t*(HEAP_T<uint16_t>)> heap_data_uint16_t = builder::as_global("shim::hdata<uint16_t>");
+builder::dyn_var<uint32_t*(HEAP_T<uint32_t>)> heap_data_uint32_t = builder::as_global("shim::hdata<uint32_t>");
+builder::dyn_var<uint64_t*(HEAP_T<uint64_t>)> heap_data_uint64_t = builder::as_global("shim::hdata<uint64_t>");
+builder::dyn_var<char*(HEAP_T<char>)> heap_data_char = builder::as_global("shim::hdata<char>");
+builder::dyn_var<int8_t*(HEAP_T<int8_t>)> heap_data_int8_t = builder::as_global("shim::hdata<int8_t>");
+builder::dyn_var<int16_t*(HEAP_T<int16_t>)> heap_data_int16_t = builder::as_global("shim::hdata<int16_t>");
+builder::dyn_var<int32_t*(HEAP_T<int32_t>)> heap_data_int32_t = builder::as_global("shim::hdata<int32_t>");
+builder::dyn_var<int64_t*(HEAP_T<int64_t>)> heap_data_int64_t = builder::as_global("shim::hdata<int64_t>");
+builder::dyn_var<float*(HEAP_T<float>)> heap_data_float = builder::as_global("shim::hdata<float>");
+builder::dyn_var<double*(HEAP_T<double>)> heap_data_double = builder::as_global("shim::hdata<double>");
+
 builder::dyn_var<uint8_t*(loop_type)> build_stackarr_uint8_t = builder::as_global("SHIM_BUILD_STACK_UINT8_T");
 builder::dyn_var<uint16_t*(loop_type)> build_stackarr_uint16_t = builder::as_global("SHIM_BUILD_STACK_UINT16_T");
 builder::dyn_var<uint32_t*(loop_type)> build_stackarr_uint32_t = builder::as_global("SHIM_BUILD_STACK_UINT32_T");
@@ -109,6 +156,20 @@ builder::dyn_var<int32_t*(loop_type)> build_stackarr_int32_t = builder::as_globa
 builder::dyn_var<int64_t*(loop_type)> build_stackarr_int64_t = builder::as_global("SHIM_BUILD_STACK_INT64_T");
 builder::dyn_var<float*(loop_type)> build_stackarr_float = builder::as_global("SHIM_BUILD_STACK_FLOAT");
 builder::dyn_var<double*(loop_type)> build_stackarr_double = builder::as_global("SHIM_BUILD_STACK_DOUBLE");
+
+builder::dyn_var<ARENA_SCOPE_T(void)> build_arena_scope = builder::as_global("shim::arena_scope");
+
+builder::dyn_var<uint8_t*(loop_type,loop_type,bool)> build_arenaarr_uint8_t = builder::as_global("shim::arena_alloc<uint8_t>");
+builder::dyn_var<uint16_t*(loop_type,loop_type,bool)> build_arenaarr_uint16_t = builder::as_global("shim::arena_alloc<uint16_t>");
+builder::dyn_var<uint32_t*(loop_type,loop_type,bool)> build_arenaarr_uint32_t = builder::as_global("shim::arena_alloc<uint32_t>");
+builder::dyn_var<uint64_t*(loop_type,loop_type,bool)> build_arenaarr_uint64_t = builder::as_global("shim::arena_alloc<uint64_t>");
+builder::dyn_var<char*(loop_type,loop_type,bool)> build_arenaarr_char = builder::as_global("shim::arena_alloc<char>");
+builder::dyn_var<int8_t*(loop_type,loop_type,bool)> build_arenaarr_int8_t = builder::as_global("shim::arena_alloc<int8_t>");
+builder::dyn_var<int16_t*(loop_type,loop_type,bool)> build_arenaarr_int16_t = builder::as_global("shim::arena_alloc<int16_t>");
+builder::dyn_var<int32_t*(loop_type,loop_type,bool)> build_arenaarr_int32_t = builder::as_global("shim::arena_alloc<int32_t>");
+builder::dyn_var<int64_t*(loop_type,loop_type,bool)> build_arenaarr_int64_t = builder::as_global("shim::arena_alloc<int64_t>");
+builder::dyn_var<float*(loop_type,loop_type,bool)> build_arenaarr_float = builder::as_global("shim::arena_alloc<float>");
+builder::dyn_var<double*(loop_type,loop_type,bool)> build_arenaarr_double = builder::as_global("shim::arena_alloc<double>");
 #endif
 
 builder::dyn_var<void(uint8_t)> print_elem_uint8_t = builder::as_global("shim::print_elem<uint8_t>");
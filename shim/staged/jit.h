@@ -0,0 +1,131 @@
+// -*-c++-*-
+
+#pragma once
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dlfcn.h>
+#include <unistd.h>
+#include "compile.h"
+#include "cache.h"
+
+namespace shim {
+
+///
+/// How jit builds the generated code
+struct JitOptions {
+
+  ///
+  /// The compiler to use. Defaults to $CXX (or $CC for C), then c++ (or cc). Like with make,
+  /// this is a command rather than a path, so it can be i.e. "ccache g++".
+  static std::string compiler() {
+    const char *env = std::getenv(CompileOptions::isCPP ? "CXX" : "CC");
+    if (env) return env;
+    return CompileOptions::isCPP ? "c++" : "cc";
+  }
+
+  ///
+  /// Flags for building the shared object, on top of -shared -fPIC
+#ifdef __APPLE__
+  static inline std::string flags = "-O3";
+#else
+  static inline std::string flags = "-O3 -fopenmp";
+#endif
+
+  ///
+  /// Where the runtime headers live. CMake passes this in as SHIM_INCLUDE_DIR.
+#ifdef SHIM_INCLUDE_DIR
+  static inline std::vector<std::string> include_dirs = {SHIM_INCLUDE_DIR};
+#else
+  static inline std::vector<std::string> include_dirs = {};
+#endif
+
+  ///
+  /// Where shared objects are kept. Defaults to the StageCache dir, then the temp dir.
+  static std::string dir() {
+    if (!StageCache::dir.empty()) return StageCache::dir;
+    return (std::filesystem::temp_directory_path() / "shim_jit").string();
+  }
+
+};
+
+///
+/// Quote arg for the shell, so paths with spaces or quotes stay one argument
+inline std::string shell_quote(const std::string &arg) {
+  std::string quoted = "'";
+  for (char c : arg) {
+    if (c == '\'') {
+      quoted += "'\\''";
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "'";
+}
+
+///
+/// Stage func with args, build it into a shared object, load it, and return a pointer
+/// to the generated function, i.e.
+/// auto kernel = jit<void(uint8_t*,int)>(staged_kernel, "kernel", "", width, height);
+/// kernel(data, n);
+/// Since args are baked in at staging time, this specializes a kernel on values only known
+/// when the program runs. Shared objects are keyed on the hash of their source, compiler and
+/// flags, so restarting with the same values reuses the build. Loaded objects stay loaded
+/// for the life of the process.
+/// Generation goes through the StageCache, which tells args apart by value. Args it can't
+/// hash that way (e.g. pointers, whose targets may differ) are extracted every time.
+/// pre_src is added to the top of the source, like with stage.
+template <typename Sig, typename Func, typename...Args>
+Sig *jit(Func func, std::string name, std::string pre_src, Args...args) {
+  std::stringstream hdr;
+  std::stringstream src;
+  write_prelude(hdr, src, "", pre_src);
+  generate_staged(func, name, "", hdr, src, args...);
+  // a C entry point to find the function by, since the C++ name is mangled
+  std::string entry = "shim_jit_" + name;
+  src << (CompileOptions::isCPP ? "extern \"C\" " : "") << "void *" << entry << "() { return (void*)&"
+      << name << "; }" << std::endl;
+  std::string compile = JitOptions::compiler() + " " + JitOptions::flags + " -shared -fPIC";
+  for (auto &inc : JitOptions::include_dirs) {
+    compile += " -I" + shell_quote(inc);
+  }
+  uint64_t h = StageCache::hash(14695981039346656037ull, src.str());
+  h = StageCache::hash(h, compile);
+  std::stringstream key;
+  key << name << "_" << std::hex << h;
+  std::filesystem::path dir = JitOptions::dir();
+  std::filesystem::path so = dir / (key.str() + ".so");
+  if (!std::filesystem::exists(so)) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    // build under a temporary name so concurrent processes never load a partial object
+    std::string tmp = (dir / (key.str() + "." + std::to_string(::getpid()))).string();
+    std::string source = tmp + (CompileOptions::isCPP ? ".cpp" : ".c");
+    write_if_changed(source, src.str());
+    std::string cmd = compile + " -o " + shell_quote(tmp + ".so") + " " + shell_quote(source);
+    if (std::system(cmd.c_str()) != 0) {
+      std::cerr << "JIT compilation failed: " << cmd << std::endl;
+      exit(-1);
+    }
+    std::filesystem::rename(tmp + ".so", so, ec);
+    std::filesystem::remove(source, ec);
+  }
+  void *handle = dlopen(so.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!handle) {
+    std::cerr << "Cannot load " << so << ": " << dlerror() << std::endl;
+    exit(-1);
+  }
+  auto lookup = (void *(*)())dlsym(handle, entry.c_str());
+  if (!lookup) {
+    std::cerr << "Cannot find " << entry << " in " << so << std::endl;
+    exit(-1);
+  }
+  return (Sig*)lookup();
+}
+
+}
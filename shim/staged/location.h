@@ -11,6 +11,119 @@
 
 namespace shim {
 
+/// A loop bound of an inline statement that is generated inline within the loop header
+#ifndef UNSTAGED
+using LoopBound_T = builder::builder;
+#else
+using LoopBound_T = loop_type;
+#endif
+
+///
+/// val as a literal if its value is known during staging, otherwise the runtime value
+inline LoopBound_T static_or(loop_type known, const dvar<loop_type> &val) {
+  if (known != not_static) return (LoopBound_T)known;
+  return (LoopBound_T)val;
+}
+
+///
+/// One value of a LocParam. Plain integers are known during staging.
+struct LocElem {
+#ifndef UNSTAGED
+  LocElem(int v) : val(v), known(v) { }
+
+  template <typename T, typename std::enable_if<!std::is_integral<T>::value && !std::is_enum<T>::value,int>::type=0>
+  LocElem(const T &v) : val(v), known(not_static) { }
+
+  builder::builder val;
+#else
+  LocElem(loop_type v) : val(v), known(not_static) { }
+
+  loop_type val;
+#endif
+  loop_type known;
+};
+
+///
+/// Location information as passed in by the user, i.e. {16,16} or {height, 16}. This keeps
+/// track of which values were given as plain integers so that they can be generated as
+/// literals rather than as runtime values.
+template <unsigned long Rank>
+struct LocParam {
+
+  LocParam() { known.fill(not_static); }
+
+  LocParam(Loc_T<Rank> loc) : loc(std::move(loc)) { known.fill(not_static); }
+
+  LocParam(Loc_T<Rank> loc, Static_T<Rank> known) : loc(std::move(loc)), known(known) { }
+
+  LocParam(std::initializer_list<LocElem> elems) {
+    int i = 0;
+    for (auto &elem : elems) {
+      loc[i] = elem.val;
+      known[i] = elem.known;
+      i++;
+    }
+  }
+
+  ///
+  /// Value d for use in generated code
+  LoopBound_T at(int d) const { return static_or(known[d], loc[d]); }
+
+  Loc_T<Rank> loc;
+  Static_T<Rank> known;
+
+};
+
+///
+/// All values unknown during staging
+template <unsigned long Rank>
+Static_T<Rank> static_unknown() {
+  Static_T<Rank> s;
+  s.fill(not_static);
+  return s;
+}
+
+///
+/// All values known to be v during staging
+template <unsigned long Rank>
+Static_T<Rank> static_fill(loop_type v) {
+  Static_T<Rank> s;
+  s.fill(v);
+  return s;
+}
+
+///
+/// Elementwise a * b / c of staging-time values. Anything with a not_static operand is not_static.
+template <unsigned long Rank>
+Static_T<Rank> static_scale(const Static_T<Rank> &a, const Static_T<Rank> &b, const Static_T<Rank> &c) {
+  Static_T<Rank> s;
+  for (int i = 0; i < (int)Rank; i++) {
+    s[i] = a[i] == not_static || b[i] == not_static || c[i] == not_static ? not_static : a[i] * b[i] / c[i];
+  }
+  return s;
+}
+
+///
+/// Elementwise a * b + c of staging-time values. Anything with a not_static operand is not_static.
+template <unsigned long Rank>
+Static_T<Rank> static_affine(const Static_T<Rank> &a, const Static_T<Rank> &b, const Static_T<Rank> &c) {
+  Static_T<Rank> s;
+  for (int i = 0; i < (int)Rank; i++) {
+    s[i] = a[i] == not_static || b[i] == not_static || c[i] == not_static ? not_static : a[i] * b[i] + c[i];
+  }
+  return s;
+}
+
+///
+/// True if every value is known to be v during staging
+template <unsigned long Rank>
+bool static_all(const Static_T<Rank> &s, loop_type v) {
+  for (int i = 0; i < (int)Rank; i++) {
+    if (s[i] != v) return false;
+  }
+  return true;
+}
+
 /// An immutable representation of a physical location.
 /// Represents the base object for use within Blocks and Views.
 template <unsigned long Rank>
@@ -20,14 +133,20 @@ struct MeshLocation {
   MeshLocation();
   
   MeshLocation(SLoc_T extents, SLoc_T strides, SLoc_T origin,
-	       SLoc_T refinement_factors, SLoc_T coarsening_factors);
+	       SLoc_T refinement_factors, SLoc_T coarsening_factors,
+	       bool unit_strides=false, bool unit_factors=false,
+	       Static_T<Rank> static_extents=static_unknown<Rank>(),
+	       Static_T<Rank> static_strides=static_unknown<Rank>(),
+	       Static_T<Rank> static_origin=static_unknown<Rank>(),
+	       Static_T<Rank> static_refinement=static_unknown<Rank>(),
+	       Static_T<Rank> static_coarsening=static_unknown<Rank>());
   
   void dump_location();
   
   MeshLocation<Rank> compute_base_mesh_location();
   MeshLocation<Rank> into(MeshLocation<Rank> &other);
-  MeshLocation<Rank> refine(SLoc_T refinement_factors);
-  MeshLocation<Rank> coarsen(SLoc_T coarsening_factors);
+  MeshLocation<Rank> refine(LocParam<Rank> factors);
+  MeshLocation<Rank> coarsen(LocParam<Rank> factors);
   
 
   SLoc_T get_extents() { return extents; }
@@ -35,6 +154,30 @@ struct MeshLocation {
   SLoc_T get_origin() { return origin; }
   SLoc_T get_refinement_factors() { return refinement_factors; }
   SLoc_T get_coarsening_factors() { return coarsening_factors; }
+
+  /// True if the strides are known to be 1 during staging
+  bool has_unit_strides() const { return unit_strides; }
+
+  /// True if the refinement and coarsening factors are known to be 1 during staging
+  bool has_unit_factors() const { return unit_factors; }
+
+  Static_T<Rank> get_static_extents() const { return static_extents; }
+  Static_T<Rank> get_static_strides() const { return static_strides; }
+  Static_T<Rank> get_static_origin() const { return static_origin; }
+  Static_T<Rank> get_static_refinement_factors() const { return static_refinement; }
+  Static_T<Rank> get_static_coarsening_factors() const { return static_coarsening; }
+
+  /// The extents (strides, origin) along with what's known about them during staging
+  LocParam<Rank> extents_param() { return LocParam<Rank>(extents, static_extents); }
+  LocParam<Rank> strides_param() { return LocParam<Rank>(strides, static_strides); }
+  LocParam<Rank> origin_param() { return LocParam<Rank>(origin, static_origin); }
+  LocParam<Rank> refinement_param() { return LocParam<Rank>(refinement_factors, static_refinement); }
+  LocParam<Rank> coarsening_param() { return LocParam<Rank>(coarsening_factors, static_coarsening); }
+
+  /// Extent d for use in generated code. This is a literal if it's known during staging.
+  LoopBound_T extent(int d) const { return static_or(static_extents[d], extents[d]); }
+  LoopBound_T stride(int d) const { return static_or(static_strides[d], strides[d]); }
+  LoopBound_T origin_at(int d) const { return static_or(static_origin[d], origin[d]); }
   
 private:
 
@@ -44,6 +187,19 @@ private:
   SLoc_T refinement_factors;
   SLoc_T coarsening_factors; 
 
+  // staging-time knowledge about the values above. These let index computations
+  // skip multiplies and divides by 1.
+  bool unit_strides;
+  bool unit_factors;
+
+  // staging-time values of the above (not_static if unknown). These are generated as
+  // literals, so fixed-size blocks get constant loop bounds and index math.
+  Static_T<Rank> static_extents;
+  Static_T<Rank> static_strides;
+  Static_T<Rank> static_origin;
+  Static_T<Rank> static_refinement;
+  Static_T<Rank> static_coarsening;
+
 };
 
 /// An intermediate object that can be used to buildup a location piecewise.
@@ -54,11 +210,13 @@ struct LocationBuilder {
 
   LocationBuilder();
 
-  LocationBuilder<Rank> &with_extents(SLoc_T extents);
-  LocationBuilder<Rank> &with_strides(SLoc_T strides);
-  LocationBuilder<Rank> &with_origin(SLoc_T origin);
-  LocationBuilder<Rank> &with_refinement(SLoc_T refinement);
-  LocationBuilder<Rank> &with_coarsening(SLoc_T coarsening);
+  LocationBuilder<Rank> &with_extents(LocParam<Rank> extents);
+  LocationBuilder<Rank> &with_strides(LocParam<Rank> strides);
+  LocationBuilder<Rank> &with_origin(LocParam<Rank> origin);
+  LocationBuilder<Rank> &with_refinement(LocParam<Rank> refinement);
+  LocationBuilder<Rank> &with_coarsening(LocParam<Rank> coarsening);
+  /// Use the refinement and coarsening factors of other
+  LocationBuilder<Rank> &with_factors(MeshLocation<Rank> &other);
 
   MeshLocation<Rank> to_loc();
 
@@ -70,10 +228,22 @@ private:
   SLoc_T origin;
   SLoc_T refinement;
   SLoc_T coarsening; 
+  bool unit_strides;
+  bool unit_factors;
+  Static_T<Rank> static_extents;
+  Static_T<Rank> static_strides;
+  Static_T<Rank> static_origin;
+  Static_T<Rank> static_refinement;
+  Static_T<Rank> static_coarsening;
 };
 
 template <unsigned long Rank>
-LocationBuilder<Rank>::LocationBuilder() {
+LocationBuilder<Rank>::LocationBuilder() : unit_strides(true), unit_factors(true),
+					   static_extents(static_fill<Rank>(1)), 
+					   static_strides(static_fill<Rank>(1)),
+					   static_origin(static_fill<Rank>(0)), 
+					   static_refinement(static_fill<Rank>(1)),
+					   static_coarsening(static_fill<Rank>(1)) {
   for (svar<int> i = 0; i < Rank; i=i+1) {
     extents[i] = 1;
     strides[i] = 1;
@@ -84,52 +254,74 @@ LocationBuilder<Rank>::LocationBuilder() {
 }
 
 template <unsigned long Rank>
-LocationBuilder<Rank> &LocationBuilder<Rank>::with_extents(SLoc_T extents) {
+LocationBuilder<Rank> &LocationBuilder<Rank>::with_extents(LocParam<Rank> extents) {
   for (svar<int> i = 0; i < Rank; i=i+1) {
-    this->extents[i] = extents[i];
+    this->extents[i] = extents.loc[i];
   }
+  static_extents = extents.known;
   return *this;
 }
 
 template <unsigned long Rank>
-LocationBuilder<Rank> &LocationBuilder<Rank>::with_strides(SLoc_T strides) {
+LocationBuilder<Rank> &LocationBuilder<Rank>::with_strides(LocParam<Rank> strides) {
   for (svar<int> i = 0; i < Rank; i=i+1) {
-    this->strides[i] = strides[i];
+    this->strides[i] = strides.loc[i];
   }
+  static_strides = strides.known;
+  unit_strides = static_all<Rank>(strides.known, 1);
   return *this;
 }
 
 template <unsigned long Rank>
-LocationBuilder<Rank> &LocationBuilder<Rank>::with_origin(SLoc_T origin) {
+LocationBuilder<Rank> &LocationBuilder<Rank>::with_origin(LocParam<Rank> origin) {
   for (svar<int> i = 0; i < Rank; i=i+1) {
-    this->origin[i] = origin[i];
+    this->origin[i] = origin.loc[i];
   }
+  static_origin = origin.known;
   return *this;
 }
 
 template <unsigned long Rank>
-LocationBuilder<Rank> &LocationBuilder<Rank>::with_refinement(SLoc_T refinement) {
+LocationBuilder<Rank> &LocationBuilder<Rank>::with_refinement(LocParam<Rank> refinement) {
   for (svar<int> i = 0; i < Rank; i=i+1) {
-    this->refinement[i] = refinement[i];
+    this->refinement[i] = refinement.loc[i];
   }
+  static_refinement = refinement.known;
+  unit_factors = static_all<Rank>(static_refinement, 1) && static_all<Rank>(static_coarsening, 1);
   return *this;
 }
 
 template <unsigned long Rank>
-LocationBuilder<Rank> &LocationBuilder<Rank>::with_coarsening(SLoc_T coarsening) {
+LocationBuilder<Rank> &LocationBuilder<Rank>::with_coarsening(LocParam<Rank> coarsening) {
   for (svar<int> i = 0; i < Rank; i=i+1) {
-    this->coarsening[i] = coarsening[i];
+    this->coarsening[i] = coarsening.loc[i];
   }
+  static_coarsening = coarsening.known;
+  unit_factors = static_all<Rank>(static_refinement, 1) && static_all<Rank>(static_coarsening, 1);
+  return *this;
+}
+
+template <unsigned long Rank>
+LocationBuilder<Rank> &LocationBuilder<Rank>::with_factors(MeshLocation<Rank> &other) {
+  with_refinement(other.refinement_param());
+  with_coarsening(other.coarsening_param());
+  unit_factors = unit_factors || other.has_unit_factors();
   return *this;
 }
 
 template <unsigned long Rank>
 MeshLocation<Rank> LocationBuilder<Rank>::to_loc() {
-  return {extents, strides, origin, refinement, coarsening};
+  return {extents, strides, origin, refinement, coarsening, unit_strides, unit_factors,
+    static_extents, static_strides, static_origin, static_refinement, static_coarsening};
 }
 
 template <unsigned long Rank>
-MeshLocation<Rank>::MeshLocation() {
+MeshLocation<Rank>::MeshLocation() : unit_strides(true), unit_factors(true),
+				     static_extents(static_fill<Rank>(1)), 
+				     static_strides(static_fill<Rank>(1)),
+				     static_origin(static_fill<Rank>(0)), 
+				     static_refinement(static_fill<Rank>(1)),
+				     static_coarsening(static_fill<Rank>(1)) {
   for (svar<int> i = 0; i < Rank; i=i+1) {
     extents[i] = 1;
     strides[i] = 1;
@@ -141,9 +333,16 @@ MeshLocation<Rank>::MeshLocation() {
 
 template <unsigned long Rank>
 MeshLocation<Rank>::MeshLocation(SLoc_T extents, SLoc_T strides, SLoc_T origin,
-				 SLoc_T refinement_factors, SLoc_T coarsening_factors) :
+				 SLoc_T refinement_factors, SLoc_T coarsening_factors,
+				 bool unit_strides, bool unit_factors,
+				 Static_T<Rank> static_extents, Static_T<Rank> static_strides,
+				 Static_T<Rank> static_origin, Static_T<Rank> static_refinement,
+				 Static_T<Rank> static_coarsening) :
   extents(std::move(extents)), strides(std::move(strides)), origin(std::move(origin)),
-  refinement_factors(std::move(refinement_factors)), coarsening_factors(std::move(coarsening_factors))
+  refinement_factors(std::move(refinement_factors)), coarsening_factors(std::move(coarsening_factors)),
+  unit_strides(unit_strides), unit_factors(unit_factors),
+  static_extents(static_extents), static_strides(static_strides), static_origin(static_origin),
+  static_refinement(static_refinement), static_coarsening(static_coarsening)
 { }
 
 template <unsigned long Rank>
@@ -194,8 +393,15 @@ MeshLocation<Rank> MeshLocation<Rank>::compute_base_mesh_location() {
     base_origin[i] = origin[i] * coarsening_factors[i] / refinement_factors[i];
     base_strides[i] = strides[i] * coarsening_factors[i] / refinement_factors[i];
   }
+  Static_T<Rank> sstrides = static_scale<Rank>(static_strides, static_coarsening, static_refinement);
   return {std::move(base_extents), std::move(base_strides), std::move(base_origin),
-    refinement_factors, coarsening_factors};
+    refinement_factors, coarsening_factors, 
+    static_all<Rank>(sstrides, 1), 
+    static_all<Rank>(static_refinement, 1) && static_all<Rank>(static_coarsening, 1),
+    static_scale<Rank>(static_extents, static_coarsening, static_refinement),
+    sstrides,
+    static_scale<Rank>(static_origin, static_coarsening, static_refinement),
+    static_refinement, static_coarsening};
 }
   
 template <unsigned long Rank>
@@ -208,12 +414,23 @@ MeshLocation<Rank> MeshLocation<Rank>::into(MeshLocation<Rank> &other) {
     mesh_strides[i] = get_strides()[i] * other.get_refinement_factors()[i] / other.get_coarsening_factors()[i];
     mesh_origin[i] = get_origin()[i] * other.get_refinement_factors()[i] / other.get_coarsening_factors()[i];
   }  
+  Static_T<Rank> oref = other.get_static_refinement_factors();
+  Static_T<Rank> ocoarse = other.get_static_coarsening_factors();
+  Static_T<Rank> sstrides = static_scale<Rank>(static_strides, oref, ocoarse);
   return {mesh_extents, mesh_strides, mesh_origin, 
-    other.get_refinement_factors(), other.get_coarsening_factors()};
+    other.get_refinement_factors(), other.get_coarsening_factors(),
+    static_all<Rank>(sstrides, 1), 
+    static_all<Rank>(oref, 1) && static_all<Rank>(ocoarse, 1),
+    static_scale<Rank>(static_extents, oref, ocoarse),
+    sstrides,
+    static_scale<Rank>(static_origin, oref, ocoarse),
+    oref, ocoarse};
 }
 
 template <unsigned long Rank>
-MeshLocation<Rank> MeshLocation<Rank>::refine(SLoc_T refinement_factors) {
+MeshLocation<Rank> MeshLocation<Rank>::refine(LocParam<Rank> factors) {
+  SLoc_T &refinement_factors = factors.loc;
+  Static_T<Rank> ones = static_fill<Rank>(1);
   SLoc_T rextents;
   SLoc_T rorigin;
   SLoc_T rrefinement;
@@ -229,14 +446,16 @@ MeshLocation<Rank> MeshLocation<Rank>::refine(SLoc_T refinement_factors) {
     rrefinement[i] = this->refinement_factors[i] * refinement_factors[i];    
   }
   return LocationBuilder<Rank>().
-    with_extents(std::move(rextents)).
-    with_origin(std::move(rorigin)).
-    with_refinement(std::move(rrefinement)).
-    with_coarsening(coarsening_factors).to_loc();
+    with_extents(LocParam<Rank>(std::move(rextents), static_scale<Rank>(static_extents, factors.known, ones))).
+    with_origin(LocParam<Rank>(std::move(rorigin), static_scale<Rank>(static_origin, factors.known, ones))).
+    with_refinement(LocParam<Rank>(std::move(rrefinement), static_scale<Rank>(static_refinement, factors.known, ones))).
+    with_coarsening(coarsening_param()).to_loc();
 }
 
 template <unsigned long Rank>
-MeshLocation<Rank> MeshLocation<Rank>::coarsen(SLoc_T coarsening_factors) {
+MeshLocation<Rank> MeshLocation<Rank>::coarsen(LocParam<Rank> factors) {
+  SLoc_T &coarsening_factors = factors.loc;
+  Static_T<Rank> ones = static_fill<Rank>(1);
   SLoc_T cextents;
   SLoc_T corigin;
   SLoc_T ccoarsening;
@@ -252,10 +471,23 @@ MeshLocation<Rank> MeshLocation<Rank>::coarsen(SLoc_T coarsening_factors) {
     ccoarsening[i] = coarsening_factors[i] * coarsening_factors[i];
   }  
   return LocationBuilder<Rank>().
-    with_extents(std::move(cextents)).
-    with_origin(std::move(corigin)).
-    with_refinement(refinement_factors).
-    with_coarsening(std::move(ccoarsening)).to_loc();
+    with_extents(LocParam<Rank>(std::move(cextents), static_scale<Rank>(static_extents, ones, factors.known))).
+    with_origin(LocParam<Rank>(std::move(corigin), static_scale<Rank>(static_origin, ones, factors.known))).
+    with_refinement(refinement_param()).
+    with_coarsening(LocParam<Rank>(std::move(ccoarsening), static_scale<Rank>(factors.known, factors.known, ones))).to_loc();
 }
   
+///
+/// Convert a coordinate to a linear index within loc. Extents known during staging are
+/// generated as literals.
+template <int Depth, unsigned long Rank>
+dvar<loop_type> linearize(const MeshLocation<Rank> &loc, darr<loop_type,Rank> &coord) {
+  dvar<loop_type> c = coord[Rank-1-Depth];
+  if constexpr (Depth == Rank - 1) {
+    return c;
+  } else {
+    return c + loc.extent(Rank-1-Depth) * linearize<Depth+1,Rank>(loc, coord);
+  }
+}
+
 }
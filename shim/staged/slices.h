@@ -6,6 +6,7 @@
 #include "fwddecls.h"
 #include "fwrappers.h"
 #include "defs.h"
+#include "location.h"
 
 namespace shim {
 
@@ -17,14 +18,27 @@ struct Def { };
 template <bool Stop> // if Stop = true, then need to infer this value as the extent when use
 struct Range {
 
-  Range(dvar<loop_type> start, 
-	dvar<loop_type> stop, 
-	dvar<loop_type> stride) : params({start,stop,stride}) { }
+  Range(LocElem start, 
+	LocElem stop, 
+	LocElem stride) : params({start.val,stop.val,stride.val}), 
+			  known({start.known,stop.known,stride.known}) { 
+    if (!Stop && known[0] != not_static && known[1] != not_static && known[2] != not_static) {
+      known_extent = (known[1] - known[0] - 1) / known[2] + 1;
+    }
+  }
 
   dvar<loop_type> operator[](loop_type idx) { return params[idx]; }
 
   darr<loop_type,3> params;
 
+  ///
+  /// The start, stop, and stride if they're known during staging
+  Static_T<3> known;
+
+  ///
+  /// The number of elements in the range if it's known during staging
+  loop_type known_extent = not_static;
+
 };
 
 ///
@@ -82,6 +96,59 @@ auto range(Start start, Stop stop, Stride stride) {
   }
 }
 
+///
+/// Create a range of N elements from start, i.e. range(start, start+(N-1)*stride+1, stride).
+/// The extent is known during staging even if start isn't, so the loops over a slice like
+/// img.slice(span<16>(mb_y), span<16>(mb_x)) get literal bounds.
+template <int N, typename Start, typename Stride=int>
+auto span(Start start, Stride stride=1) {
+  Range<false> r(start, start + (N - 1) * stride + 1, stride);
+  r.known_extent = N;
+  return r;
+}
+
+///
+/// The value of a slice param if it's known during staging
+template <typename Arg>
+loop_type static_param(Arg arg) {
+  if constexpr (std::is_integral<Arg>::value || std::is_enum<Arg>::value) {
+    return (loop_type)arg;
+  } else {
+    return not_static;
+  }
+}
+
+///
+/// Combine the staging-time origin, extent, and stride of each slice param (see gather_origin,
+/// gather_stops, gather_strides, and convert_stops_to_extents). extents are those of the object
+/// being sliced.
+template <int Idx, int Rank, typename Arg, typename...Args>
+void gather_static(Static_T<Rank> &origin, Static_T<Rank> &vextents, Static_T<Rank> &strides,
+		   const Static_T<Rank> &extents, Arg arg, Args...args) {
+  if constexpr (is_range<Arg>::value) {
+    origin[Idx] = arg.known[0];
+    strides[Idx] = arg.known[2];
+    if constexpr (is_stop_range<Arg>::value) {
+      // the stop is the extent of the sliced object
+      if (arg.known[0] != not_static && arg.known[2] != not_static && extents[Idx] != not_static) {
+	vextents[Idx] = (extents[Idx] - arg.known[0] - 1) / arg.known[2] + 1;
+      } else {
+	vextents[Idx] = not_static;
+      }
+    } else {
+      vextents[Idx] = arg.known_extent;
+    }
+  } else {
+    // a single value
+    origin[Idx] = static_param(arg);
+    strides[Idx] = static_param(arg);
+    vextents[Idx] = 1;
+  }
+  if constexpr (Idx < Rank - 1) {
+    gather_static<Idx+1,Rank>(origin, vextents, strides, extents, args...);
+  }
+}
+
 ///
 /// Combine start params from a view range into one array
 template <int Idx, int Rank, typename Arg, typename...Args>
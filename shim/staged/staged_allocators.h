@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <iostream>
+#include <type_traits>
 #include "builder/dyn_var.h"
 #include "builder/array.h"
 #include "staged_utils.h"
@@ -68,6 +70,10 @@ struct Allocation {
   /// Whether this is an internally-managed stack allocation
   virtual bool is_stack_strategy() const { return false; }
 
+  ///
+  /// Whether this is an internally-managed arena allocation
+  virtual bool is_arena_strategy() const { return false; }
+
   ///
   /// Whether this is a user-managed heap allocation
   virtual bool is_user_heap_strategy() const { return false; }  
@@ -97,6 +103,11 @@ struct Allocation {
 //  template <int Sz>
   builder::dyn_var<Elem*> stack();
 
+  ///
+  /// Get a raw pointer to the start of the underlying data, i.e. for passing to external
+  /// functions. Not valid for multidimensional user allocations.
+  virtual builder::dyn_var<Elem*> raw() = 0;
+
 };
 
 #define DISPATCH_MEMSET(dtype)						\
@@ -120,6 +131,15 @@ struct Allocation {
     }							\
   }
 
+// calls the appropriate function for getting the data pointer out of a heap array
+#define DISPATCH_HEAP_DATA(dtype)					\
+  template <>								\
+  struct DispatchHeapData<dtype> {					\
+    auto operator()(builder::dyn_var<HEAP_T<dtype>> &data) {		\
+      return heap_data_##dtype(data);					\
+    }									\
+  }
+
 // calls the appropriate stack builder function
 #define DISPATCH_STACK_BUILDER(dtype)				\
   template <>							\
@@ -129,6 +149,15 @@ struct Allocation {
     }								\
   }
 
+// calls the appropriate arena builder function
+#define DISPATCH_ARENA_BUILDER(dtype)					\
+  template <>								\
+  struct DispatchBuildArena<dtype> {					\
+    auto operator()(builder::dyn_var<loop_type> sz, loop_type alignment, bool zero) { \
+      return build_arenaarr_##dtype(sz, alignment, zero);		\
+    }									\
+  }
+
 template <typename Elem, bool IsHeapArry, typename Data>
 struct DispatchMemset { };
 DISPATCH_MEMSET(uint8_t);
@@ -157,6 +186,20 @@ DISPATCH_BUILDER(int64_t);
 DISPATCH_BUILDER(float);
 DISPATCH_BUILDER(double);
 
+template <typename Elem>
+struct DispatchHeapData { };
+DISPATCH_HEAP_DATA(uint8_t);
+DISPATCH_HEAP_DATA(uint16_t);
+DISPATCH_HEAP_DATA(uint32_t);
+DISPATCH_HEAP_DATA(uint64_t);
+DISPATCH_HEAP_DATA(char);
+DISPATCH_HEAP_DATA(int8_t);
+DISPATCH_HEAP_DATA(int16_t);
+DISPATCH_HEAP_DATA(int32_t);
+DISPATCH_HEAP_DATA(int64_t);
+DISPATCH_HEAP_DATA(float);
+DISPATCH_HEAP_DATA(double);
+
 template <typename Elem>
 struct DispatchBuildStack { };
 DISPATCH_STACK_BUILDER(uint8_t);
@@ -171,6 +214,20 @@ DISPATCH_STACK_BUILDER(int64_t);
 DISPATCH_STACK_BUILDER(float);
 DISPATCH_STACK_BUILDER(double);
 
+template <typename Elem>
+struct DispatchBuildArena { };
+DISPATCH_ARENA_BUILDER(uint8_t);
+DISPATCH_ARENA_BUILDER(uint16_t);
+DISPATCH_ARENA_BUILDER(uint32_t);
+DISPATCH_ARENA_BUILDER(uint64_t);
+DISPATCH_ARENA_BUILDER(char);
+DISPATCH_ARENA_BUILDER(int8_t);
+DISPATCH_ARENA_BUILDER(int16_t);
+DISPATCH_ARENA_BUILDER(int32_t);
+DISPATCH_ARENA_BUILDER(int64_t);
+DISPATCH_ARENA_BUILDER(float);
+DISPATCH_ARENA_BUILDER(double);
+
 
 ///
 /// Calls the appropriate external write function based on the Elem and allocation type
@@ -186,6 +243,13 @@ auto dispatch_build_heap(builder::dyn_var<loop_type> sz) {
   return DispatchBuildHeap<Elem>()(sz);  
 }
 
+///
+/// Calls the appropriate external function for getting the data pointer of a HeapArr
+template <typename Elem>
+auto dispatch_heap_data(builder::dyn_var<HEAP_T<Elem>> &data) {
+  return DispatchHeapData<Elem>()(data);
+}
+
 ///
 /// Calls the appropriate external StackArr builder function based on the Elem and allocation type
 template <typename Elem>
@@ -193,6 +257,13 @@ auto dispatch_build_stack(loop_type sz) {
   return DispatchBuildStack<Elem>()(sz);  
 }
 
+///
+/// Calls the appropriate external arena builder function based on the Elem
+template <typename Elem>
+auto dispatch_build_arena(builder::dyn_var<loop_type> sz, loop_type alignment, bool zero) {
+  return DispatchBuildArena<Elem>()(sz, alignment, zero);
+}
+
 ///
 /// Defines an internally-allocated reference-counted heap
 template <typename Elem>
@@ -210,6 +281,8 @@ struct HeapAllocation : public Allocation<Elem,1> {
 
   void memset(builder::dyn_var<loop_type> sz) override;
 
+  builder::dyn_var<Elem*> raw() override;
+
   builder::dyn_var<HEAP_T<Elem>> data;
 };
 
@@ -223,12 +296,46 @@ struct StackAllocation : public Allocation<Elem,1> {
   // For a stack allocation, this better be a constant sz. otherwise your generated code may fail
   explicit StackAllocation(builder::static_var<loop_type> sz) : data(dispatch_build_stack<Elem>(sz)) { }
 
+  bool is_stack_strategy() const override { return true; }
+
+  builder::dyn_var<Elem> read(builder::dyn_arr<loop_type,1> &idxs) override;
+
+  void write(builder::dyn_var<Elem> val, builder::dyn_arr<loop_type,1> &idxs) override;
+
+  void memset(builder::dyn_var<loop_type> sz) override;
+
+  builder::dyn_var<Elem*> raw() override;
+
+  builder::dyn_var<Elem*> data;
+
+};
+
+///
+/// Defines an internally-allocated buffer from the per-thread arena of the generated code.
+/// Unlike a stack allocation, the size can be dynamic. Like a stack allocation, the buffer
+/// only lives until the end of the scope it's created in, so allocating one per iteration
+/// of a loop reuses the same memory rather than going to the heap each time.
+template <typename Elem>
+struct ArenaAllocation : public Allocation<Elem,1> {
+
+  virtual ~ArenaAllocation() = default;
+
+  // the scope has to be declared before the data so that it's destroyed after it
+  ArenaAllocation(builder::dyn_var<loop_type> sz, loop_type alignment, bool zero) : 
+    scope(build_arena_scope()), data(dispatch_build_arena<Elem>(sz, alignment, zero)) { }
+
+  bool is_arena_strategy() const override { return true; }
+
   builder::dyn_var<Elem> read(builder::dyn_arr<loop_type,1> &idxs) override;
 
   void write(builder::dyn_var<Elem> val, builder::dyn_arr<loop_type,1> &idxs) override;
 
   void memset(builder::dyn_var<loop_type> sz) override;
 
+  builder::dyn_var<Elem*> raw() override;
+
+  builder::dyn_var<ARENA_SCOPE_T> scope;
+
   builder::dyn_var<Elem*> data;
 
 };
@@ -248,6 +355,8 @@ struct UserAllocation : public Allocation<Elem, PhysicalRank> {
   void write(builder::dyn_var<Elem> val, builder::dyn_arr<loop_type,PhysicalRank> &idxs) override;
 
   void memset(builder::dyn_var<loop_type> sz) override;
+
+  builder::dyn_var<Elem*> raw() override;
   
   builder::dyn_var<Storage> data;
 
@@ -279,6 +388,11 @@ void HeapAllocation<Elem>::memset(builder::dyn_var<loop_type> sz) {
   dispatch_memset<Elem,true>(data, Elem(0), sz);
 }
 
+template <typename Elem>
+builder::dyn_var<Elem*> HeapAllocation<Elem>::raw() {
+  return dispatch_heap_data<Elem>(data);
+}
+
 template <typename Elem>
 builder::dyn_var<Elem> StackAllocation<Elem>::read(builder::dyn_arr<loop_type,1> &idxs) { 
   return data[idxs[0]];
@@ -294,6 +408,31 @@ void StackAllocation<Elem>::memset(builder::dyn_var<loop_type> sz) {
   dispatch_memset<Elem,false>(data, Elem(0), sz);
 }  
 
+template <typename Elem>
+builder::dyn_var<Elem*> StackAllocation<Elem>::raw() {
+  return data;
+}
+
+template <typename Elem>
+builder::dyn_var<Elem> ArenaAllocation<Elem>::read(builder::dyn_arr<loop_type,1> &idxs) { 
+  return data[idxs[0]];
+}
+
+template <typename Elem>
+void ArenaAllocation<Elem>::write(builder::dyn_var<Elem> val, builder::dyn_arr<loop_type,1> &idxs) { 
+  data[idxs[0]] = val;
+}
+
+template <typename Elem>
+void ArenaAllocation<Elem>::memset(builder::dyn_var<loop_type> sz) {
+  dispatch_memset<Elem,false>(data, Elem(0), sz);
+}  
+
+template <typename Elem>
+builder::dyn_var<Elem*> ArenaAllocation<Elem>::raw() {
+  return data;
+}
+
 template <int Rank, int Depth, typename Data, typename Idxs>
 auto multi_read(Data &data, Idxs &idxs) {
   auto x = data[idxs[Depth]];
@@ -329,5 +468,15 @@ void UserAllocation<Elem,Storage,PhysicalRank>::memset(builder::dyn_var<loop_typ
   assert(false);
 }
 
+template <typename Elem, typename Storage, int PhysicalRank>
+builder::dyn_var<Elem*> UserAllocation<Elem,Storage,PhysicalRank>::raw() {
+  if constexpr (std::is_same<Storage,Elem*>::value) {
+    return data;
+  } else {
+    std::cerr << "Cannot get a raw pointer to a multidimensional user allocation" << std::endl;
+    exit(-1);
+  }
+}
+
 }
 #endif
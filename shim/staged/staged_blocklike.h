@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <memory>
 #include <vector>
 #include <sstream>
 #include "builder/dyn_var.h"
@@ -14,6 +15,7 @@
 #include "staged_allocators.h"
 #include "object.h"
 #include "annotations.h"
+#include "fusion.h"
 #include "location.h"
 #ifdef UNSTAGED
 #include "runtime/cpp/heaparray.h"
@@ -69,20 +71,29 @@ struct Block {
 
   ///
   /// Create an internally-managed heap Block
-  Block(SLoc_T bextents, SLoc_T bstrides, SLoc_T borigin);
+  Block(LocParam<Rank> bextents, LocParam<Rank> bstrides, LocParam<Rank> borigin);
 
   ///
   /// Create an internally-managed heap Block
-  Block(SLoc_T bextents, SLoc_T bstrides, SLoc_T borigin, 
-	SLoc_T brefinement_factors, SLoc_T bcoarsening_factors);
+  Block(LocParam<Rank> bextents, LocParam<Rank> bstrides, LocParam<Rank> borigin, 
+	LocParam<Rank> brefinement_factors, LocParam<Rank> bcoarsening_factors);
 
   ///
   /// Create an internally-managed heap Block
-  Block(SLoc_T bextents);
+  Block(LocParam<Rank> bextents);
 
   ///
   /// Create an internally-managed heap Block
-  static Block<Elem,Rank,MultiDimRepr> heap(SLoc_T bextents);
+  static Block<Elem,Rank,MultiDimRepr> heap(LocParam<Rank> bextents);
+
+  ///
+  /// Create an internally-managed Block in the arena of the generated code. This is for
+  /// scratch Blocks created within a loop: the data is freed at the end of the enclosing
+  /// scope, so it must not be used after that (like a stack Block), but the extents can be
+  /// dynamic. With ArenaInit::Overwritten, the data is not zeroed, so the first use of the
+  /// Block must write every element.
+  static Block<Elem,Rank,MultiDimRepr> arena(LocParam<Rank> bextents, ArenaInit init=ArenaInit::Zeroed,
+					     loop_type alignment=64);
 
 #ifndef UNSTAGED
   ///
@@ -100,20 +111,20 @@ struct Block {
   ///
   /// Create an internally-managed stack Block
   template <int...Extents>
-  static Block<Elem,Rank,false> stack(SLoc_T bstrides, SLoc_T borigin, 
-				      SLoc_T brefinement_factors, SLoc_T bcoarsening_factors);
+  static Block<Elem,Rank,false> stack(LocParam<Rank> bstrides, LocParam<Rank> borigin, 
+				      LocParam<Rank> brefinement_factors, LocParam<Rank> bcoarsening_factors);
 #endif
 
   ///
   /// Create a user-managed allocation
 #ifndef UNSTAGED
-  static Block<Elem,Rank,MultiDimRepr> user(SLoc_T bextents, 
+  static Block<Elem,Rank,MultiDimRepr> user(LocParam<Rank> bextents, 
 					    dvar<typename decltype(ptr_wrap<Elem,Rank,MultiDimRepr>())::P> user);
-  static Block<Elem,Rank,MultiDimRepr> user(SLoc_T bextents, SLoc_T bstrides, SLoc_T borigin,
-					    SLoc_T brefinement_factors, SLoc_T bcoarsening_factors,
+  static Block<Elem,Rank,MultiDimRepr> user(LocParam<Rank> bextents, LocParam<Rank> bstrides, LocParam<Rank> borigin,
+					    LocParam<Rank> brefinement_factors, LocParam<Rank> bcoarsening_factors,
 					    dvar<typename decltype(ptr_wrap<Elem,Rank,MultiDimRepr>())::P> user);
 #else
-  static Block<Elem,Rank,MultiDimRepr> user(SLoc_T bextents, dvar<Elem*> user);
+  static Block<Elem,Rank,MultiDimRepr> user(LocParam<Rank> bextents, dvar<Elem*> user);
 #endif
 
   ///
@@ -206,18 +217,30 @@ private:
 
   ///
   /// Create a Block with the specifed Allocation
-  Block(SLoc_T bextents, Allocation_T<Elem,physical<Rank,MultiDimRepr>()> allocator);
+  Block(LocParam<Rank> bextents, Allocation_T<Elem,physical<Rank,MultiDimRepr>()> allocator);
 
   ///
   /// Create a Block with the specifed Allocation
-  Block(SLoc_T bextents, SLoc_T bstrides, SLoc_T borigin,
-	SLoc_T brefinement_factors, SLoc_T bcoarsening_factors,
+  Block(LocParam<Rank> bextents, LocParam<Rank> bstrides, LocParam<Rank> borigin,
+	LocParam<Rank> brefinement_factors, LocParam<Rank> bcoarsening_factors,
 	Allocation_T<Elem,physical<Rank,MultiDimRepr>()> allocator);
 
   MeshLocation<Rank> location;
 
 };
 
+///
+/// The linear index of a View access as base + sum(coords[d] * coeffs[d]).
+/// Only exists when the location information makes the access affine.
+template <unsigned long Rank>
+struct AffineForm {
+  dvar<loop_type> base;
+  Loc_T<Rank> coeffs;
+  // the base and coeffs if they're known during staging
+  loop_type known_base;
+  Static_T<Rank> known_coeffs;
+};
+
 ///
 /// A region of data with a location that shares its underlying data with another block or view
 /// If MultiDimRepr=true, # physical dims == # logical dims
@@ -249,8 +272,8 @@ struct View {
   
   /// 
   /// Create a View from the specified location information
-  View(SLoc_T bextents, SLoc_T bstrides, SLoc_T borigin, SLoc_T brefinement_factors, SLoc_T bcoarsening_factors,
-       SLoc_T vextents, SLoc_T vstrides, SLoc_T vorigin, SLoc_T vrefinement_factors, SLoc_T vcoarsening_factors,
+  View(LocParam<Rank> bextents, LocParam<Rank> bstrides, LocParam<Rank> borigin, LocParam<Rank> brefinement_factors, LocParam<Rank> bcoarsening_factors,
+       LocParam<Rank> vextents, LocParam<Rank> vstrides, LocParam<Rank> vorigin, LocParam<Rank> vrefinement_factors, LocParam<Rank> vcoarsening_factors,
        Allocation_T<Elem,physical<Rank,MultiDimRepr>()> allocator);
   
   ///
@@ -355,9 +378,26 @@ private:
   void compute_block_mesh_space_location(const darr<loop_type,Rank> &coords,
 					 darr<loop_type,Rank> &out);
 
+  ///
+  /// Compute the coordinates relative to the block from the permuted view coordinates
+  void compute_block_coords(const darr<loop_type,Rank> &permuted, darr<loop_type,Rank> &bcoords);
+
+  ///
+  /// Compute the affine form of accesses if the location information makes them affine. 
+  /// This happens once when the View is created so that it's outside of any loop nests that use it.
+  void init_affine();
+
+  ///
+  /// Compute the linear index of coords (not permuted) with the affine form
+  template <int Depth>
+  dvar<loop_type> affine_offset(darr<loop_type,Rank> &coords);
+
   MeshLocation<Rank> block_location;
   MeshLocation<Rank> view_location;
   std::array<int,Rank> permuted_indices;
+
+  // shared between copies so the affine form is only computed once
+  std::shared_ptr<AffineForm<Rank>> affine;
   
 };
 
@@ -407,6 +447,12 @@ struct Ref : public Expr<Ref<BlockLike,Idxs>> {
 //  template <typename Rhs, typename std::enable_if<is_dyn_like<Rhs>::value, int>::type=0>
   void operator=(builder::builder rhs);
 
+  ///
+  /// Set extent to the extent of Iter C if it's used directly as an index within this Ref.
+  /// Used for finding the bounds of reductions.
+  template <char C>
+  bool iter_extent(IterExtent &extent);
+
   Idxs idxs;
   BlockLike block_like;
 
@@ -429,10 +475,65 @@ private:
   void realize_each(LhsIdxs lhs, const darr<loop_type,N> &iters,
 		    darr<loop_type,BlockLike::Rank_T> &out);
   
+  ///
+  /// The loop variables of the tile loops of an inline statement. nullptr if a
+  /// dimension isn't tiled.
+  using TileVars = std::array<dvar<loop_type>*,BlockLike::Rank_T>;
+
+  ///
+  /// Create the outer tile loops for this ref (if any were requested), then the 
+  /// rest of the loop nest.
+  template <int Depth, typename Rhs>
+  void realize_tile_loops(const OptList &opts, TileVars tiles, Rhs rhs);
+
   ///
   /// Create the loop nest for this ref and also evaluate the rhs.
+  /// opts are the optimizations requested for this statement.
   template <typename Rhs, typename...Iters>
-  void realize_loop_nest(Rhs rhs, Iters...iters);
+  void realize_loop_nest(const OptList &opts, const TileVars &tiles, Rhs rhs, Iters...iters);
+
+  ///
+  /// Create the loop over [lo(),hi()) for the next Iter of this ref and continue the loop nest within it.
+  /// The bounds are generated inline in the loop header so that nests stay perfectly nested.
+  template <typename Lo, typename Hi, typename Rhs, typename...Iters>
+  void realize_point_loop(const OptList &opts, const TileVars &tiles, bool is_outermost, bool is_innermost,
+			  Lo lo, Hi hi, Rhs rhs, Iters...iters);
+
+  ///
+  /// Write the rhs at a single point of the loop nest
+  template <typename Rhs, unsigned long N>
+  void write_point(Rhs rhs, darr<loop_type,N> &iters);
+
+  ///
+  /// Create the loop nest for this statement, or add it to the current fused region
+  /// if there is one.
+  template <typename Rhs>
+  void realize_statement(const OptList &opts, Rhs rhs);
+
+  ///
+  /// Write the rhs at a single point of a fused loop nest. iters are the loop variables 
+  /// of the first statement in the fused group.
+  template <typename Rhs>
+  void realize_fused_point(Rhs rhs, const darr<loop_type,BlockLike::Rank_T> &iters);
+
+  ///
+  /// Helper method for realize_fused_point. Uses iters for the dims indexed by an Iter and
+  /// this ref's own indices otherwise.
+  template <int Depth>
+  void fused_iters(const darr<loop_type,BlockLike::Rank_T> &iters, darr<loop_type,BlockLike::Rank_T> &out);
+
+  ///
+  /// The extents of the lhs of an inline statement
+  Loc_T<BlockLike::Rank_T> lhs_extents();
+
+  ///
+  /// Extent d of the lhs of an inline statement, as a literal if it's known during staging
+  LoopBound_T lhs_extent(int d);
+
+  ///
+  /// Helper method for iter_extent
+  template <char C, int Depth>
+  bool iter_extent_each(IterExtent &extent);
 
   ///
   /// Verify that the Idxs of this Ref are unadorned. This is used when this is 
@@ -473,7 +574,7 @@ dvar<Elem> Block<Elem,Rank,MultiDimRepr>::read(darr<loop_type,N> &coords) {
     if constexpr (MultiDimRepr==true) {
       return allocator->read(permuted);
     } else {
-      dvar<loop_type> lidx = linearize<0,Rank>(location.get_extents(), permuted);
+      dvar<loop_type> lidx = linearize<0,Rank>(location, permuted);
       darr<loop_type,1> arr{lidx};
       return allocator->read(arr);
     }
@@ -482,7 +583,7 @@ dvar<Elem> Block<Elem,Rank,MultiDimRepr>::read(darr<loop_type,N> &coords) {
     for (int i = 0; i < Rank; i++) {
       permuted[i] = coords[i];
     }
-    dvar<loop_type> lidx = linearize<0,Rank>(location.get_extents(), permuted);
+    dvar<loop_type> lidx = linearize<0,Rank>(location, permuted);
     return allocator[lidx];
 #endif
   }
@@ -527,12 +628,12 @@ void Block<Elem,Rank,MultiDimRepr>::write(ScalarElem val, darr<loop_type,N> &coo
     if constexpr (MultiDimRepr==true) {
       allocator->write(val, coords);
     } else {
-      dvar<loop_type> lidx = linearize<0,Rank>(location.get_extents(), coords);
+      dvar<loop_type> lidx = linearize<0,Rank>(location, coords);
       darr<loop_type,1> arr{lidx};
       allocator->write(val, arr);
     }
 #else
-    dvar<loop_type> lidx = linearize<0,Rank>(location.get_extents(), coords);
+    dvar<loop_type> lidx = linearize<0,Rank>(location, coords);
     allocator.write(lidx, val);
 #endif
   }
@@ -590,21 +691,21 @@ View<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::colocate(View<Elem2,
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
 template <typename...Factors>
 View<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::virtually_refine(Factors...factors) {
-  SLoc_T rfactors{factors...};
+  LocParam<Rank> rfactors{factors...};
   return {location, location.refine(rfactors), allocator};
 }
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
 template <typename...Factors>
 Block<Elem,Rank,false> Block<Elem,Rank,MultiDimRepr>::physically_refine(Factors...factors) {
-  SLoc_T rfactors{factors...};
+  LocParam<Rank> rfactors{factors...};
   return {location.refine(rfactors)};
 }
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
 template <typename...Factors>
 Block<Elem,Rank,false> Block<Elem,Rank,MultiDimRepr>::physically_coarsen(Factors...factors) {
-  SLoc_T cfactors{factors...};
+  LocParam<Rank> cfactors{factors...};
   return {location.coarsen(cfactors)};
 }
 
@@ -649,9 +750,20 @@ View<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::slice(Slices...slice
   for (svar<int> i = 0; i < Rank; i=i+1) {
     vorigin[i] = vorigin[i] * location.get_strides()[i] + location.get_origin()[i];
   }
+  // and the same for whatever is known during staging
+  Static_T<Rank> svorigin;
+  Static_T<Rank> svextents;
+  Static_T<Rank> svstrides;
+  gather_static<0,Rank>(svorigin, svextents, svstrides, location.get_static_extents(), slices...);
+  Static_T<Rank> ones = static_fill<Rank>(1);
   return {
     location,
-    LocationBuilder<Rank>().with_extents(vextents).with_strides(strides).with_origin(vorigin).with_refinement(location.get_refinement_factors()).with_coarsening(location.get_coarsening_factors()).to_loc(),
+    LocationBuilder<Rank>().
+    with_extents(LocParam<Rank>(vextents, svextents)).
+    with_strides(LocParam<Rank>(strides, static_scale<Rank>(location.get_static_strides(), svstrides, ones))).
+    with_origin(LocParam<Rank>(vorigin, static_affine<Rank>(svorigin, location.get_static_strides(), 
+							    location.get_static_origin()))).
+    with_factors(location).to_loc(),
     this->allocator};
 }
 
@@ -730,22 +842,22 @@ Block<Elem,Rank,MultiDimRepr>::Block(MeshLocation<Rank> location) : location(loc
 }
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
-Block<Elem,Rank,MultiDimRepr>::Block(SLoc_T bextents, SLoc_T bstrides, SLoc_T borigin) :
+Block<Elem,Rank,MultiDimRepr>::Block(LocParam<Rank> bextents, LocParam<Rank> bstrides, LocParam<Rank> borigin) :
   location(LocationBuilder<Rank>().
 	   with_extents(bextents).
 	   with_strides(bstrides).
 	   with_origin(borigin).to_loc()) {
   static_assert(!MultiDimRepr);
 #ifndef UNSTAGED
-  this->allocator = std::make_shared<HeapAllocation<Elem>>(reduce<MulFunctor>(bextents));
+  this->allocator = std::make_shared<HeapAllocation<Elem>>(reduce<MulFunctor>(bextents.loc));
 #else
-  this->allocator = HeapArray<Elem>(reduce<MulFunctor>(bextents));
+  this->allocator = HeapArray<Elem>(reduce<MulFunctor>(bextents.loc));
 #endif
 }
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
-Block<Elem,Rank,MultiDimRepr>::Block(SLoc_T bextents, SLoc_T bstrides, SLoc_T borigin, 
-				     SLoc_T brefinement_factors, SLoc_T bcoarsening_factors) :
+Block<Elem,Rank,MultiDimRepr>::Block(LocParam<Rank> bextents, LocParam<Rank> bstrides, LocParam<Rank> borigin, 
+				     LocParam<Rank> brefinement_factors, LocParam<Rank> bcoarsening_factors) :
   location(LocationBuilder<Rank>().
 	   with_extents(bextents).
 	   with_strides(bstrides).
@@ -754,26 +866,26 @@ Block<Elem,Rank,MultiDimRepr>::Block(SLoc_T bextents, SLoc_T bstrides, SLoc_T bo
 	   with_coarsening(bcoarsening_factors).to_loc()) {
   static_assert(!MultiDimRepr);
 #ifndef UNSTAGED
-  this->allocator = std::make_shared<HeapAllocation<Elem>>(reduce<MulFunctor>(bextents));
+  this->allocator = std::make_shared<HeapAllocation<Elem>>(reduce<MulFunctor>(bextents.loc));
 #else
-  this->allocator = HeapArray<Elem>(reduce<MulFunctor>(bextents));
+  this->allocator = HeapArray<Elem>(reduce<MulFunctor>(bextents.loc));
 #endif
 }
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
-Block<Elem,Rank,MultiDimRepr>::Block(SLoc_T bextents) : 
+Block<Elem,Rank,MultiDimRepr>::Block(LocParam<Rank> bextents) : 
   location(LocationBuilder<Rank>().
 	   with_extents(bextents).to_loc()) {
   static_assert(!MultiDimRepr);
 #ifndef UNSTAGED
-  this->allocator = std::make_shared<HeapAllocation<Elem>>(reduce<MulFunctor>(bextents));
+  this->allocator = std::make_shared<HeapAllocation<Elem>>(reduce<MulFunctor>(bextents.loc));
 #else
-  this->allocator = HeapArray<Elem>(reduce<MulFunctor>(std::move(bextents)));
+  this->allocator = HeapArray<Elem>(reduce<MulFunctor>(bextents.loc));
 #endif
 }
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
-Block<Elem,Rank,MultiDimRepr>::Block(SLoc_T bextents, 
+Block<Elem,Rank,MultiDimRepr>::Block(LocParam<Rank> bextents, 
 				     Allocation_T<Elem,physical<Rank,MultiDimRepr>()> allocator) : 
   location(LocationBuilder<Rank>().
 	   with_extents(bextents).to_loc()), 
@@ -781,8 +893,8 @@ Block<Elem,Rank,MultiDimRepr>::Block(SLoc_T bextents,
 }
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
-Block<Elem,Rank,MultiDimRepr>::Block(SLoc_T bextents, SLoc_T bstrides, SLoc_T borigin,
-				     SLoc_T brefinement_factors, SLoc_T bcoarsening_factors,
+Block<Elem,Rank,MultiDimRepr>::Block(LocParam<Rank> bextents, LocParam<Rank> bstrides, LocParam<Rank> borigin,
+				     LocParam<Rank> brefinement_factors, LocParam<Rank> bcoarsening_factors,
 				     Allocation_T<Elem,physical<Rank,MultiDimRepr>()> allocator) :
   location(LocationBuilder<Rank>().
 	   with_extents(bextents).
@@ -794,13 +906,35 @@ Block<Elem,Rank,MultiDimRepr>::Block(SLoc_T bextents, SLoc_T bstrides, SLoc_T bo
 }
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
-Block<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::heap(SLoc_T bextents) {
+Block<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::heap(LocParam<Rank> bextents) {
 #ifdef UNSTAGED
   static_assert(!MultiDimRepr);
 #endif
   return Block<Elem,Rank,MultiDimRepr>(std::move(bextents));
 }    
 
+template <typename Elem, unsigned long Rank, bool MultiDimRepr>
+Block<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::arena(LocParam<Rank> bextents, ArenaInit init,
+								   loop_type alignment) {
+  static_assert(!MultiDimRepr);
+#ifdef UNSTAGED
+  // there's no generated scope to free into, so this is just a heap Block
+  return Block<Elem,Rank,MultiDimRepr>(std::move(bextents));
+#else
+  if (!CompileOptions::isCPP) {
+    std::cerr << "Arena Blocks need C++ output, since their scope frees them (set CompileOptions::isCPP)" << std::endl;
+    exit(-1);
+  }
+  if (alignment <= 0 || (alignment & (alignment - 1)) != 0) {
+    std::cerr << "Arena alignment must be a power of 2, not " << alignment << std::endl;
+    exit(-1);
+  }
+  auto allocator = std::make_shared<ArenaAllocation<Elem>>(reduce<MulFunctor>(bextents.loc), alignment,
+							   init == ArenaInit::Zeroed);
+  return Block<Elem,Rank,MultiDimRepr>(std::move(bextents), allocator);
+#endif
+}
+
 #ifndef UNSTAGED
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
 template <int...Extents>
@@ -808,7 +942,7 @@ Block<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::stack() {
   // This causes a buildit error if I do static_var (and also make the allocator take a static var)
   loop_type sz = mul_reduce<Extents...>();
   auto allocator = std::make_shared<StackAllocation<Elem>>(sz);
-  SLoc_T extents{Extents...};
+  LocParam<Rank> extents{Extents...};
   return Block<Elem,Rank,MultiDimRepr>(extents, allocator);
 }
 
@@ -818,21 +952,21 @@ Block<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::stack(MeshLocation<
   // This causes a buildit error if I do static_var (and also make the allocator take a static var)
   loop_type sz = mul_reduce<Extents...>();
   auto allocator = std::make_shared<StackAllocation<Elem>>(sz);
-  SLoc_T extents{Extents...};
-  return Block<Elem,Rank,MultiDimRepr>(extents, location.get_strides(), location.get_origin(), 
-				       location.get_refinement_factors(),
-				       location.get_coarsening_factors(),
+  LocParam<Rank> extents{Extents...};
+  return Block<Elem,Rank,MultiDimRepr>(extents, location.strides_param(), location.origin_param(), 
+				       location.refinement_param(),
+				       location.coarsening_param(),
 				       allocator);
 }
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
 template <int...Extents>
-Block<Elem,Rank,false> Block<Elem,Rank,MultiDimRepr>::stack(SLoc_T bstrides, SLoc_T borigin, 
-							    SLoc_T brefinement_factors, SLoc_T bcoarsening_factors) {
+Block<Elem,Rank,false> Block<Elem,Rank,MultiDimRepr>::stack(LocParam<Rank> bstrides, LocParam<Rank> borigin, 
+							    LocParam<Rank> brefinement_factors, LocParam<Rank> bcoarsening_factors) {
   // This causes a buildit error if I do static_var (and also make the allocator take a static var)
   loop_type sz = mul_reduce<Extents...>();
   auto allocator = std::make_shared<StackAllocation<Elem>>(sz);
-  SLoc_T extents{Extents...};
+  LocParam<Rank> extents{Extents...};
   return Block<Elem,Rank,MultiDimRepr>(extents, std::move(bstrides), std::move(borigin),
 				       std::move(brefinement_factors), std::move(bcoarsening_factors), allocator);
 }
@@ -840,10 +974,10 @@ Block<Elem,Rank,false> Block<Elem,Rank,MultiDimRepr>::stack(SLoc_T bstrides, SLo
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
 #ifndef UNSTAGED
-Block<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::user(SLoc_T bextents, 
+Block<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::user(LocParam<Rank> bextents, 
 								  dvar<typename decltype(ptr_wrap<Elem,Rank,MultiDimRepr>())::P> user) {  
 #else
-  Block<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::user(SLoc_T bextents, 
+  Block<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::user(LocParam<Rank> bextents, 
 								    dvar<Elem*> user) {  
 #endif
 #ifdef UNSTAGED
@@ -871,8 +1005,8 @@ Block<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::user(SLoc_T bextent
   }
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
-Block<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::user(SLoc_T bextents, SLoc_T bstrides, SLoc_T borigin,
-								  SLoc_T brefinement_factors, SLoc_T bcoarsening_factors,
+Block<Elem,Rank,MultiDimRepr> Block<Elem,Rank,MultiDimRepr>::user(LocParam<Rank> bextents, LocParam<Rank> bstrides, LocParam<Rank> borigin,
+								  LocParam<Rank> brefinement_factors, LocParam<Rank> bcoarsening_factors,
 								  dvar<typename decltype(ptr_wrap<Elem,Rank,MultiDimRepr>())::P> user) {  
   // make sure that the dyn_var passed in matches the actual storage type (seems like it's not caught otherwise?)
   static_assert((MultiDimRepr && peel<typename decltype(ptr_wrap<Elem,Rank,MultiDimRepr>())::P>() == Rank) || 
@@ -897,6 +1031,7 @@ View<Elem,Rank,MultiDimRepr>::View(MeshLocation<Rank> block_location,
   for (int i = 0; i < Rank; i++) {
     this->permuted_indices[i] = i;
   }
+  init_affine();
 }
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
@@ -906,13 +1041,14 @@ View<Elem,Rank,MultiDimRepr>::View(MeshLocation<Rank> block_location,
 				   std::array<int,Rank> permuted_indices) : 
   block_location(block_location), view_location(view_location), allocator(allocator),
   permuted_indices(permuted_indices) { 
+  init_affine();
 }
 
  template <typename Elem, unsigned long Rank, bool MultiDimRepr>
-   View<Elem,Rank,MultiDimRepr>::View(SLoc_T bextents, SLoc_T bstrides, SLoc_T borigin, 
-				      SLoc_T brefinement_factors, SLoc_T bcoarsening_factors,
-				      SLoc_T vextents, SLoc_T vstrides, SLoc_T vorigin, 
-				      SLoc_T vrefinement_factors, SLoc_T vcoarsening_factors,		     
+   View<Elem,Rank,MultiDimRepr>::View(LocParam<Rank> bextents, LocParam<Rank> bstrides, LocParam<Rank> borigin, 
+				      LocParam<Rank> brefinement_factors, LocParam<Rank> bcoarsening_factors,
+				      LocParam<Rank> vextents, LocParam<Rank> vstrides, LocParam<Rank> vorigin, 
+				      LocParam<Rank> vrefinement_factors, LocParam<Rank> vcoarsening_factors,		     
 				     Allocation_T<Elem,physical<Rank,MultiDimRepr>()> allocator) :
    block_location(LocationBuilder<Rank>().
     with_extents(bextents).
@@ -930,6 +1066,7 @@ View<Elem,Rank,MultiDimRepr>::View(MeshLocation<Rank> block_location,
   for (int i = 0; i < Rank; i++) {
     this->permuted_indices[i] = i;
   }
+  init_affine();
  }      
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
@@ -955,6 +1092,19 @@ dvar<Elem> View<Elem,Rank,MultiDimRepr>::read(darr<loop_type,N> &coords) {
   } else {
     static_assert(N == Rank);
     // manually specified all the dimensions (can happen with ref reads)
+    if constexpr (!MultiDimRepr) {
+      if (affine) {
+	// the base offset and coefficients are precomputed, so this is just a dot product
+	LoopBound_T base = affine->known_base != not_static ? (LoopBound_T)affine->known_base : (LoopBound_T)affine->base;
+	dvar<loop_type> lidx = base + affine_offset<0>(coords);
+#ifndef UNSTAGED
+	darr<loop_type,1> arr{lidx};
+	return allocator->read(arr);
+#else
+	return allocator[lidx];
+#endif
+      }
+    }
     // first get the global location
     // bi0 = vi0 * vstride0 + vorigin0
     darr<loop_type,Rank> permuted;
@@ -962,22 +1112,18 @@ dvar<Elem> View<Elem,Rank,MultiDimRepr>::read(darr<loop_type,N> &coords) {
       permuted[permuted_indices[i]] = coords[i];
     }
     darr<loop_type,Rank> bcoords;
-    compute_block_mesh_space_location<0>(permuted, bcoords);
-    // now adjust to make it relative to the block
-    for (svar<int> i = 0; i < N; i=i+1) {
-      bcoords[i] = (bcoords[i] - block_location.get_origin()[i]) / block_location.get_strides()[i];
-    }
+    compute_block_coords(permuted, bcoords);
     // then linearize with respect to the block
 #ifndef UNSTAGED
     if constexpr (MultiDimRepr==true) {
       return allocator->read(bcoords);
     } else {
-      dvar<loop_type> lidx = linearize<0,Rank>(block_location.get_extents(), bcoords);
+      dvar<loop_type> lidx = linearize<0,Rank>(block_location, bcoords);
       darr<loop_type,1> arr{lidx};
       return allocator->read(arr);
     }
 #else
-    dvar<loop_type> lidx = linearize<0,Rank>(block_location.get_extents(), bcoords);
+    dvar<loop_type> lidx = linearize<0,Rank>(block_location, bcoords);
     return allocator[lidx];
 #endif
   }
@@ -1017,27 +1163,37 @@ void View<Elem,Rank,MultiDimRepr>::write(ScalarElem val, darr<loop_type,N> &coor
   } else {
     static_assert(N == Rank);
     // manually specified all the dimensions (can happen with ref writes)
+    if constexpr (!MultiDimRepr) {
+      if (affine) {
+	// the base offset and coefficients are precomputed, so this is just a dot product
+	LoopBound_T base = affine->known_base != not_static ? (LoopBound_T)affine->known_base : (LoopBound_T)affine->base;
+	dvar<loop_type> lidx = base + affine_offset<0>(coords);
+#ifndef UNSTAGED
+	darr<loop_type,1> arr{lidx};
+	allocator->write(val, arr);
+#else
+	allocator.write(lidx, val);
+#endif
+	return;
+      }
+    }
     darr<loop_type,Rank> permuted;
     for (int i = 0; i < Rank; i++) {
       permuted[permuted_indices[i]] = coords[i];
     }
     darr<loop_type,Rank> bcoords;
-    compute_block_mesh_space_location<0>(permuted, bcoords);
-    // now adjust to make it relative to the block
-    for (svar<int> i = 0; i < N; i=i+1) {
-      bcoords[i] = (bcoords[i] - block_location.get_origin()[i]) / block_location.get_strides()[i];
-    }
+    compute_block_coords(permuted, bcoords);
     // then linearize with respect to the block
 #ifndef UNSTAGED
     if constexpr (MultiDimRepr==true) {
       allocator->write(val, bcoords);
     } else {
-      dvar<loop_type> lidx = linearize<0,Rank>(block_location.get_extents(), bcoords);
+      dvar<loop_type> lidx = linearize<0,Rank>(block_location, bcoords);
       darr<loop_type,1> arr{lidx};
       allocator->write(val, arr);
     }
 #else
-    dvar<loop_type> lidx = linearize<0,Rank>(block_location.get_extents(), bcoords);
+    dvar<loop_type> lidx = linearize<0,Rank>(block_location, bcoords);
     allocator.write(lidx, val);
 #endif
   }
@@ -1089,21 +1245,21 @@ View<Elem,Rank,MultiDimRepr> View<Elem,Rank,MultiDimRepr>::colocate(View<Elem2,R
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
 template <typename...Factors>
 View<Elem,Rank,MultiDimRepr> View<Elem,Rank,MultiDimRepr>::virtually_refine(Factors...factors) {
-  SLoc_T rfactors{factors...};
+  LocParam<Rank> rfactors{factors...};
   return {block_location, view_location.refine(rfactors), allocator};
 }
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
 template <typename...Factors>
 Block<Elem,Rank,false> View<Elem,Rank,MultiDimRepr>::physically_refine(Factors...factors) {
-  SLoc_T rfactors{factors...};
+  LocParam<Rank> rfactors{factors...};
   return {view_location.refine(rfactors)};
 }
 
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
 template <typename...Factors>
 Block<Elem,Rank,false> View<Elem,Rank,MultiDimRepr>::physically_coarsen(Factors...factors) {
-  SLoc_T cfactors{factors...};
+  LocParam<Rank> cfactors{factors...};
   return {view_location.coarsen(cfactors)};
 }
 
@@ -1149,12 +1305,32 @@ View<Elem,Rank,MultiDimRepr> View<Elem,Rank,MultiDimRepr>::slice(Slices...slices
   // new strides = old strides * new strides
   SLoc_T strides;
   apply<MulFunctor,Rank>(strides, view_location.get_strides(), vstrides);
+  // and the same for whatever is known during staging
+  Static_T<Rank> sextents = view_location.get_static_extents();
+  Static_T<Rank> permuted_sextents;
+  for (int i = 0; i < Rank; i++) {
+    permuted_sextents[i] = sextents[permuted_indices[i]];
+  }
+  Static_T<Rank> svorigin_p;
+  Static_T<Rank> svextents_p;
+  Static_T<Rank> svstrides_p;
+  gather_static<0,Rank>(svorigin_p, svextents_p, svstrides_p, permuted_sextents, slices...);
+  Static_T<Rank> svorigin;
+  Static_T<Rank> svextents;
+  Static_T<Rank> svstrides;
+  for (int i = 0; i < Rank; i++) {
+    svorigin[permuted_indices[i]] = svorigin_p[i];
+    svextents[permuted_indices[i]] = svextents_p[i];
+    svstrides[permuted_indices[i]] = svstrides_p[i];
+  }
+  Static_T<Rank> ones = static_fill<Rank>(1);
   return {block_location, 
-    LocationBuilder<Rank>().with_extents(vextents).
-    with_strides(strides).
-    with_origin(origin).
-    with_refinement(view_location.get_refinement_factors()).
-    with_coarsening(view_location.get_coarsening_factors()).
+    LocationBuilder<Rank>().
+    with_extents(LocParam<Rank>(vextents, svextents)).
+    with_strides(LocParam<Rank>(strides, static_scale<Rank>(view_location.get_static_strides(), svstrides, ones))).
+    with_origin(LocParam<Rank>(origin, static_affine<Rank>(svorigin, view_location.get_static_strides(),
+							   view_location.get_static_origin()))).
+    with_factors(view_location).
     to_loc(),
     allocator};
 }
@@ -1166,18 +1342,95 @@ template <int Depth>
   if constexpr (Depth == Rank) {
   } else {
     dvar<loop_type> rvidx = coords[Depth] * 
-      view_location.get_strides()[Depth] + 
-      view_location.get_origin()[Depth];
-    dvar<loop_type> rbidx = rvidx * 
-      view_location.get_coarsening_factors()[Depth] * 
-      block_location.get_refinement_factors()[Depth] / 
-      (block_location.get_coarsening_factors()[Depth] * 
-       view_location.get_refinement_factors()[Depth]);
-    out[Depth] = rbidx;
+      view_location.stride(Depth) + 
+      view_location.origin_at(Depth);
+    if (view_location.has_unit_factors() && block_location.has_unit_factors()) {
+      // no change of resolution between the view and block
+      out[Depth] = rvidx;
+    } else {
+      dvar<loop_type> rbidx = rvidx * 
+	view_location.get_coarsening_factors()[Depth] * 
+	block_location.get_refinement_factors()[Depth] / 
+	(block_location.get_coarsening_factors()[Depth] * 
+	 view_location.get_refinement_factors()[Depth]);
+      out[Depth] = rbidx;
+    }
     compute_block_mesh_space_location<Depth+1>(coords, out);
   }
 }
 
+template <typename Elem, unsigned long Rank, bool MultiDimRepr>
+void View<Elem,Rank,MultiDimRepr>::compute_block_coords(const darr<loop_type,Rank> &permuted,
+							darr<loop_type,Rank> &bcoords) {
+  compute_block_mesh_space_location<0>(permuted, bcoords);
+  // now adjust to make it relative to the block
+  if (block_location.has_unit_strides()) {
+    for (int i = 0; i < Rank; i++) {
+      bcoords[i] = bcoords[i] - block_location.origin_at(i);
+    }
+  } else {
+    for (int i = 0; i < Rank; i++) {
+      bcoords[i] = (bcoords[i] - block_location.origin_at(i)) / block_location.stride(i);
+    }
+  }
+}
+
+template <typename Elem, unsigned long Rank, bool MultiDimRepr>
+void View<Elem,Rank,MultiDimRepr>::init_affine() {
+  // with unit factors and unit block strides there's no division, so the linear index is
+  // sum((coord[d] * vstride[d] + vorigin[d] - borigin[d]) * pitch[d])
+  if (MultiDimRepr || !block_location.has_unit_strides() || 
+      !view_location.has_unit_factors() || !block_location.has_unit_factors()) {
+    return;
+  }
+  SLoc_T bextents = block_location.get_extents();
+  SLoc_T borigin = block_location.get_origin();
+  SLoc_T vstrides = view_location.get_strides();
+  SLoc_T vorigin = view_location.get_origin();
+  affine = std::make_shared<AffineForm<Rank>>();
+  affine->base = 0;
+  dvar<loop_type> pitch = 1;
+  for (svar<int> i = Rank - 1; i >= 0; i=i-1) {
+    affine->coeffs[i] = vstrides[i] * pitch;
+    affine->base = affine->base + (vorigin[i] - borigin[i]) * pitch;
+    if (i > 0) {
+      pitch = pitch * bextents[i];
+    }
+  }
+  // the same thing for whatever is known during staging
+  Static_T<Rank> sbextents = block_location.get_static_extents();
+  Static_T<Rank> sborigin = block_location.get_static_origin();
+  Static_T<Rank> svstrides = view_location.get_static_strides();
+  Static_T<Rank> svorigin = view_location.get_static_origin();
+  affine->known_base = 0;
+  loop_type spitch = 1;
+  for (int i = Rank - 1; i >= 0; i--) {
+    affine->known_coeffs[i] = spitch == not_static || svstrides[i] == not_static ? 
+      not_static : svstrides[i] * spitch;
+    if (affine->known_base != not_static) {
+      affine->known_base = spitch == not_static || svorigin[i] == not_static || sborigin[i] == not_static ?
+	not_static : affine->known_base + (svorigin[i] - sborigin[i]) * spitch;
+    }
+    if (i > 0) {
+      spitch = spitch == not_static || sbextents[i] == not_static ? not_static : spitch * sbextents[i];
+    }
+  }
+}
+
+template <typename Elem, unsigned long Rank, bool MultiDimRepr>
+template <int Depth>
+dvar<loop_type> View<Elem,Rank,MultiDimRepr>::affine_offset(darr<loop_type,Rank> &coords) {
+  // coords[Depth] is in dim permuted_indices[Depth] of the block
+  loop_type known = affine->known_coeffs[permuted_indices[Depth]];
+  LoopBound_T coeff = known != not_static ? (LoopBound_T)known : (LoopBound_T)affine->coeffs[permuted_indices[Depth]];
+  dvar<loop_type> c = coords[Depth] * coeff;
+  if constexpr (Depth == Rank - 1) {
+    return c;
+  } else {
+    return c + affine_offset<Depth+1>(coords);
+  }
+}
+
 template <typename Elem, unsigned long Rank, bool MultiDimRepr>
 template <typename T>
 void View<Elem,Rank,MultiDimRepr>::dump_data() {
@@ -1282,6 +1535,41 @@ struct VerifyUnique<C, C, Others...> {
   constexpr bool operator()() { return false; }
 };
 
+///
+/// The depth of the first Iter in Idxs, or -1 if there isn't one. This is the 
+/// outermost loop of an inline statement (unless it's tiled).
+template <typename Idxs, int Depth=0>
+constexpr int outermost_iter() {
+  if constexpr (Depth == (int)std::tuple_size<Idxs>()) {
+    return -1;
+  } else if constexpr (is_iter<typename std::tuple_element<Depth,Idxs>::type>::value) {
+    return Depth;
+  } else {
+    return outermost_iter<Idxs,Depth+1>();
+  }
+}
+
+///
+/// Which elements of Idxs are Iters
+template <typename Idxs, size_t...Is>
+constexpr std::array<bool,sizeof...(Is)> iter_mask(std::index_sequence<Is...>) {
+  return {is_iter<typename std::tuple_element<Is,Idxs>::type>::value...};
+}
+
+///
+/// The depth of the last Iter in Idxs, or -1 if there isn't one. This is the 
+/// innermost loop of an inline statement.
+template <typename Idxs, int Depth=(int)std::tuple_size<Idxs>()-1>
+constexpr int innermost_iter() {
+  if constexpr (Depth < 0) {
+    return -1;
+  } else if constexpr (is_iter<typename std::tuple_element<Depth,Idxs>::type>::value) {
+    return Depth;
+  } else {
+    return innermost_iter<Idxs,Depth-1>();
+  }
+}
+
 template <typename BlockLike, typename Idxs>
 template <typename Idx>
 Ref<BlockLike,typename TupleTypeCat<typename RefIdxType<Idx>::type,Idxs>::type> Ref<BlockLike,Idxs>::operator[](Idx idx) {
@@ -1300,6 +1588,8 @@ Ref<BlockLike,typename TupleTypeCat<typename RefIdxType<Idx>::type,Idxs>::type>
 template <typename BlockLike, typename Idxs>
 template <typename Rhs>
 void Ref<BlockLike,Idxs>::internal_assign(Rhs rhs) {
+  // any optimizations requested by the user apply to this statement only
+  OptList opts = Optimization::consume();
   // check that permuted indices are not used here
   if constexpr (!BlockLike::IsBlock_T) {
     for (int i = 0; i < BlockLike::Rank_T; i++) {
@@ -1319,10 +1609,10 @@ void Ref<BlockLike,Idxs>::internal_assign(Rhs rhs) {
     // now combine everything
     auto new_idxs = std::tuple_cat(dyn_arr_to_tuple<pad_amt,0>(std::move(padded)), this->idxs);
     auto new_ref = Ref<BlockLike, decltype(new_idxs)>(this->block_like, std::move(new_idxs));
-    new_ref.realize_loop_nest(rhs);
+    new_ref.realize_statement(opts, rhs);
   } else {
     // no padding or unfreezing needed (you may have frozen dimensions, but they would be overridden in this case)
-    realize_loop_nest(rhs);
+    realize_statement(opts, rhs);
   }
 }
 
@@ -1406,11 +1696,98 @@ dvar<typename BlockLike::Elem_T> Ref<BlockLike,Idxs>::realize(LhsIdxs lhs,
   return block_like.read(arr);
 }
 
+template <typename BlockLike, typename Idxs>
+Loc_T<BlockLike::Rank_T> Ref<BlockLike,Idxs>::lhs_extents() {
+  if constexpr (BlockLike::IsBlock_T) {
+    return block_like.location.get_extents();
+  } else {
+    return block_like.view_location.get_extents();
+  }
+}
+
+template <typename BlockLike, typename Idxs>
+LoopBound_T Ref<BlockLike,Idxs>::lhs_extent(int d) {
+  if constexpr (BlockLike::IsBlock_T) {
+    return block_like.location.extent(d);
+  } else {
+    return block_like.view_location.extent(d);
+  }
+}
+
+template <typename BlockLike, typename Idxs>
+template <char C>
+bool Ref<BlockLike,Idxs>::iter_extent(IterExtent &extent) {
+  return iter_extent_each<C,0>(extent);
+}
+
+template <typename BlockLike, typename Idxs>
+template <char C, int Depth>
+bool Ref<BlockLike,Idxs>::iter_extent_each(IterExtent &extent) {
+  constexpr int nidxs = std::tuple_size<Idxs>();
+  if constexpr (Depth == nidxs) {
+    return false;
+  } else if constexpr (std::is_same<typename std::tuple_element<Depth,Idxs>::type, Iter<C>>::value) {
+    // missing leading indices are padded
+    int dim = BlockLike::Rank_T - nidxs + Depth;
+    if constexpr (!BlockLike::IsBlock_T) {
+      dim = block_like.permuted_indices[dim];
+    }
+    extent.extent = lhs_extents()[dim];
+    if constexpr (BlockLike::IsBlock_T) {
+      extent.known = block_like.location.get_static_extents()[dim];
+    } else {
+      extent.known = block_like.view_location.get_static_extents()[dim];
+    }
+    return true;
+  } else {
+    return iter_extent_each<C,Depth+1>(extent);
+  }
+}
+
+template <typename BlockLike, typename Idxs>
+template <int Depth, typename Rhs>
+void Ref<BlockLike,Idxs>::realize_tile_loops(const OptList &opts, TileVars tiles, Rhs rhs) {
+  constexpr int rank = BlockLike::Rank_T;
+  if constexpr (Depth == 0) {
+    verify_strips(opts, rank);
+    verify_collapse(opts, iter_mask<Idxs>(std::make_index_sequence<rank>()));
+  }
+  if constexpr (Depth < rank) {
+    int size = strip_size(opts, LOOP_TILE, Depth);
+    if constexpr (is_iter<typename std::tuple_element<Depth,Idxs>::type>::value) {
+      if (size > 0) {
+	// the first tile loop is the outermost loop of the nest
+	bool is_outermost = true;
+	for (int d = 0; d < Depth; d++) {
+	  if (strip_size(opts, LOOP_TILE, d) > 0) {
+	    is_outermost = false;
+	  }
+	}
+	annotate_inline_loop(opts, is_outermost, false);
+	for (dvar<loop_type> tile = 0; tile < lhs_extent(Depth); tile = tile + size) {
+	  tiles[Depth] = &tile;
+	  realize_tile_loops<Depth+1>(opts, tiles, rhs);
+	}
+      } else {
+	realize_tile_loops<Depth+1>(opts, tiles, rhs);
+      }
+    } else {
+      if (size > 0 || strip_size(opts, LOOP_SPLIT, Depth) > 0) {
+	std::cerr << "Only dims indexed by an Iter can be strip-mined (dim " << Depth << ")" << std::endl;
+	exit(-1);
+      }
+      realize_tile_loops<Depth+1>(opts, tiles, rhs);
+    }
+  } else {
+    realize_loop_nest(opts, tiles, rhs);
+  }
+}
+
 template <typename BlockLike, typename Idxs>
 template <typename Rhs, typename...Iters>
-void Ref<BlockLike,Idxs>::realize_loop_nest(Rhs rhs, Iters...iters) {
+void Ref<BlockLike,Idxs>::realize_loop_nest(const OptList &opts, const TileVars &tiles, Rhs rhs, Iters...iters) {
   // the lhs indices can be either an Iter or an integer.
-  // Iter -> loop over whole extent
+  // Iter -> loop over whole extent (or the current tile/strip if it's strip-mined)
   // integer -> single iteration loop
   constexpr int rank = BlockLike::Rank_T;
   constexpr int depth = sizeof...(Iters);
@@ -1420,27 +1797,137 @@ void Ref<BlockLike,Idxs>::realize_loop_nest(Rhs rhs, Iters...iters) {
 		  is_dyn_like<decltype(dummy)>::value) {
 	// single iter
 	dvar<loop_type> iter = std::get<depth>(idxs);
-	realize_loop_nest(rhs, iters..., iter);
+	realize_loop_nest(opts, tiles, rhs, iters..., iter);
     } else {
       // loop
-      if constexpr (BlockLike::IsBlock_T) {
-	for (dvar<loop_type> iter = 0; iter < block_like.location.get_extents()[depth]; iter = iter + 1) {
-	  realize_loop_nest(rhs, iters..., iter);
+      constexpr bool is_innermost = depth == innermost_iter<Idxs>();
+      bool is_tiled = false;
+      for (int d = 0; d < rank; d++) {
+	if (tiles[d]) {
+	  is_tiled = true;
 	}
-      } else {
-	for (dvar<loop_type> iter = 0; iter < block_like.view_location.get_extents()[depth]; iter = iter + 1) {
-	  realize_loop_nest(rhs, iters..., iter);
+      }
+      // if there are tile loops, the first of those is the outermost loop
+      bool is_outermost = !is_tiled && depth == outermost_iter<Idxs>();
+      int split = strip_size(opts, LOOP_SPLIT, depth);
+      if (tiles[depth]) {
+	// point loop within the current tile
+	int size = strip_size(opts, LOOP_TILE, depth);
+	dvar<loop_type> &tile = *tiles[depth];
+	realize_point_loop(opts, tiles, is_outermost, is_innermost, 
+			   [&]() -> LoopBound_T { return (LoopBound_T)tile; },
+			   [&]() -> LoopBound_T { return hmin(tile + size, lhs_extent(depth)); }, rhs, iters...);
+      } else if (split > 0) {
+	annotate_inline_loop(opts, is_outermost, false);
+	for (dvar<loop_type> strip = 0; strip < lhs_extent(depth); strip = strip + split) {
+	  realize_point_loop(opts, tiles, false, is_innermost, 
+			     [&]() -> LoopBound_T { return (LoopBound_T)strip; },
+			     [&]() -> LoopBound_T { return hmin(strip + split, lhs_extent(depth)); }, rhs, iters...);
 	}
+      } else {
+	realize_point_loop(opts, tiles, is_outermost, is_innermost, 
+			   []() -> LoopBound_T { return 0; },
+			   [&]() -> LoopBound_T { return lhs_extent(depth); }, rhs, iters...);
       }
     }
   } else {
     // at the innermost level
     darr<loop_type,sizeof...(Iters)> arr{iters...};
-    if constexpr (std::is_arithmetic<Rhs>() ||
-		  is_dyn_like<Rhs>::value) {
-      block_like.write(rhs, arr);
-    } else {      
-      block_like.write(rhs.realize(idxs, arr), arr);
+    write_point(rhs, arr);
+  }
+}
+
+template <typename BlockLike, typename Idxs>
+template <typename Rhs, unsigned long N>
+void Ref<BlockLike,Idxs>::write_point(Rhs rhs, darr<loop_type,N> &iters) {
+  if constexpr (is_fused_body<Rhs>::value) {
+    // each statement in the fused group does its own write
+    rhs(iters);
+  } else if constexpr (std::is_arithmetic<Rhs>() ||
+		       is_dyn_like<Rhs>::value) {
+    block_like.write(rhs, iters);
+  } else {      
+    block_like.write(rhs.realize(idxs, iters), iters);
+  }
+}
+
+template <typename BlockLike, typename Idxs>
+template <typename Rhs>
+void Ref<BlockLike,Idxs>::realize_statement(const OptList &opts, Rhs rhs) {
+  constexpr unsigned long rank = BlockLike::Rank_T;
+  FusionRegion *region = FusionRegion::active;
+  if (!region) {
+    realize_tile_loops<0>(opts, {}, rhs);
+    return;
+  }
+  if (!opts.empty()) {
+    std::cerr << "Optimizations for a fused region must be requested before the call to fuse" << std::endl;
+    exit(-1);
+  }
+  // the statement is generated when the group it ends up in is flushed, so hold onto a copy
+  auto &group = region->group_for<rank>(iter_mask<Idxs>(std::make_index_sequence<rank>()));
+  Ref<BlockLike,Idxs> self = *this;
+  if (group.bodies.empty()) {
+    // the first statement in the group creates the shared loop nest
+    group.realize = [self](const OptList &opts, FusedBody<rank> body) mutable {
+      self.template realize_tile_loops<0>(opts, {}, body);
+    };
+  }
+  group.bodies.push_back([self, rhs](const darr<loop_type,rank> &iters) mutable {
+    self.realize_fused_point(rhs, iters);
+  });
+  group.standalones.push_back([self, rhs](const OptList &opts) mutable {
+    self.template realize_tile_loops<0>(opts, {}, rhs);
+  });
+  group.extents.push_back([self]() mutable {
+    return self.lhs_extents();
+  });
+}
+
+template <typename BlockLike, typename Idxs>
+template <typename Rhs>
+void Ref<BlockLike,Idxs>::realize_fused_point(Rhs rhs, const darr<loop_type,BlockLike::Rank_T> &iters) {
+  darr<loop_type,BlockLike::Rank_T> arr;
+  fused_iters<0>(iters, arr);
+  write_point(rhs, arr);
+}
+
+template <typename BlockLike, typename Idxs>
+template <int Depth>
+void Ref<BlockLike,Idxs>::fused_iters(const darr<loop_type,BlockLike::Rank_T> &iters, 
+				      darr<loop_type,BlockLike::Rank_T> &out) {
+  if constexpr (Depth < (int)BlockLike::Rank_T) {
+    if constexpr (is_iter<typename std::tuple_element<Depth,Idxs>::type>::value) {
+      out[Depth] = iters[Depth];
+    } else {
+      out[Depth] = std::get<Depth>(idxs);
+    }
+    fused_iters<Depth+1>(iters, out);
+  }
+}
+
+template <typename BlockLike, typename Idxs>
+template <typename Lo, typename Hi, typename Rhs, typename...Iters>
+void Ref<BlockLike,Idxs>::realize_point_loop(const OptList &opts, const TileVars &tiles, 
+					     bool is_outermost, bool is_innermost,
+					     Lo lo, Hi hi, Rhs rhs, Iters...iters) {
+  int factor = is_innermost ? unroll_factor(opts) : 0;
+  if (factor > 1) {
+    // unrolled main loop, then the remainder
+    annotate_inline_loop(opts, is_outermost, is_innermost);
+    for (dvar<loop_type> iter = lo(); iter < lo() + (hi() - lo()) / factor * factor; iter = iter + factor) {
+      for (svar<int> u = 0; u < factor; u = u + 1) {
+	dvar<loop_type> uiter = iter + u;
+	realize_loop_nest(opts, tiles, rhs, iters..., uiter);
+      }
+    }
+    for (dvar<loop_type> iter = lo() + (hi() - lo()) / factor * factor; iter < hi(); iter = iter + 1) {
+      realize_loop_nest(opts, tiles, rhs, iters..., iter);
+    }
+  } else {
+    annotate_inline_loop(opts, is_outermost, is_innermost);
+    for (dvar<loop_type> iter = lo(); iter < hi(); iter = iter + 1) {
+      realize_loop_nest(opts, tiles, rhs, iters..., iter);
     }
   }
 }
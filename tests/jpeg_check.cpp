@@ -0,0 +1,136 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// End to end checks of the JPEG apps, on a synthetic image so the tests don't need any data.
+//   jpeg_check roundtrip <jpeg> <jpegd> <H> <W> <444|422|420> <restart interval> <min PSNR>
+// encodes the image, decodes it again, and checks the PSNR against the original.
+//   jpeg_check stream <jpeg> <H> <W> <444|422|420> <restart interval>
+// encodes the image in whole and stream mode, and checks the outputs are byte for byte the same.
+
+// Smooth gradients and waves, with a little noise so the blocks aren't all DC
+static vector<uint8_t> synthetic_image(int H, int W) {
+  vector<uint8_t> RGB(H * W * 3);
+  unsigned seed = 1;
+  for (int y = 0; y < H; y++) {
+    for (int x = 0; x < W; x++) {
+      seed = seed * 1103515245 + 12345;
+      int noise = (int)((seed >> 16) % 7) - 3;
+      int v[3] = {(int)(128 + 90 * sin(x * 0.09 + y * 0.04)) + noise,
+		  (x * 200) / max(W - 1, 1) + 30 + noise,
+		  (int)(128 + 80 * cos(y * 0.13)) + noise};
+      for (int c = 0; c < 3; c++) {
+	RGB[(y * W + x) * 3 + c] = (uint8_t)max(0, min(255, v[c]));
+      }
+    }
+  }
+  return RGB;
+}
+
+static void write_ppm(const string &fn, const vector<uint8_t> &RGB, int H, int W) {
+  ofstream out(fn, ios::binary);
+  out << "P6\n" << W << " " << H << "\n255\n";
+  out.write((const char*)RGB.data(), RGB.size());
+}
+
+static bool read_ppm(const string &fn, vector<uint8_t> &RGB, int &H, int &W) {
+  ifstream in(fn, ios::binary);
+  string magic;
+  int max_val;
+  if (!(in >> magic >> W >> H >> max_val) || magic != "P6" || max_val != 255)
+    return false;
+  in.get();
+  RGB.resize(H * W * 3);
+  return (bool)in.read((char*)RGB.data(), RGB.size());
+}
+
+// Paths are quoted, so the build directory can have spaces
+static bool run(const vector<string> &args) {
+  stringstream cmd;
+  for (auto &arg : args) {
+    cmd << "\"" << arg << "\" ";
+  }
+  cmd << "> /dev/null";
+  if (system(cmd.str().c_str()) != 0) {
+    cerr << "Failed: " << cmd.str() << endl;
+    return false;
+  }
+  return true;
+}
+
+static bool read_file(const string &fn, string &contents) {
+  ifstream in(fn, ios::binary);
+  stringstream ss;
+  ss << in.rdbuf();
+  contents = ss.str();
+  return (bool)in;
+}
+
+static int roundtrip(const string &jpeg, const string &jpegd, int H, int W, const string &sampling,
+		     const string &restart_interval, double min_psnr) {
+  // named after the encoder too, since tests of jpeg_v1 and jpeg_v2 can run at the same time
+  string name = jpeg.substr(jpeg.find_last_of('/') + 1) + "_roundtrip_" + sampling + "_" + restart_interval +
+    "_" + to_string(H) + "x" + to_string(W);
+  vector<uint8_t> original = synthetic_image(H, W);
+  write_ppm(name + ".ppm", original, H, W);
+  if (!run({jpeg, name + ".ppm", name + ".jpg", restart_interval, sampling}) ||
+      !run({jpegd, name + ".jpg", name + "_decoded.ppm"}))
+    return 1;
+  vector<uint8_t> decoded;
+  int dH, dW;
+  if (!read_ppm(name + "_decoded.ppm", decoded, dH, dW) || dH != H || dW != W) {
+    cerr << "The decoded image isn't a " << H << "x" << W << " PPM" << endl;
+    return 1;
+  }
+  double err = 0;
+  for (size_t i = 0; i < original.size(); i++) {
+    double d = (double)original[i] - decoded[i];
+    err += d * d;
+  }
+  double psnr = err == 0 ? INFINITY : 10 * log10(255.0 * 255.0 * original.size() / err);
+  cout << name << ": PSNR " << psnr << " dB" << endl;
+  if (psnr < min_psnr) {
+    cerr << "PSNR is below " << min_psnr << " dB" << endl;
+    return 1;
+  }
+  return 0;
+}
+
+static int stream(const string &jpeg, int H, int W, const string &sampling, const string &restart_interval) {
+  string name = jpeg.substr(jpeg.find_last_of('/') + 1) + "_stream_" + sampling + "_" + restart_interval +
+    "_" + to_string(H) + "x" + to_string(W);
+  write_ppm(name + ".ppm", synthetic_image(H, W), H, W);
+  if (!run({jpeg, name + ".ppm", name + "_whole.jpg", restart_interval, sampling, "whole"}) ||
+      !run({jpeg, name + ".ppm", name + "_stream.jpg", restart_interval, sampling, "stream"}))
+    return 1;
+  string whole, streamed;
+  if (!read_file(name + "_whole.jpg", whole) || !read_file(name + "_stream.jpg", streamed)) {
+    cerr << "Couldn't read the encoded images" << endl;
+    return 1;
+  }
+  if (whole.empty() || whole != streamed) {
+    cerr << name << ": the whole and stream outputs differ" << endl;
+    return 1;
+  }
+  cout << name << ": " << whole.size() << " bytes, identical" << endl;
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  string mode = argc > 1 ? argv[1] : "";
+  if (mode == "roundtrip" && argc == 9) {
+    return roundtrip(argv[2], argv[3], atoi(argv[4]), atoi(argv[5]), argv[6], argv[7], atof(argv[8]));
+  } else if (mode == "stream" && argc == 7) {
+    return stream(argv[2], atoi(argv[3]), atoi(argv[4]), argv[5], argv[6]);
+  }
+  cerr << "Usage: ./jpeg_check roundtrip <jpeg> <jpegd> <H> <W> <444|422|420> <restart interval> <min PSNR>" << endl;
+  cerr << "       ./jpeg_check stream <jpeg> <H> <W> <444|422|420> <restart interval>" << endl;
+  return 1;
+}
@@ -0,0 +1,48 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/test_utils.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+// tiled and split inline statements, where the extents aren't multiples of the strips
+static void staged() {
+  Iter<'i'> i;
+  Iter<'j'> j;
+  auto block = Block<int,2>::heap({10,7});
+  Tile::apply(0, 4);
+  Tile::apply(1, 3);
+  block[i][j] = i*7+j;
+  for (dyn_var<loop_type> r = 0; r < 10; r = r + 1) {
+    for (dyn_var<loop_type> c = 0; c < 7; c = c + 1) {
+      ASSERT(block(r,c) == r*7+c);
+    }
+  }
+  auto block2 = Block<int,2>::heap({10,7});
+  Split::apply(1, 4);
+  Vectorize::apply();
+  block2[i][j] = block[i][j] + 1;
+  for (dyn_var<loop_type> r = 0; r < 10; r = r + 1) {
+    for (dyn_var<loop_type> c = 0; c < 7; c = c + 1) {
+      ASSERT(block2(r,c) == r*7+c+1);
+    }
+  }
+  // tile a strided view
+  auto view = block2.slice(range(1,10,2), range(0,7,1));
+  Tile::apply(0, 2);
+  view[i][j] = 0;
+  ASSERT(block2(9,6) == 0);
+  ASSERT(block2(1,0) == 0);
+  ASSERT(block2(8,6) == 63);
+  ASSERT(block2(0,0) == 1);
+}
+
+int main() {
+  test_stage(staged, __FILE__);
+}
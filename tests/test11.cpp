@@ -0,0 +1,53 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/test_utils.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+// several optimizations composed on the same loops
+static void staged() {
+  Iter<'i'> i;
+  Iter<'j'> j;
+  Iter<'k'> k;
+  auto block = Block<int,3>::heap({4,5,7});
+  Parallel::apply(2);
+  Collapse::apply(2);
+  Schedule::apply("static", 2);
+  Vectorize::apply();
+  Unroll::apply(3);
+  block[i][j][k] = i*35+j*7+k;
+  for (dyn_var<loop_type> r = 0; r < 4; r = r + 1) {
+    for (dyn_var<loop_type> c = 0; c < 5; c = c + 1) {
+      for (dyn_var<loop_type> d = 0; d < 7; d = d + 1) {
+        ASSERT(block(r,c,d) == r*35+c*7+d);
+      }
+    }
+  }
+  // unrolled and tiled
+  auto block2 = Block<int,2>::heap({10,7});
+  Tile::apply(0, 4);
+  Unroll::apply(2);
+  block2[i][j] = block[2][4][j] + i;
+  ASSERT(block2(9,6) == 2*35+4*7+6+9);
+  ASSERT(block2(0,0) == 2*35+4*7);
+  // actual loops
+  auto block3 = Block<int,1>::heap({9});
+  annotate_loop(Parallel(2), Schedule("dynamic", 1), Unroll(2));
+  for (dyn_var<loop_type> r = 0; r < 9; r = r + 1) {
+    block3[r] = r*2;
+  }
+  for (dyn_var<loop_type> r = 0; r < 9; r = r + 1) {
+    ASSERT(block3(r) == r*2);
+  }
+}
+
+int main() {
+  test_stage(staged, __FILE__);
+}
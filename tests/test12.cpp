@@ -0,0 +1,51 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/test_utils.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+// fused inline statements
+static void staged() {
+  Iter<'i'> i;
+  Iter<'j'> j;
+  auto in = Block<int,2>::heap({6,5});
+  in[i][j] = i*5+j;
+  // same shape, with fixed indices in different positions
+  auto out = Block<int,3>::heap({3,6,5});
+  Vectorize::apply();
+  fuse([&]() {
+    out[0][i][j] = in[i][j];
+    out[1][i][j] = in[i][j] * 2;
+    out[2][i][j] = in[i][j] + out[0][i][j];
+  });
+  for (dyn_var<loop_type> r = 0; r < 6; r = r + 1) {
+    for (dyn_var<loop_type> c = 0; c < 5; c = c + 1) {
+      ASSERT(out(0,r,c) == r*5+c);
+      ASSERT(out(1,r,c) == (r*5+c)*2);
+      ASSERT(out(2,r,c) == (r*5+c)*2);
+    }
+  }
+  // incompatible statements are split into separate groups, and mismatched extents 
+  // fall back to the unfused nests
+  auto small = Block<int,2>::heap({2,5});
+  auto row = Block<int,1>::heap({5});
+  fuse([&]() {
+    small[i][j] = in[i][j] + 1;
+    in[i][j] = 7;
+    row[j] = small[1][j];
+  });
+  ASSERT(small(1,4) == 10);
+  ASSERT(in(5,4) == 7);
+  ASSERT(row(4) == 10);
+}
+
+int main() {
+  test_stage(staged, __FILE__);
+}
@@ -0,0 +1,46 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/test_utils.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+// view accesses with precomputed affine indices, and ones that still need the full computation
+static void staged() {
+  Iter<'i'> i;
+  Iter<'j'> j;
+  auto block = Block<int,2>::heap({6,8});
+  block[i][j] = i*8+j;
+  // strided views
+  auto view = block.slice(range(1,6,2), range(2,8,3));
+  ASSERT(view(0,0) == 10);
+  ASSERT(view(1,1) == 29);
+  ASSERT(view(2,1) == 45);
+  auto view2 = view.slice(range(1,3,1), range(0,2,1));
+  ASSERT(view2(1,0) == 42);
+  // permuted
+  auto perm = block.permute({1,0});
+  ASSERT(perm(2,3) == 26);
+  ASSERT(perm(7,5) == 47);
+  // reads and writes in a loop nest
+  auto out = Block<int,2>::heap({3,2});
+  out[i][j] = view[i][j];
+  ASSERT(out(2,0) == 42);
+  view[i][j] = 0;
+  ASSERT(block(3,5) == 0);
+  ASSERT(block(3,4) == 28);
+  // refined, so the full computation is needed
+  auto refined = block.virtually_refine(2,2);
+  ASSERT(refined(9,9) == 36);
+  ASSERT(refined(7,10) == 0);
+}
+
+int main() {
+  test_stage(staged, __FILE__);
+}
@@ -0,0 +1,72 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/test_utils.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+// reductions over inline expressions
+static void staged() {
+  Iter<'i'> i;
+  Iter<'j'> j;
+  // extents that aren't a multiple of the lanes
+  auto block = Block<int,2>::heap({5,7});
+  block[i][j] = i*7 - j;
+  dyn_var<int> s = sum(block[i][j]);
+  ASSERT(s == 385);
+  dyn_var<int> s1 = sum<1>(block[i][j]);
+  ASSERT(s1 == 385);
+  dyn_var<int> s8 = sum<8>(block[i][j] * 2);
+  ASSERT(s8 == 770);
+  dyn_var<int> a = sum(habs(block[i][j]));
+  ASSERT(a == 427);
+  dyn_var<int> lo = min(block[i][j]);
+  ASSERT(lo == -6);
+  dyn_var<int> hi = max<3>(block[i][j]);
+  ASSERT(hi == 28);
+  // min and max in the type of the elements, rather than a loop_type
+  auto wide = Block<int64_t,1>::heap({4});
+  wide[i] = cast<int64_t>(i) * (int64_t)3000000000;
+  dyn_var<int64_t> wide_hi = max(wide[i]);
+  ASSERT(wide_hi == (int64_t)9000000000);
+  dyn_var<int64_t> wide_lo = min(-wide[i]);
+  ASSERT(wide_lo == (int64_t)-9000000000);
+  // permuted
+  auto perm = block.permute({1,0});
+  dyn_var<int> ps = sum(perm[i][j] - block[j][i]);
+  ASSERT(ps == 0);
+  // early exits stop after the first checked row that passes the threshold
+  dyn_var<int> threshold = 50;
+  dyn_var<int> u1 = sum_until(block[i][j], threshold);
+  ASSERT(u1 == 84);
+  dyn_var<int> u2 = sum_until<2>(block[i][j], threshold);
+  ASSERT(u2 == 210);
+  dyn_var<int> high = 1000;
+  dyn_var<int> u3 = sum_until<3,1>(block[i][j], high);
+  ASSERT(u3 == 385);
+  // several sums in one loop nest
+  dyn_arr<int,3> each;
+  sum_each(each, block[i][j], habs(block[i][j]), perm[j][i] * 2);
+  ASSERT(each[0] == 385);
+  ASSERT(each[1] == 427);
+  ASSERT(each[2] == 770);
+  // argmin keeps the first of equal costs
+  dyn_var<int> best;
+  dyn_var<int> cost;
+  argmin<5>(best, cost, [&](int k) -> dyn_var<int> {
+    dyn_var<int> c = habs(block(k,2) * 2 - 17);
+    return c;
+  });
+  ASSERT(best == 1);
+  ASSERT(cost == 7);
+}
+
+int main() {
+  test_stage(staged, __FILE__);
+}
@@ -0,0 +1,43 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/test_utils.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+// raw pointers to the data of stack, heap, and user blocks
+static void staged() {
+  Iter<'i'> i;
+  Iter<'j'> j;
+  auto stack = Block<int,2>::stack<4,6>();
+  stack[i][j] = i*6+j;
+  dyn_var<int*> sraw = stack.allocator->raw();
+  ASSERT(sraw[0] == 0);
+  ASSERT(sraw[13] == 13);
+  // writes through the pointer are seen by the block
+  sraw[23] = -1;
+  ASSERT(stack(3,5) == -1);
+  // zero the whole thing
+  stack.allocator->memset(24);
+  ASSERT(stack(3,5) == 0);
+  ASSERT(stack(2,1) == 0);
+  auto heap = Block<int,2>::heap({3,3});
+  heap[i][j] = i+j;
+  dyn_var<int*> hraw = heap.allocator->raw();
+  ASSERT(hraw[8] == 4);
+  auto user = Block<int,2>::user({2,12}, sraw);
+  user[i][j] = j;
+  dyn_var<int*> uraw = user.allocator->raw();
+  ASSERT(uraw[14] == 2);
+  ASSERT(stack(2,2) == 2);
+}
+
+int main() {
+  test_stage(staged, __FILE__);
+}
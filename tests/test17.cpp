@@ -0,0 +1,69 @@
+#include <array>
+#include <filesystem>
+#include <iostream>
+
+#include "builder/dyn_var.h"
+#include "builder/static_var.h"
+#include "staged/staged.h"
+#include "staged/jit.h"
+
+using builder::dyn_var;
+using namespace shim;
+
+// kernels built and loaded at runtime, specialized on values not known until then
+static void scale(dyn_var<int*> data, dyn_var<int> n, int factor) {
+  for (dyn_var<int> i = 0; i < n; i = i + 1) {
+    data[i] = data[i] * factor;
+  }
+}
+
+// specialized on a table, like the quant tables of an encoder
+static void weigh(dyn_var<int*> data, std::array<int,4> weights) {
+  for (builder::static_var<int> k = 0; k < 4; k = k + 1) {
+    data[k] = data[k] * weights[k];
+  }
+}
+
+int main(int argc, char **argv) {
+  CompileOptions::isCPP = true;
+  // with the StageCache on, so different tables must not share a cache entry. The shared
+  // objects are built there too, so the space and quote check the build command's quoting.
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "shim test17's cache";
+  std::filesystem::remove_all(dir);
+  StageCache::dir = dir.string();
+  // pretend this came from the command line
+  int factor = argc + 2;
+  auto triple = jit<void(int*,int)>(scale, "scale", "", factor);
+  auto quintuple = jit<void(int*,int)>(scale, "scale", "", factor + 2);
+  int data[4] = {1, 2, 3, 4};
+  triple(data, 4);
+  quintuple(data, 3);
+  int expected[4] = {15, 30, 45, 12};
+  for (int i = 0; i < 4; i++) {
+    if (data[i] != expected[i]) {
+      std::cerr << "data[" << i << "] is " << data[i] << ", not " << expected[i] << std::endl;
+      return 1;
+    }
+  }
+  // the same specialization again is the same object
+  if (jit<void(int*,int)>(scale, "scale", "", factor) != triple) {
+    std::cerr << "Reloading gave a different function" << std::endl;
+    return 1;
+  }
+  std::array<int,4> ramp = {1, 2, 3, 4};
+  std::array<int,4> flat = {argc, argc, argc, argc};
+  auto weigh_ramp = jit<void(int*)>(weigh, "weigh", "", ramp);
+  auto weigh_flat = jit<void(int*)>(weigh, "weigh", "", flat);
+  int row[4] = {5, 6, 7, 8};
+  weigh_ramp(row);
+  weigh_flat(row);
+  int expected_row[4] = {5, 12, 21, 32};
+  for (int i = 0; i < 4; i++) {
+    if (row[i] != expected_row[i]) {
+      std::cerr << "row[" << i << "] is " << row[i] << ", not " << expected_row[i] << std::endl;
+      return 1;
+    }
+  }
+  std::filesystem::remove_all(dir);
+  return 0;
+}
@@ -0,0 +1,51 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/test_utils.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+// extents known during staging, mixed with ones that aren't
+static void staged() {
+  Iter<'i'> i;
+  Iter<'j'> j;
+  dyn_var<int> rows = 6;
+  dyn_var<int> cols = 9;
+  auto block = Block<int,2>::heap({rows,cols});
+  block[i][j] = i*9 + j;
+  // a fixed size window at a runtime offset
+  dyn_var<int> y = 1;
+  dyn_var<int> x = 2;
+  auto win = block.slice(span<4>(y), span<4>(x));
+  auto same = block.slice(range(y,y+4,1), range(x,x+4,1));
+  dyn_var<int> s = sum(win[i][j]);
+  ASSERT(s == 416);
+  dyn_var<int> d = sum(habs(win[i][j] - same[i][j]));
+  ASSERT(d == 0);
+  // strided, with a tail that isn't a multiple of the lanes
+  auto strided = block.slice(span<3>(y,2), span<3>(x,3));
+  dyn_var<int> ss = sum<2>(strided[i][j]);
+  ASSERT(ss == 288);
+  ASSERT(strided(2,2) == 5*9 + 8);
+  // writes through a window land in the right place
+  win[i][j] = i + j;
+  ASSERT(block(1,2) == 0);
+  ASSERT(block(4,5) == 6);
+  ASSERT(block(0,2) == 2);
+  ASSERT(block(5,5) == 50);
+  // a stack block's extents are all known
+  auto tile = Block<int,2>::stack<4,4>();
+  tile[i][j] = win[i][j] * 2;
+  dyn_var<int> t = sum(tile[i][j]);
+  ASSERT(t == 96);
+}
+
+int main() {
+  test_stage(staged, __FILE__);
+}
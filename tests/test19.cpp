@@ -0,0 +1,60 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/test_utils.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+static dyn_var<uint64_t(void)> arena_position = builder::as_global("shim::arena_position");
+
+// arena Blocks as per-iteration scratch
+static void staged() {
+  Iter<'i'> i;
+  Iter<'j'> j;
+  dyn_var<int> n = 5;
+  dyn_arr<int,5> out;
+  dyn_var<uint64_t> before = arena_position();
+  for (dyn_var<int> it = 0; it < n; it = it + 1) {
+    // the last iteration's buffers were freed, so this one reuses their memory
+    ASSERT(arena_position() == before);
+    // a fresh zeroed buffer every iteration, with dynamic extents
+    auto acc = Block<int,2>::arena({it + 1, 3});
+    ASSERT(arena_position() > before);
+    dyn_var<int> zero = sum(acc[i][j]);
+    ASSERT(zero == 0);
+    acc[i][j] = acc[i][j] + i + it;
+    // fully overwritten, so it doesn't need zeroing
+    auto scratch = Block<int,2>::arena({it + 1, 3}, ArenaInit::Overwritten, 32);
+    scratch[i][j] = acc[i][j] * 2;
+    dyn_var<int> s = sum(scratch[i][j]);
+    out[it] = s;
+  }
+  ASSERT(arena_position() == before);
+  // 6 * sum_{k<=it} (k + it)
+  ASSERT(out[0] == 0);
+  ASSERT(out[1] == 18);
+  ASSERT(out[2] == 54);
+  ASSERT(out[3] == 108);
+  ASSERT(out[4] == 180);
+  // arena Blocks in parallel iterations come from per-thread arenas
+  dyn_arr<int,5> par;
+  annotate_loop(Parallel());
+  for (dyn_var<int> it = 0; it < n; it = it + 1) {
+    auto tmp = Block<int,1>::arena({it + 2}, ArenaInit::Overwritten);
+    tmp[i] = i * it;
+    dyn_var<int> s = sum(tmp[i]);
+    par[it] = s;
+  }
+  ASSERT(par[3] == 30);
+  ASSERT(par[4] == 60);
+}
+
+int main() {
+  test_stage(staged, __FILE__);
+}
@@ -0,0 +1,51 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/bitstream.h"
+#include "staged/test_utils.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+// reading a bitstream through the refill cache
+static void staged() {
+  Iter<'i'> i;
+  auto bytes = Block<uint8_t,1>::stack<20>();
+  bytes[i] = cast<uint8_t>((i * 37 + 11) & 255);
+  Bitstream bs(bytes.allocator->raw(), 160);
+  dyn_var<uint64_t> a = bs.pop(3);
+  ASSERT(a == 0);
+  dyn_var<uint64_t> b = bs.pop(13);
+  ASSERT(b == 2864);
+  dyn_var<uint64_t> c = bs.peek(20);
+  ASSERT(c == 350121);
+  bs.skip(5);
+  // wider than a single refill
+  dyn_var<uint64_t> d = bs.pop(60);
+  ASSERT(d == 789607170841536176ull);
+  bs.align();
+  ASSERT(bs.position() == 88);
+  dyn_var<int> e = bs.pop_aligned<int>(8);
+  ASSERT(e == 162);
+  dyn_var<uint64_t> f = bs.peek(64);
+  ASSERT(f == 14405908233212437962ull);
+  // past what's in the cache
+  bs.skip(33);
+  dyn_var<uint64_t> g = bs.pop(17);
+  ASSERT(g == 93698);
+  ASSERT(bs.position() == 146);
+  ASSERT(bs.exists(14) == 1);
+  ASSERT(bs.exists(15) == 0);
+  // the tail reads 0s past the end
+  dyn_var<uint64_t> h = bs.pop(20);
+  ASSERT(h == 619136);
+}
+
+int main() {
+  test_stage(staged, __FILE__);
+}
@@ -0,0 +1,41 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/test_utils.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+// downsampling by accumulating through a refined view of the coarse block
+static void staged() {
+  Iter<'i'> i;
+  Iter<'j'> j;
+  Iter<'k'> k;
+  auto fine = Block<int,3>::stack<2,4,6>();
+  fine[i][j][k] = i * 100 + j * 6 + k;
+  auto coarse = Block<int,3>::stack<3,2,3>();
+  coarse[i][j][k] = 0;
+  // only the last two components, coarser by 2x2
+  auto sub = coarse.slice(range(1,3,1), range(0,2,1), range(0,3,1));
+  auto sub_fine = sub.virtually_refine(1,2,2);
+  sub_fine[i][j][k] = sub_fine[i][j][k] + fine[i][j][k];
+  ASSERT(coarse(0,1,2) == 0);
+  // 0 + 1 + 6 + 7
+  ASSERT(coarse(1,0,0) == 14);
+  // 16 + 17 + 22 + 23
+  ASSERT(coarse(1,1,2) == 78);
+  ASSERT(coarse(2,0,1) == 422);
+  // and reading back at the fine resolution
+  sub[i][j][k] = (sub[i][j][k] + 2) >> 2;
+  ASSERT(sub_fine(0,3,5) == 20);
+  ASSERT(sub_fine(1,0,1) == 104);
+}
+
+int main() {
+  test_stage(staged, __FILE__);
+}
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/test_utils.h"
+#include "color.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+// fixed-point color conversion against the double version, for every RGB value
+static void staged() {
+  Iter<'i'> i;
+  Iter<'j'> j;
+  Iter<'k'> k;
+  // R is fixed per iteration, with every G down the rows and every B across the columns
+  auto RGB = Block<uint8_t,3>::heap({256,256,3});
+  auto G = RGB.slice(range(0,256,1),range(0,256,1),range(1,2,1));
+  auto B = RGB.slice(range(0,256,1),range(0,256,1),range(2,3,1));
+  G[i][j][k] = cast<uint8_t>(i);
+  B[i][j][k] = cast<uint8_t>(j);
+  auto expected = Block<int,3>::heap({3,256,256});
+  auto actual = Block<int,3>::heap({3,256,256});
+  dyn_arr<int,3> mismatches;
+  for (builder::static_var<int> c = 0; c < 3; c = c + 1)
+    mismatches[c] = 0;
+  for (dyn_var<int> r = 0; r < 256; r = r + 1) {
+    auto R = RGB.slice(range(0,256,1),range(0,256,1),range(0,1,1));
+    R[i][j][k] = cast<uint8_t>(r);
+    color_double(RGB, expected);
+    color_fixed(RGB, actual);
+    for (builder::static_var<int> c = 0; c < 3; c = c + 1) {
+      auto e = expected.slice(range(c,c+1,1),range(0,256,1),range(0,256,1));
+      auto a = actual.slice(range(c,c+1,1),range(0,256,1),range(0,256,1));
+      dyn_var<int> off = sum(habs(e[i][j][k] - a[i][j][k]));
+      dyn_var<int> sq = sum((e[i][j][k] - a[i][j][k]) * (e[i][j][k] - a[i][j][k]));
+      // these are only equal if every difference is 0 or 1
+      ASSERT(off == sq);
+      mismatches[c] = mismatches[c] + off;
+    }
+  }
+  // not bit-exact (see color_fixed), but close: under 0.2% of the 2^24 values
+  ASSERT(mismatches[0] < 33554);
+  ASSERT(mismatches[1] < 33554);
+  ASSERT(mismatches[2] < 33554);
+}
+
+int main() {
+  test_stage(staged, __FILE__);
+}
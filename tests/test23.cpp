@@ -0,0 +1,82 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/test_utils.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+// Optimizations that can't be applied as written. Staging each of these must fail.
+
+// Collapses over loops that aren't perfectly nested with independent bounds
+
+// the fixed index is declared between the i and k loops
+static void fixed_index() {
+  Iter<'i'> i;
+  Iter<'k'> k;
+  auto block = Block<int,3>::heap({4,5,7});
+  Parallel::apply();
+  Collapse::apply(2);
+  block[i][2][k] = i + k;
+}
+
+// the point loop is bounded by its tile
+static void tiled() {
+  Iter<'i'> i;
+  Iter<'j'> j;
+  auto block = Block<int,2>::heap({10,7});
+  Parallel::apply();
+  Tile::apply(0, 4);
+  Collapse::apply(2);
+  block[i][j] = i + j;
+}
+
+// the i loop holds both the unrolled j loop and its remainder
+static void unrolled() {
+  Iter<'i'> i;
+  Iter<'j'> j;
+  auto block = Block<int,2>::heap({10,7});
+  Parallel::apply();
+  Unroll::apply(2);
+  Collapse::apply(2);
+  block[i][j] = i + j;
+}
+
+// Parallel::apply is for inline statements, so this leaves it queued
+static void actual_loop() {
+  dyn_arr<int,8> arr;
+  Parallel::apply();
+  for (dyn_var<int> r = 0; r < 8; r = r + 1) {
+    arr[r] = r;
+  }
+}
+
+// arena Blocks are freed by a C++ scope, so they can't be staged to C
+static void arena_in_c() {
+  Iter<'i'> i;
+  auto block = Block<int,1>::arena({8});
+  block[i] = i;
+}
+
+int main(int argc, char **argv) {
+  std::string which = argc > 1 ? argv[1] : "";
+  if (which == "fixed_index") {
+    test_stage(fixed_index, __FILE__);
+  } else if (which == "tiled") {
+    test_stage(tiled, __FILE__);
+  } else if (which == "unrolled") {
+    test_stage(unrolled, __FILE__);
+  } else if (which == "actual_loop") {
+    test_stage(actual_loop, __FILE__);
+  } else if (which == "arena_in_c") {
+    CompileOptions::isCPP = false;
+    stage(arena_in_c, "staged", "test23_generated", "", "");
+  } else {
+    std::cerr << "Usage: ./test23_generator <fixed_index|tiled|unrolled|actual_loop|arena_in_c>" << std::endl;
+  }
+}
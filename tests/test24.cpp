@@ -0,0 +1,37 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/test_utils.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+// StageCache reuse across runs of a generator. This is built twice, once with RELINKED, and the
+// two binaries are run one after the other on the same cache (see CMakeLists.txt). The second
+// must reuse the versioned function but not the unversioned one, since its binary differs.
+
+static dyn_var<int> versioned(dyn_var<int> a) {
+  Iter<'i'> i;
+  auto block = Block<int,1>::heap({8});
+  block[i] = a * i;
+  return sum(block[i]);
+}
+
+static dyn_var<int> unversioned(dyn_var<int> a) {
+  return a * 2;
+}
+
+int main() {
+#ifdef RELINKED
+  std::cout << "Relinked generator" << std::endl;
+#endif
+  CompileOptions::isCPP = true;
+  stage_all("test24_generated", "", "",
+	    Staged{versioned, "versioned", "1"},
+	    Staged{unversioned, "unversioned"});
+}
@@ -0,0 +1,124 @@
+#include <iostream>
+#include <utility>
+
+#include "runtime/cpp/heaparray.h"
+
+using namespace shim;
+
+// Reference counting in the runtime's HeapArray, without any staging. Meant to be run under
+// ASan and TSan too (see CMakeLists.txt), which catch anything freed too early, leaked, or
+// counted racily.
+
+#if defined(__SANITIZE_THREAD__)
+#define TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define TSAN 1
+#endif
+#endif
+
+#ifdef TSAN
+extern "C" void __tsan_acquire(void *addr);
+extern "C" void __tsan_release(void *addr);
+#endif
+
+// libgomp isn't built with TSan, so it can't see that the barrier at the end of a parallel
+// loop orders the iterations before the code after it. These tell it.
+static void end_iteration(void *loop) {
+#ifdef TSAN
+  __tsan_release(loop);
+#endif
+}
+
+static void after_loop(void *loop) {
+#ifdef TSAN
+  __tsan_acquire(loop);
+#endif
+}
+
+static bool check(bool ok, const char *what) {
+  if (!ok) {
+    std::cerr << "Failed: " << what << std::endl;
+  }
+  return ok;
+}
+
+static HeapArray<int> ramp(int n) {
+  HeapArray<int> arr(n);
+  for (int i = 0; i < n; i++) {
+    arr.write(i, i);
+  }
+  return arr;
+}
+
+static bool self_assignment() {
+  HeapArray<int> a = ramp(8);
+  HeapArray<int> &alias = a;
+  a = alias;
+  a = std::move(alias);
+  return check(a.base != nullptr && a[7] == 7, "self assignment keeps the array");
+}
+
+static bool assign_over_live() {
+  HeapArray<int> a = ramp(8);
+  HeapArray<int> b(16);
+  b.write(3, 42);
+  // drops a's only reference, so its array is freed here
+  a = b;
+  b.write(4, 43);
+  bool ok = check(a.base == b.base && a[3] == 42 && a[4] == 43, "copy assignment shares the array");
+  HeapArray<int> c = ramp(4);
+  // c's array goes, and b's now has a reference from each of a and c
+  c = std::move(b);
+  return ok && check(b.base == nullptr && c[3] == 42 && a[4] == 43, "move assignment hands over the array");
+}
+
+static bool moving() {
+  HeapArray<int> a = ramp(8);
+  HeapArray<int> b(std::move(a));
+  HeapArray<int> c(std::move(b));
+  return check(a.base == nullptr && b.base == nullptr && c[5] == 5, "moves leave the source empty");
+}
+
+static bool user_array() {
+  int data[4] = {1, 2, 3, 4};
+  {
+    HeapArray<int> a(data);
+    HeapArray<int> b = a;
+    b.write(0, 10);
+  }
+  // freeing data here would be caught by ASan
+  return check(data[0] == 10, "the user's array is written through");
+}
+
+// the copies a parallel loop makes of an array it shares
+static bool parallel_copies() {
+  constexpr int N = 4096;
+  HeapArray<int> shared(N);
+  HeapArray<int> tails(N);
+#pragma omp parallel for
+  for (int i = 0; i < N; i++) {
+    HeapArray<int> copy = shared;
+    copy.write(i, i);
+    HeapArray<int> local = ramp(i % 8 + 1);
+    local = copy;
+    HeapArray<int> moved(std::move(local));
+    tails.write(i, moved[i]);
+    end_iteration(&shared);
+  }
+  after_loop(&shared);
+  bool ok = true;
+  for (int i = 0; i < N; i++) {
+    ok = ok && shared[i] == i && tails[i] == i;
+  }
+  return check(ok, "copies in a parallel loop see the shared array");
+}
+
+int main() {
+  bool ok = self_assignment();
+  ok = assign_over_live() && ok;
+  ok = moving() && ok;
+  ok = user_array() && ok;
+  ok = parallel_copies() && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "builder/dyn_var.h"
+#include "builder/array.h"
+#include "staged/staged.h"
+#include "staged/test_utils.h"
+
+using builder::dyn_var;
+using builder::dyn_arr;
+using namespace shim;
+
+// vectorized inline statements
+static void staged() {
+  Iter<'i'> i;
+  Iter<'j'> j;
+  Iter<'k'> k;
+  auto block = Block<int,3>::heap({3,4,5});
+  Vectorize::apply(4);
+  block[i][j][k] = i*20+j*5+k;
+  ASSERT(block(0,0,0) == 0);
+  ASSERT(block(0,0,4) == 4);
+  ASSERT(block(1,2,3) == 33);
+  ASSERT(block(2,3,4) == 59);
+  // the innermost loop is i since the last index is fixed
+  auto block2 = Block<int,2>::heap({4,5});
+  Vectorize::apply();
+  block2[i][2] = block[1][i][2] + 1;
+  ASSERT(block2(0,2) == 23);
+  ASSERT(block2(3,2) == 38);
+  ASSERT(block2(3,1) == 0);
+  // nothing pending here
+  block2[i][j] = block2[i][j] + j;
+  ASSERT(block2(3,2) == 40);
+  ASSERT(block2(3,1) == 1);
+}
+
+int main() {
+  test_stage(staged, __FILE__);
+}